@@ -1,54 +1,678 @@
 /* farmacia_no_files_no_structs.c
-   Sistema de Farmacia sin archivos y sin structs/typedef.
-   - Todos los datos en memoria usando arrays paralelos.
+   Sistema de Farmacia en memoria, con arrays paralelos (nacio sin archivos
+   y sin structs/typedef; el nombre del archivo quedo de esa epoca).
+   - Todos los datos viven en memoria usando arrays paralelos; solo las
+     disposiciones no SoA (FARM_LAYOUT, mas abajo) usan structs.
    - "Exportar CSV" imprime CSV por pantalla (no escribe archivos).
+   - Archivos, todos opcionales: la importacion masiva de catalogo (opcion
+     15) y los remitos LEEN CSV; --registro escribe la bitacora y sus
+     imagenes de recuperacion (<bitacora>.ckpt); el stream de ventas
+     (opcion 16) escribe a un FIFO o archivo; el comando de lote prometheus
+     escribe las metricas; --grabar escribe una grabacion del menu. Sin
+     --registro, todo se pierde al cerrar o si se corta la luz.
+   - Trazas del camino de venta: compilar con -DFARMACIA_TRACE (opcion 18).
+   - Modo lote: ./farmacia --lote [archivo] ejecuta comandos de texto
+     (metricas, prometheus <ruta>, importar <ruta>, listar, ...).
+   - Bitacora y replica: ./farmacia --registro farmacia.log guarda cada cambio
+     (y lo recupera al volver a arrancar); ./farmacia --replica farmacia.log
+     es un segundo proceso de solo lectura para informes y exportaciones.
+     --registro-io uring|fdatasync|sin_sync elige como se baja a disco
+     (en Linux, io_uring por defecto: la venta no espera al disco);
+     bench_journal.c compara los tres.
+   - Grabacion: ./farmacia --grabar dia.rec guarda lo que se escribe en el
+     menu; ./farmacia --reproducir dia.rec [--velocidad N] lo vuelve a correr
+     (lo mas rapido posible o a N veces el ritmo original) e informa
+     rendimiento y percentiles por operacion.
+   - Motor embebible: las operaciones del negocio (farm_*, ver seccion MOTOR)
+     no usan teclado ni pantalla; con #define FARMACIA_SIN_MENU antes de
+     incluir este archivo se usan desde otro programa (benchmarks, servidor).
+   - Disposicion de las filas al compilar: -DFARM_LAYOUT=0 (SoA, arrays
+     paralelos, por defecto), 1 (AoS), 2 (AoSoA) o 3 (catalogo partido en
+     filas calientes y nombres aparte); solo las variantes no SoA usan
+     structs. bench_layouts.sh compara todas.
+   - Sucursales: hasta MAX_BRANCHES locales en un mismo motor (opcion 28,
+     comandos de lote sucursal/consolidado). Comparten el maestro de
+     productos; cada una tiene su stock y sus ventas, y los informes
+     consolidados recorren las sucursales en paralelo (hilos POSIX);
+     bench_branches.c los mide.
+   - Reposicion: cada venta actualiza la demanda diaria estimada del
+     producto (promedio exponencial y varianza, sin guardar ventas); la
+     opcion 29 y el comando de lote reposicion dan dias de cobertura y
+     cantidad a pedir de todo el catalogo.
+   - Recepcion de mercaderia: un remito (CSV Codigo,Cantidad, opcion 30, o
+     comandos de lote recepcion/recibir) se ordena por codigo y se cruza
+     con el catalogo en una pasada; suma el stock de una sucursal, queda en
+     la bitacora como un solo lote e informa codigos desconocidos y filas/s.
+     bench_receive.c lo compara con buscar cada renglon en el hash.
+   - Dueno: la contrasena se guarda como hash lento con sal (PBKDF2) y se
+     pide una vez por sesion; la sesion se cierra sola tras
+     OWNER_SESSION_IDLE_MIN minutos sin usar opciones del dueno, o con la
+     opcion 27.
    - Compilar: gcc -std=c11 -O2 -Wall farmacia_no_files_no_structs.c -o farmacia
+   - Para catalogos grandes se pueden subir los limites al compilar, ej:
+     gcc -std=c11 -O2 -Wall -DMAX_MEDICINES=1000000 farmacia_no_files_no_structs.c -o farmacia
 */
 
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64   /* off_t de 64 bits: bitacoras de mas de 2 GB */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE   /* syscall() y MADV_DONTFORK para io_uring */
+#endif
+
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
 
 #ifndef _WIN32
 #include <termios.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#endif
+/* Hilos solo para los informes consolidados de sucursales (en glibc
+   anteriores a 2.34 compilar con -pthread, o -DFARM_NO_THREADS) */
+#if !defined(_WIN32) && !defined(FARM_NO_THREADS)
+#include <pthread.h>
+#define BRANCH_THREADS 1
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(IOSQE_IO_LINK) && defined(IORING_FEAT_SINGLE_MMAP) && defined(__NR_io_uring_setup)
+#define JOURNAL_URING 1
+#endif
+#endif
 #endif
 
 /* ------------- CONFIG ------------- */
+#ifndef MAX_MEDICINES
 #define MAX_MEDICINES 200
+#endif
 #define MAX_NAME_LEN 64
+#ifndef MAX_SALES
 #define MAX_SALES 5000
+#endif
+#undef MAX_INPUT   /* <linux/limits.h> (via io_uring.h) tiene uno del sistema */
 #define MAX_INPUT 128
 #define DAYS_IN_MONTH 31
+#define MAX_SALES_PER_RECORD 32      /* lineas por carrito / registro de bitacora */
+#define JOURNAL_MAX_LINE 8192
+/* Sucursales en un mismo motor: 0 = este local, 1..MAX_BRANCHES-1 = las
+   demas (ver DATOS: particiones por sucursal) */
+#ifndef MAX_BRANCHES
+#define MAX_BRANCHES 4
+#endif
+#if MAX_BRANCHES < 2
+#error "MAX_BRANCHES debe ser al menos 2"
+#endif
 
-/* Contraseña inicial del dueño (en memoria). Se muestra en comentario. */
+/* Contraseña inicial del dueño (en memoria). Se muestra en comentario.
+   No se guarda en texto: ver CONTRASENA DEL DUENO. */
 /* contrasena inicial: admin123 */
-static char owner_password[64] = "admin123";
+#define OWNER_DEFAULT_PASSWORD "admin123"
+#define OWNER_PASSWORD_LEN 64
+/* Iteraciones del hash de la contrasena (PBKDF2-HMAC-SHA256): cuanto mas,
+   mas cuesta probar contrasenas por fuerza bruta y mas tarda cada ingreso */
+#ifndef OWNER_HASH_ITERS
+#define OWNER_HASH_ITERS 100000
+#endif
+/* Minutos sin usar una opcion del dueno hasta que se cierra la sesion */
+#ifndef OWNER_SESSION_IDLE_MIN
+#define OWNER_SESSION_IDLE_MIN 5
+#endif
+
+/* ------------- DISPOSICION EN MEMORIA DE LAS FILAS ------------- */
+/* Las filas del catalogo y de las ventas se leen y escriben solo con los
+   accesores MED_*(i) y SALE_*(i), asi la forma de guardarlas se elige al
+   compilar con -DFARM_LAYOUT=...:
+     FARM_LAYOUT_SOA   (por defecto) un array paralelo por campo, sin structs
+     FARM_LAYOUT_AOS   un array de filas (struct con todos los campos)
+     FARM_LAYOUT_AOSOA bloques de LAYOUT_BLOCK filas, cada campo contiguo
+                       dentro del bloque
+     FARM_LAYOUT_HOTCOLD catalogo partido: lo que usa la venta (codigo,
+                       precio, stock, venta libre) en filas de 32 bytes
+                       alineadas, dos por linea de cache; el nombre aparte.
+                       Las ventas quedan como en SoA.
+   Ver bench_layouts.c para compararlas. La imagen de checkpoint y la
+   bitacora tienen el mismo formato con cualquier disposicion. */
+#define FARM_LAYOUT_SOA 0
+#define FARM_LAYOUT_AOS 1
+#define FARM_LAYOUT_AOSOA 2
+#define FARM_LAYOUT_HOTCOLD 3
+#ifndef FARM_LAYOUT
+#define FARM_LAYOUT FARM_LAYOUT_SOA
+#endif
+#ifndef LAYOUT_BLOCK
+#define LAYOUT_BLOCK 8
+#endif
+#define DNI_LEN 32
 
 /* ------------- DATOS: arrays paralelos para medicamentos ------------- */
 static int med_count = 0;
+#if FARM_LAYOUT == FARM_LAYOUT_SOA
 static int med_code[MAX_MEDICINES];
 static char med_name[MAX_MEDICINES][MAX_NAME_LEN];
 static double med_price[MAX_MEDICINES];
 static int med_stock[MAX_MEDICINES];
 static int med_is_otc[MAX_MEDICINES];    /* 1 = venta libre, 0 = bajo receta */
 static int med_critical[MAX_MEDICINES];
+#define MED_CODE(i) (med_code[i])
+#define MED_NAME(i) (med_name[i])
+#define MED_PRICE(i) (med_price[i])
+#define MED_STOCK(i) (med_stock[i])
+#define MED_OTC(i) (med_is_otc[i])
+#define MED_CRIT(i) (med_critical[i])
+#elif FARM_LAYOUT == FARM_LAYOUT_AOS
+struct med_row { int code, stock, is_otc, critical; double price; char name[MAX_NAME_LEN]; };
+static struct med_row med_rows[MAX_MEDICINES];
+#define MED_CODE(i) (med_rows[i].code)
+#define MED_NAME(i) (med_rows[i].name)
+#define MED_PRICE(i) (med_rows[i].price)
+#define MED_STOCK(i) (med_rows[i].stock)
+#define MED_OTC(i) (med_rows[i].is_otc)
+#define MED_CRIT(i) (med_rows[i].critical)
+#elif FARM_LAYOUT == FARM_LAYOUT_AOSOA
+struct med_block {
+    int code[LAYOUT_BLOCK], stock[LAYOUT_BLOCK], is_otc[LAYOUT_BLOCK], critical[LAYOUT_BLOCK];
+    double price[LAYOUT_BLOCK];
+    char name[LAYOUT_BLOCK][MAX_NAME_LEN];
+};
+static struct med_block med_blocks[(MAX_MEDICINES + LAYOUT_BLOCK - 1) / LAYOUT_BLOCK];
+#define MED_CODE(i) (med_blocks[(i) / LAYOUT_BLOCK].code[(i) % LAYOUT_BLOCK])
+#define MED_NAME(i) (med_blocks[(i) / LAYOUT_BLOCK].name[(i) % LAYOUT_BLOCK])
+#define MED_PRICE(i) (med_blocks[(i) / LAYOUT_BLOCK].price[(i) % LAYOUT_BLOCK])
+#define MED_STOCK(i) (med_blocks[(i) / LAYOUT_BLOCK].stock[(i) % LAYOUT_BLOCK])
+#define MED_OTC(i) (med_blocks[(i) / LAYOUT_BLOCK].is_otc[(i) % LAYOUT_BLOCK])
+#define MED_CRIT(i) (med_blocks[(i) / LAYOUT_BLOCK].critical[(i) % LAYOUT_BLOCK])
+#else
+/* critico ocupa el lugar que sobra en la fila caliente (lo lee el informe
+   de stock critico junto con el stock) */
+struct med_hot_row { double price; int code, stock, is_otc, critical; char pad[8]; };
+static _Alignas(64) struct med_hot_row med_hot[MAX_MEDICINES];
+static char med_cold_name[MAX_MEDICINES][MAX_NAME_LEN];
+#define MED_CODE(i) (med_hot[i].code)
+#define MED_NAME(i) (med_cold_name[i])
+#define MED_PRICE(i) (med_hot[i].price)
+#define MED_STOCK(i) (med_hot[i].stock)
+#define MED_OTC(i) (med_hot[i].is_otc)
+#define MED_CRIT(i) (med_hot[i].critical)
+#endif
+
+/* Cubo pre-agregado producto x dia del mes en curso: unidades e importe.
+   Las filas son paralelas a med_* (se corren al eliminar, igual que el
+   resto). sell_medicine lo actualiza al vender, asi los informes por
+   producto no recorren las ventas. Las filas crecen con el catalogo (al
+   doble, ver cube_reserve). */
+static int cube_cap = 0;
+static int (*med_cube_units)[DAYS_IN_MONTH + 1];
+static double (*med_cube_amount)[DAYS_IN_MONTH + 1];
+
+/* Indice hash codigo -> posicion (direccionamiento abierto, sondeo lineal).
+   Cada casilla guarda indice+1; 0 = casilla vacia. Se dimensiona al doble
+   del catalogo para que las cadenas de sondeo sean cortas. */
+#define MED_INDEX_SIZE (2 * MAX_MEDICINES + 1)
+static int med_index_slot[MED_INDEX_SIZE];
 
 /* ------------- DATOS: arrays paralelos para ventas ------------- */
 static int sale_count = 0;
+/* SALE_TS: momento real de la venta en microsegundos desde 1970,
+   estrictamente creciente: como las ventas solo se agregan al final, ya es
+   un indice ordenado por tiempo y los rangos se buscan por busqueda binaria. */
+#if FARM_LAYOUT == FARM_LAYOUT_SOA || FARM_LAYOUT == FARM_LAYOUT_HOTCOLD
 static int sale_day[MAX_SALES];        /* dia 1..31 */
 static int sale_med_code[MAX_SALES];   /* codigo del medicamento */
 static int sale_qty[MAX_SALES];        /* cantidad vendida en la operacion */
 static double sale_amount[MAX_SALES];  /* importe total de la operacion */
-static char sale_dni[MAX_SALES][32];   /* dni del comprador si RX, '-' si OTC */
+static char sale_dni[MAX_SALES][DNI_LEN];   /* dni del comprador si RX, '-' si OTC */
+static long long sale_ts[MAX_SALES];
+#define SALE_DAY(i) (sale_day[i])
+#define SALE_CODE(i) (sale_med_code[i])
+#define SALE_QTY(i) (sale_qty[i])
+#define SALE_AMOUNT(i) (sale_amount[i])
+#define SALE_DNI(i) (sale_dni[i])
+#define SALE_TS(i) (sale_ts[i])
+#elif FARM_LAYOUT == FARM_LAYOUT_AOS
+struct sale_row { long long ts; double amount; int day, code, qty; char dni[DNI_LEN]; };
+static struct sale_row sale_rows[MAX_SALES];
+#define SALE_DAY(i) (sale_rows[i].day)
+#define SALE_CODE(i) (sale_rows[i].code)
+#define SALE_QTY(i) (sale_rows[i].qty)
+#define SALE_AMOUNT(i) (sale_rows[i].amount)
+#define SALE_DNI(i) (sale_rows[i].dni)
+#define SALE_TS(i) (sale_rows[i].ts)
+#else
+struct sale_block {
+    long long ts[LAYOUT_BLOCK];
+    double amount[LAYOUT_BLOCK];
+    int day[LAYOUT_BLOCK], code[LAYOUT_BLOCK], qty[LAYOUT_BLOCK];
+    char dni[LAYOUT_BLOCK][DNI_LEN];
+};
+static struct sale_block sale_blocks[(MAX_SALES + LAYOUT_BLOCK - 1) / LAYOUT_BLOCK];
+#define SALE_DAY(i) (sale_blocks[(i) / LAYOUT_BLOCK].day[(i) % LAYOUT_BLOCK])
+#define SALE_CODE(i) (sale_blocks[(i) / LAYOUT_BLOCK].code[(i) % LAYOUT_BLOCK])
+#define SALE_QTY(i) (sale_blocks[(i) / LAYOUT_BLOCK].qty[(i) % LAYOUT_BLOCK])
+#define SALE_AMOUNT(i) (sale_blocks[(i) / LAYOUT_BLOCK].amount[(i) % LAYOUT_BLOCK])
+#define SALE_DNI(i) (sale_blocks[(i) / LAYOUT_BLOCK].dni[(i) % LAYOUT_BLOCK])
+#define SALE_TS(i) (sale_blocks[(i) / LAYOUT_BLOCK].ts[(i) % LAYOUT_BLOCK])
+#endif
+static long long sale_last_ts = 0;
+/* Numero de secuencia global: la venta i del mes tiene secuencia
+   sale_seq_base + i + 1. Sigue creciendo despues de reiniciar el mes. */
+static long long sale_seq_base = 0;
+
+/* ------------- DATOS: particiones por sucursal ------------- */
+/* La sucursal 0 es este local: su stock es MED_STOCK y sus ventas los
+   arrays sale_* (con cubo, indices, stream, consultas y carrito). Las
+   sucursales 1..MAX_BRANCHES-1 comparten el maestro de productos (codigo,
+   nombre, precio, venta libre y critico de las filas med_*) y cada una
+   tiene su particion: una columna de stock paralela a med_* y su propio
+   registro de ventas del mes (particion p = sucursal p + 1). Vender en una
+   sucursal solo escribe su particion, asi las cajas de sucursales
+   distintas no comparten arrays ni lineas de cache. Las columnas de stock
+   crecen con el catalogo y las de ventas con las ventas de la particion
+   (al doble, ver branch_stock_reserve y branch_sales_reserve); no se
+   reservan de entrada para MAX_MEDICINES filas ni BRANCH_MAX_SALES ventas. */
+#define BRANCH_PARTS (MAX_BRANCHES - 1)
+#ifndef BRANCH_MAX_SALES
+#define BRANCH_MAX_SALES MAX_SALES
+#endif
+static int branch_count = 1;       /* sucursales en uso: 0..branch_count-1 */
+static int branch_stock_cap = 0;   /* filas con lugar en cada columna de stock */
+static int *branch_stock[BRANCH_PARTS];
+/* cantidad de ventas de cada particion, cada una en su linea de cache */
+static _Alignas(64) int branch_sale_rows[BRANCH_PARTS][16];
+#define BRANCH_SALES(p) (branch_sale_rows[p][0])
+static int branch_sale_cap[BRANCH_PARTS];
+static long long *branch_sale_ts[BRANCH_PARTS];
+static int *branch_sale_day[BRANCH_PARTS];
+static int *branch_sale_code[BRANCH_PARTS];
+static int *branch_sale_qty[BRANCH_PARTS];
+static double *branch_sale_amount[BRANCH_PARTS];
+static char (*branch_sale_dni[BRANCH_PARTS])[DNI_LEN];
+
+/* Lugar para rows filas del catalogo en el stock de todas las
+   particiones (las filas nuevas arrancan en 0). 0 si no hubo memoria. */
+static int branch_stock_reserve(int rows) {
+    if (rows <= branch_stock_cap) return 1;
+    int ncap = branch_stock_cap ? branch_stock_cap : 1024;
+    while (ncap < rows) ncap *= 2;
+    if (ncap > MAX_MEDICINES) ncap = MAX_MEDICINES;
+    for (int p = 0; p < BRANCH_PARTS; ++p) {
+        int *col = realloc(branch_stock[p], sizeof(int) * (size_t)ncap);
+        if (!col) return 0;
+        memset(col + branch_stock_cap, 0, sizeof(int) * (size_t)(ncap - branch_stock_cap));
+        branch_stock[p] = col;
+    }
+    branch_stock_cap = ncap;
+    return 1;
+}
+
+/* Lugar para rows ventas en la particion p. 0 si no hubo memoria. */
+static int branch_sales_reserve(int p, int rows) {
+    if (rows <= branch_sale_cap[p]) return 1;
+    int ncap = branch_sale_cap[p] ? branch_sale_cap[p] : 1024;
+    while (ncap < rows) ncap *= 2;
+    if (ncap > BRANCH_MAX_SALES) ncap = BRANCH_MAX_SALES;
+    long long *ts = realloc(branch_sale_ts[p], sizeof(ts[0]) * (size_t)ncap);
+    if (ts) branch_sale_ts[p] = ts;
+    int *day = realloc(branch_sale_day[p], sizeof(day[0]) * (size_t)ncap);
+    if (day) branch_sale_day[p] = day;
+    int *code = realloc(branch_sale_code[p], sizeof(code[0]) * (size_t)ncap);
+    if (code) branch_sale_code[p] = code;
+    int *qty = realloc(branch_sale_qty[p], sizeof(qty[0]) * (size_t)ncap);
+    if (qty) branch_sale_qty[p] = qty;
+    double *amount = realloc(branch_sale_amount[p], sizeof(amount[0]) * (size_t)ncap);
+    if (amount) branch_sale_amount[p] = amount;
+    char (*dni)[DNI_LEN] = realloc(branch_sale_dni[p], sizeof(dni[0]) * (size_t)ncap);
+    if (dni) branch_sale_dni[p] = dni;
+    if (!ts || !day || !code || !qty || !amount || !dni) return 0;
+    branch_sale_cap[p] = ncap;
+    return 1;
+}
 
 /* ------------- UTILIDADES DE ENTRADA ------------- */
+/* Reloj monotono en nanosegundos (para medir tiempos de operaciones) */
+static long long now_ns(void) {
+#ifdef _WIN32
+    return (long long)clock() * (1000000000LL / CLOCKS_PER_SEC);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+/* Tiempo total bloqueado esperando al usuario; las metricas lo descuentan
+   para medir solo el trabajo del sistema. */
+static long long input_wait_ns = 0;
+
+/* ------------- CONTRASENA DEL DUENO ------------- */
+/* La contrasena se guarda como sal aleatoria + PBKDF2-HMAC-SHA256 con
+   OWNER_HASH_ITERS iteraciones, nunca en texto. Verificar cuesta lo mismo
+   que calcular el hash (a proposito: frena la fuerza bruta), por eso el
+   menu lo paga una vez por sesion del dueno y no en cada opcion (ver
+   farm_owner_login). Las comparaciones son de tiempo constante. */
+#define SHA256_LEN 32
+#define OWNER_SALT_LEN 16
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define SHA_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t st[8], const unsigned char *blk) {
+    uint32_t w[64], v[8];
+    for (int t = 0; t < 16; ++t)
+        w[t] = (uint32_t)blk[4*t] << 24 | (uint32_t)blk[4*t+1] << 16 | (uint32_t)blk[4*t+2] << 8 | blk[4*t+3];
+    for (int t = 16; t < 64; ++t) {
+        uint32_t s0 = SHA_ROR(w[t-15], 7) ^ SHA_ROR(w[t-15], 18) ^ (w[t-15] >> 3);
+        uint32_t s1 = SHA_ROR(w[t-2], 17) ^ SHA_ROR(w[t-2], 19) ^ (w[t-2] >> 10);
+        w[t] = w[t-16] + s0 + w[t-7] + s1;
+    }
+    memcpy(v, st, sizeof(v));
+    for (int t = 0; t < 64; ++t) {
+        uint32_t t1 = v[7] + (SHA_ROR(v[4], 6) ^ SHA_ROR(v[4], 11) ^ SHA_ROR(v[4], 25))
+                    + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[t] + w[t];
+        uint32_t t2 = (SHA_ROR(v[0], 2) ^ SHA_ROR(v[0], 13) ^ SHA_ROR(v[0], 22))
+                    + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int k = 0; k < 8; ++k) st[k] += v[k];
+}
+
+/* SHA-256 de data partiendo del estado init, que ya proceso prefix bytes
+   (prefix multiplo de 64; init = sha256_iv y prefix 0 es el hash comun) */
+static void sha256_from(const uint32_t init[8], unsigned long long prefix,
+                        const unsigned char *data, size_t len, unsigned char out[SHA256_LEN]) {
+    uint32_t st[8];
+    unsigned char tail[128];
+    size_t full = len & ~(size_t)63, rest = len - full;
+    memcpy(st, init, sizeof(st));
+    for (size_t off = 0; off < full; off += 64) sha256_block(st, data + off);
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, data + full, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = rest < 56 ? 64 : 128;
+    unsigned long long bits = (prefix + len) * 8;
+    for (int b = 0; b < 8; ++b) tail[tail_len - 1 - b] = (unsigned char)(bits >> (8 * b));
+    for (size_t off = 0; off < tail_len; off += 64) sha256_block(st, tail + off);
+    for (int k = 0; k < 8; ++k)
+        for (int b = 0; b < 4; ++b) out[4*k+b] = (unsigned char)(st[k] >> (24 - 8 * b));
+}
+
+/* PBKDF2-HMAC-SHA256 con salida de un bloque (32 bytes). Los estados
+   internos de HMAC (clave ^ ipad / opad) se calculan una sola vez, asi
+   cada iteracion cuesta dos bloques de SHA-256. */
+static void pbkdf2_sha256(const char *password, const unsigned char *salt, size_t salt_len,
+                          long iters, unsigned char out[SHA256_LEN]) {
+    unsigned char key[64], pad[64], u[SHA256_LEN], msg[OWNER_SALT_LEN + 4];
+    uint32_t ist[8], ost[8];
+    size_t klen = strlen(password);
+    memset(key, 0, sizeof(key));
+    if (klen > 64) sha256_from(sha256_iv, 0, (const unsigned char *)password, klen, key);
+    else memcpy(key, password, klen);
+    for (int b = 0; b < 64; ++b) pad[b] = key[b] ^ 0x36;
+    memcpy(ist, sha256_iv, sizeof(ist));
+    sha256_block(ist, pad);
+    for (int b = 0; b < 64; ++b) pad[b] = key[b] ^ 0x5c;
+    memcpy(ost, sha256_iv, sizeof(ost));
+    sha256_block(ost, pad);
+
+    if (salt_len > OWNER_SALT_LEN) salt_len = OWNER_SALT_LEN;
+    memcpy(msg, salt, salt_len);
+    msg[salt_len] = 0; msg[salt_len + 1] = 0; msg[salt_len + 2] = 0; msg[salt_len + 3] = 1;
+    sha256_from(ist, 64, msg, salt_len + 4, u);
+    sha256_from(ost, 64, u, SHA256_LEN, u);
+    memcpy(out, u, SHA256_LEN);
+    for (long i = 1; i < iters; ++i) {
+        sha256_from(ist, 64, u, SHA256_LEN, u);
+        sha256_from(ost, 64, u, SHA256_LEN, u);
+        for (int b = 0; b < SHA256_LEN; ++b) out[b] ^= u[b];
+    }
+    memset(key, 0, sizeof(key));
+    memset(pad, 0, sizeof(pad));
+}
+
+/* Igualdad sin cortar en el primer byte distinto: el tiempo no dice
+   cuantos bytes coincidieron */
+static int const_time_equal(const unsigned char *a, const unsigned char *b, size_t n) {
+    unsigned char diff = 0;
+    for (size_t k = 0; k < n; ++k) diff |= a[k] ^ b[k];
+    return diff == 0;
+}
+
+/* Bytes aleatorios para sales y tokens de sesion. En POSIX /dev/urandom;
+   si no esta (o en Windows) se mezclan relojes con SHA-256, que alcanza
+   para que la sal no se repita pero no es aleatoriedad de calidad. */
+static void random_bytes(unsigned char *out, size_t n) {
+#ifndef _WIN32
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (f) {
+        size_t got = fread(out, 1, n, f);
+        fclose(f);
+        if (got == n) return;
+    }
+#endif
+    static unsigned long long counter = 0;
+    unsigned char seed[32], h[SHA256_LEN];
+    for (size_t off = 0; off < n; off += SHA256_LEN) {
+        long long t = now_ns();
+        time_t wall = time(NULL);
+        counter++;
+        memcpy(seed, &t, sizeof(t));
+        memcpy(seed + 8, &wall, sizeof(wall) < 8 ? sizeof(wall) : 8);
+        memcpy(seed + 16, &counter, sizeof(counter));
+        memcpy(seed + 24, &out, sizeof(out) < 8 ? sizeof(out) : 8);
+        sha256_from(sha256_iv, 0, seed, sizeof(seed), h);
+        memcpy(out + off, h, n - off < SHA256_LEN ? n - off : SHA256_LEN);
+    }
+}
+
+static unsigned char owner_salt[OWNER_SALT_LEN];
+static unsigned char owner_hash[SHA256_LEN];
+static int owner_hash_ready = 0;   /* 0 = todavia la inicial (se calcula al primer uso) */
+
+static void owner_password_store(const char *password) {
+    random_bytes(owner_salt, sizeof(owner_salt));
+    pbkdf2_sha256(password, owner_salt, sizeof(owner_salt), OWNER_HASH_ITERS, owner_hash);
+    owner_hash_ready = 1;
+}
+
+/* La parte cara: un PBKDF2 completo */
+static int owner_password_matches(const char *typed) {
+    unsigned char h[SHA256_LEN];
+    if (!owner_hash_ready) owner_password_store(OWNER_DEFAULT_PASSWORD);
+    pbkdf2_sha256(typed, owner_salt, sizeof(owner_salt), OWNER_HASH_ITERS, h);
+    int same = const_time_equal(h, owner_hash, SHA256_LEN);
+    memset(h, 0, sizeof(h));
+    return same;
+}
+
+/* ------------- GRABACION Y REPRODUCCION ------------- */
+/* --grabar <archivo> guarda cada linea que el usuario escribe en el menu
+   (opcion y argumentos: codigo, cantidad, dia, DNI, ...) con el momento en
+   que llego, para reproducir despues un dia real con --reproducir.
+   Formato binario: "FARMREC1" y luego registros
+     tipo (1 byte) | us desde el registro anterior (varint) | largo (varint) | texto
+   Las contrasenas no se guardan: solo si coincidian con la del dueno en ese
+   momento (REC_PASS_OK) o no (REC_PASS_OTHER, se reproduce como un valor fijo
+   que no coincide). Como la del dueno solo esta hasheada, la reproduccion
+   usa replay_password: arranca en la inicial y sigue los cambios que hace
+   la misma reproduccion. La grabacion no verifica nada por su cuenta: la
+   contrasena queda pendiente y se graba con el resultado de la verificacion
+   que hace el que la pidio (rec_password_result). Una que nadie verifica
+   (la nueva y su confirmacion) se graba como REC_PASS_OTHER al leer lo
+   siguiente; la reproduccion la cambia a ese valor fijo y las entradas
+   REC_PASS_OK que siguen lo repiten, asi que sigue coincidiendo. */
+#define REC_MAGIC "FARMREC1"
+#define REC_LINE 0
+#define REC_PASS_OK 1
+#define REC_PASS_OTHER 2
+#define REC_PASS_PLACEHOLDER "\x01"
+
+static FILE *rec_fp = NULL;
+static long long rec_last_ns = 0;
+static int rec_pass_pending = 0;      /* contrasena leida, todavia sin grabar */
+static long long rec_pass_ns = 0;     /* cuando se leyo */
+
+static FILE *replay_fp = NULL;
+static double replay_speed = 0.0;     /* 0 = lo mas rapido posible; N = N veces el ritmo original */
+static int replay_done = 0;
+static long long replay_start_ns = 0;
+static long long replay_orig_us = 0;  /* tiempo original acumulado hasta el registro actual */
+static long replay_records = 0;
+static char replay_password[OWNER_PASSWORD_LEN] = OWNER_DEFAULT_PASSWORD;
+
+static void rec_put_varint(unsigned long long v) {
+    while (v >= 0x80) { fputc((int)(v & 0x7f) | 0x80, rec_fp); v >>= 7; }
+    fputc((int)v, rec_fp);
+}
+
+static int rec_get_varint(unsigned long long *out) {
+    unsigned long long v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(replay_fp);
+        if (c == EOF) return 0;
+        v |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80)) { *out = v; return 1; }
+    }
+    return 0;
+}
+
+static int rec_open(const char *path) {
+    rec_fp = fopen(path, "wb");
+    if (!rec_fp) return 0;
+    fwrite(REC_MAGIC, 1, 8, rec_fp);
+    fflush(rec_fp);
+    rec_last_ns = now_ns();
+    return 1;
+}
+
+static void rec_write_at(int type, const char *text, long long t) {
+    size_t len = type == REC_LINE ? strlen(text) : 0;
+    fputc(type, rec_fp);
+    rec_put_varint((unsigned long long)((t - rec_last_ns) / 1000));
+    rec_put_varint(len);
+    fwrite(text, 1, len, rec_fp);
+    fflush(rec_fp);   /* si el programa se corta, lo grabado hasta aca sirve */
+    rec_last_ns = t;
+}
+
+/* Graba la contrasena pendiente; ok = coincidia con la del dueno */
+static void rec_password_result(int ok) {
+    if (!rec_fp || !rec_pass_pending) return;
+    rec_pass_pending = 0;
+    rec_write_at(ok ? REC_PASS_OK : REC_PASS_OTHER, NULL, rec_pass_ns);
+}
+
+static void rec_write(int type, const char *text) {
+    rec_password_result(0);   /* nadie la verifico */
+    rec_write_at(type, text, now_ns());
+}
+
+/* Sin PBKDF2 ni copia del texto: el resultado lo pasa rec_password_result */
+static void rec_write_password(const char *typed) {
+    if (typed[0] == '\0') { rec_write(REC_LINE, ""); return; }
+    rec_password_result(0);
+    rec_pass_pending = 1;
+    rec_pass_ns = now_ns();
+}
+
+static int replay_open(const char *path) {
+    char magic[8];
+    replay_fp = fopen(path, "rb");
+    if (!replay_fp) return 0;
+    if (fread(magic, 1, 8, replay_fp) != 8 || memcmp(magic, REC_MAGIC, 8) != 0) {
+        fclose(replay_fp);
+        replay_fp = NULL;
+        return 0;
+    }
+    replay_start_ns = now_ns();
+    return 1;
+}
+
+/* Espera hasta el momento original del registro (escalado por replay_speed) */
+static void replay_pace(void) {
+    if (replay_speed <= 0) return;
+    long long target = replay_start_ns + (long long)((double)replay_orig_us * 1000.0 / replay_speed);
+#ifdef _WIN32
+    while (now_ns() < target) { }
+#else
+    long long wait = target - now_ns();
+    if (wait > 0) {
+        struct timespec ts = { (time_t)(wait / 1000000000LL), (long)(wait % 1000000000LL) };
+        nanosleep(&ts, NULL);
+    }
+#endif
+}
+
+/* Siguiente linea del registro. Al terminar deja buf vacio y replay_done. */
+static void replay_next(char *buf, size_t n) {
+    int type = fgetc(replay_fp);
+    unsigned long long delta, len;
+    buf[0] = '\0';
+    if (type == EOF || !rec_get_varint(&delta) || !rec_get_varint(&len)) { replay_done = 1; return; }
+    replay_orig_us += (long long)delta;
+    replay_pace();
+    replay_records++;
+    if (type == REC_PASS_OK) { strncpy(buf, replay_password, n - 1); buf[n - 1] = '\0'; return; }
+    if (type == REC_PASS_OTHER) { strncpy(buf, REC_PASS_PLACEHOLDER, n - 1); buf[n - 1] = '\0'; return; }
+    size_t keep = len < n - 1 ? (size_t)len : n - 1;
+    if (fread(buf, 1, keep, replay_fp) != keep) { buf[0] = '\0'; replay_done = 1; return; }
+    buf[keep] = '\0';
+    for (unsigned long long k = keep; k < len; ++k) fgetc(replay_fp);
+}
+
+/* Salida a pantalla: stdout va a un buffer propio y se escribe de una sola
+   vez antes de cada lectura del teclado, asi un menu o un listado completo
+   es una sola escritura (y no una llamada al sistema por cada printf, que
+   por SSH se nota). Si el buffer se llena se vuelca solo. */
+#define SCREEN_BUF_SIZE (1 << 16)
+static char screen_buf[SCREEN_BUF_SIZE];
+
+static void screen_init(void) {
+    setvbuf(stdout, screen_buf, _IOFBF, sizeof(screen_buf));
+}
+
+/* Mostrar lo pendiente; llamar antes de esperar al usuario */
+static void screen_flush(void) {
+    fflush(stdout);
+}
+
 static void read_line(char *buf, size_t n) {
-    if (!fgets(buf, (int)n, stdin)) { buf[0] = '\0'; return; }
+    screen_flush();
+    long long t0 = now_ns();
+    if (replay_fp) replay_next(buf, n);
+    else if (!fgets(buf, (int)n, stdin)) buf[0] = '\0';
+    input_wait_ns += now_ns() - t0;
     size_t len = strlen(buf);
     if (len && buf[len-1] == '\n') buf[len-1] = '\0';
+    if (rec_fp) rec_write(REC_LINE, buf);
 }
 
 static void trim(char *s) {
@@ -64,23 +688,38 @@ static void trim(char *s) {
 */
 static void read_password(char *out, size_t maxlen) {
     size_t i = 0;
+    if (replay_fp) {
+        long long t0 = now_ns();
+        replay_next(out, maxlen);
+        input_wait_ns += now_ns() - t0;
+        printf("\n");
+        return;
+    }
 #ifdef _WIN32
     /* Windows simple: no ocultamos (puede mejorarse con conio.h en Windows) */
+    FILE *rec = rec_fp;
+    rec_fp = NULL;          /* que read_line no grabe el texto */
     read_line(out, maxlen);
+    rec_fp = rec;
+    if (rec_fp) rec_write_password(out);
     return;
 #else
+    screen_flush();
     struct termios oldt, newt;
     tcgetattr(STDIN_FILENO, &oldt);
     newt = oldt;
     newt.c_lflag &= ~(ECHO);
     tcsetattr(STDIN_FILENO, TCSANOW, &newt);
 
+    long long t0 = now_ns();
     int c;
     while ((c = getchar()) != '\n' && c != EOF && i + 1 < maxlen) {
         out[i++] = (char)c;
     }
     out[i] = '\0';
+    input_wait_ns += now_ns() - t0;
     tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    if (rec_fp) rec_write_password(out);
     printf("\n");
     return;
 #endif
@@ -124,315 +763,5840 @@ static int prompt_double(const char *prompt, double *out_val) {
     }
 }
 
-/* ------------- BÚSQUEDAS ------------- */
-static int find_med_index_by_code(int code) {
-    for (int i = 0; i < med_count; ++i) if (med_code[i] == code) return i;
-    return -1;
+/* Entre paginas de un listado: 1 = seguir, 0 = terminar */
+static int prompt_next_page(void) {
+    char buf[MAX_INPUT];
+    printf("-- ENTER: pagina siguiente | 0: terminar -- ");
+    read_line(buf, sizeof(buf));
+    trim(buf);
+    return buf[0] != '0';
 }
 
-/* ------------- FUNCIONES DE MEDICAMENTOS ------------- */
-static void add_medicine(void) {
-    if (med_count >= MAX_MEDICINES) { printf("Limite de catalogo alcanzado.\n"); return; }
+/* Marca de tiempo para una venta nueva (ver SALE_TS). Si el reloj del
+   sistema retrocede, se sigue desde la ultima marca + 1 us. */
+static long long sale_timestamp_now(void) {
+    long long us;
+#ifdef _WIN32
+    us = (long long)time(NULL) * 1000000LL;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    us = (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+    if (us <= sale_last_ts) us = sale_last_ts + 1;
+    sale_last_ts = us;
+    return us;
+}
 
-    int code;
-    if (!prompt_int("Ingrese codigo (vaciar para cancelar): ", &code)) return;
-    if (find_med_index_by_code(code) != -1) { printf("Codigo ya existente.\n"); return; }
+/* ------------- METRICAS: contadores e histogramas de latencia ------------- */
+/* Histograma log-lineal estilo HDR: los valores < 8 ns van a su propio
+   casillero; el resto se agrupa por potencia de 2 (bit mas alto) y dentro
+   de cada potencia en 8 sub-casilleros lineales. Error relativo <= 12.5%.
+   Registrar un valor cuesta un clz, dos shifts y un incremento. */
+#define OP_SELL 0
+#define OP_ADD 1
+#define OP_EDIT 2
+#define OP_DELETE 3
+#define OP_LIST 4
+#define OP_REPORT_MONTHLY 5
+#define OP_REPORT_DAY 6
+#define OP_REPORT_RX 7
+#define OP_REPORT_CRITICAL 8
+#define OP_EXPORT_MEDS 9
+#define OP_EXPORT_SALES 10
+#define OP_IMPORT_MEDS 11
+#define OP_SELL_CART 12
+#define OP_QUERY 13
+#define OP_SELL_BRANCH 14
+#define OP_REPORT_CONSOLIDATED 15
+#define OP_REPORT_REORDER 16
+#define OP_RECEIVE 17
+#define OP_COUNT 18
 
-    char name[MAX_NAME_LEN];
-    printf("Nombre: ");
-    read_line(name, sizeof(name));
-    trim(name);
-    if (name[0] == '\0') { printf("Nombre vacio. Cancelado.\n"); return; }
+#define METRIC_SUB_BITS 3
+#define METRIC_SUB (1 << METRIC_SUB_BITS)
+#define METRIC_BUCKETS ((64 - METRIC_SUB_BITS + 1) * METRIC_SUB)
 
-    double price;
-    if (!prompt_double("Precio (ej: 123.45): ", &price)) return;
-    if (price < 0) { printf("Precio invalido.\n"); return; }
+static const char *op_names[OP_COUNT] = {
+    "vender", "agregar", "editar", "eliminar", "listar",
+    "informe_mensual", "informe_dia", "registros_rx", "stock_critico",
+    "csv_medicamentos", "csv_ventas", "importar_medicamentos", "vender_carrito", "consulta",
+    "vender_sucursal", "informe_consolidado", "reposicion", "recepcion"
+};
+static unsigned long long metric_count[OP_COUNT];
+static unsigned long long metric_sum_ns[OP_COUNT];
+static unsigned long long metric_max_ns[OP_COUNT];
+static unsigned long long metric_hist[OP_COUNT][METRIC_BUCKETS];
 
-    int stock;
-    if (!prompt_int("Stock inicial: ", &stock)) return;
-    if (stock < 0) { printf("Stock invalido.\n"); return; }
+static char metric_prom_path[MAX_INPUT] = "";
+static int metric_prom_interval = 0;        /* segundos; 0 = solo a pedido */
+static long long metric_prom_last_ns = 0;
 
-    char otcbuf[MAX_INPUT];
-    int is_otc = -1;
-    while (is_otc == -1) {
-        printf("Venta libre? (s/n): ");
-        read_line(otcbuf, sizeof(otcbuf));
-        trim(otcbuf);
-        if (otcbuf[0] == '\0') { printf("Cancelado.\n"); return; }
-        if (tolower((unsigned char)otcbuf[0]) == 's') is_otc = 1;
-        else if (tolower((unsigned char)otcbuf[0]) == 'n') is_otc = 0;
-        else printf("Respuesta invalida, ingrese s o n.\n");
-    }
+static int metric_bucket(unsigned long long v) {
+    if (v < METRIC_SUB) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    return (msb - METRIC_SUB_BITS + 1) * METRIC_SUB + (int)((v >> (msb - METRIC_SUB_BITS)) & (METRIC_SUB - 1));
+}
 
-    int crit;
-    if (!prompt_int("Stock critico: ", &crit)) return;
-    if (crit < 0) { printf("Stock critico invalido.\n"); return; }
+/* Limite inferior (en ns) de un casillero */
+static unsigned long long metric_bucket_low(int b) {
+    if (b < METRIC_SUB) return (unsigned long long)b;
+    int msb = b / METRIC_SUB + METRIC_SUB_BITS - 1;
+    return (unsigned long long)(METRIC_SUB + b % METRIC_SUB) << (msb - METRIC_SUB_BITS);
+}
 
-    int idx = med_count++;
-    med_code[idx] = code;
-    strncpy(med_name[idx], name, MAX_NAME_LEN-1); med_name[idx][MAX_NAME_LEN-1] = '\0';
-    med_price[idx] = price;
-    med_stock[idx] = stock;
-    med_is_otc[idx] = is_otc;
-    med_critical[idx] = crit;
+/* Marca de inicio: reloj menos la espera de entrada acumulada */
+static long long metric_start(void) {
+    return now_ns() - input_wait_ns;
+}
 
-    printf("Medicamento agregado (indice %d).\n", idx);
+static void metric_end(int op, long long start) {
+    long long d = now_ns() - input_wait_ns - start;
+    unsigned long long v = d > 0 ? (unsigned long long)d : 0;
+    metric_count[op]++;
+    metric_sum_ns[op] += v;
+    if (v > metric_max_ns[op]) metric_max_ns[op] = v;
+    metric_hist[op][metric_bucket(v)]++;
 }
 
-static void list_medicines(void) {
-    if (med_count == 0) { printf("No hay medicamentos registrados.\n"); return; }
-    printf("Codigo | Nombre                           | Precio   | Stock | Tipo | Critico\n");
-    printf("-----------------------------------------------------------------------------\n");
-    for (int i = 0; i < med_count; ++i) {
-        printf("%6d | %-32s | %8.2f | %5d | %4s | %7d\n",
-               med_code[i],
-               med_name[i],
-               med_price[i],
-               med_stock[i],
-               med_is_otc[i] ? "OTC" : "RX",
-               med_critical[i]);
+static unsigned long long metric_percentile(int op, double pct) {
+    unsigned long long target = (unsigned long long)(pct / 100.0 * (double)metric_count[op] + 0.5);
+    unsigned long long acc = 0;
+    if (target == 0) target = 1;
+    for (int b = 0; b < METRIC_BUCKETS; ++b) {
+        acc += metric_hist[op][b];
+        if (acc >= target) return metric_bucket_low(b);
     }
+    return metric_max_ns[op];
 }
 
-static void show_medicine_by_code(void) {
-    int code;
-    if (!prompt_int("Ingrese codigo (vaciar para cancelar): ", &code)) return;
-    int idx = find_med_index_by_code(code);
-    if (idx == -1) { printf("No encontrado.\n"); return; }
-    printf("Codigo: %d\nNombre: %s\nPrecio: %.2f\nStock: %d\nTipo: %s\nCritico: %d\n",
-           med_code[idx], med_name[idx], med_price[idx], med_stock[idx],
-           med_is_otc[idx] ? "Venta libre (OTC)" : "Bajo receta (RX)", med_critical[idx]);
+static void print_metrics(FILE *out) {
+    fprintf(out, "Operacion             | Cantidad |  Prom us |   p50 us |   p90 us |   p99 us |   Max us\n");
+    fprintf(out, "--------------------------------------------------------------------------------------\n");
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (metric_count[op] == 0) { fprintf(out, "%-21s | %8d |        - |        - |        - |        - |        -\n", op_names[op], 0); continue; }
+        fprintf(out, "%-21s | %8llu | %8.1f | %8.1f | %8.1f | %8.1f | %8.1f\n", op_names[op], metric_count[op],
+               (double)metric_sum_ns[op] / (double)metric_count[op] / 1e3,
+               metric_percentile(op, 50) / 1e3, metric_percentile(op, 90) / 1e3,
+               metric_percentile(op, 99) / 1e3, metric_max_ns[op] / 1e3);
+    }
 }
 
-static void edit_medicine(void) {
-    int code;
-    if (!prompt_int("Codigo a editar (vaciar cancelar): ", &code)) return;
-    int idx = find_med_index_by_code(code);
-    if (idx == -1) { printf("Medicamento no encontrado.\n"); return; }
+/* Escribe las metricas en formato de texto Prometheus. Se escribe a un
+   archivo temporal y se renombra, asi el recolector nunca lee uno a medias.
+   Los "le" del histograma son potencias de 2 desde ~1 us hasta ~17 s. */
+static int write_metrics_prometheus(const char *path) {
+    char tmp[MAX_INPUT + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return 0;
+    fprintf(fp, "# HELP farmacia_operaciones_total Operaciones completadas por tipo.\n");
+    fprintf(fp, "# TYPE farmacia_operaciones_total counter\n");
+    for (int op = 0; op < OP_COUNT; ++op)
+        fprintf(fp, "farmacia_operaciones_total{op=\"%s\"} %llu\n", op_names[op], metric_count[op]);
+    fprintf(fp, "# HELP farmacia_latencia_segundos Latencia de cada operacion (sin espera de teclado).\n");
+    fprintf(fp, "# TYPE farmacia_latencia_segundos histogram\n");
+    for (int op = 0; op < OP_COUNT; ++op) {
+        unsigned long long acc = 0;
+        int b = 0;
+        for (int k = 10; k <= 34; ++k) {
+            unsigned long long le = 1ULL << k;
+            while (b < METRIC_BUCKETS && metric_bucket_low(b) < le) acc += metric_hist[op][b++];
+            fprintf(fp, "farmacia_latencia_segundos_bucket{op=\"%s\",le=\"%.9g\"} %llu\n", op_names[op], (double)le / 1e9, acc);
+        }
+        fprintf(fp, "farmacia_latencia_segundos_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", op_names[op], metric_count[op]);
+        fprintf(fp, "farmacia_latencia_segundos_sum{op=\"%s\"} %.9f\n", op_names[op], metric_sum_ns[op] / 1e9);
+        fprintf(fp, "farmacia_latencia_segundos_count{op=\"%s\"} %llu\n", op_names[op], metric_count[op]);
+    }
+    if (fclose(fp) != 0) { remove(tmp); return 0; }
+    if (rename(tmp, path) != 0) { remove(tmp); return 0; }
+    return 1;
+}
+
+/* Escritura periodica (se llama cuando el menu esta ocioso) */
+static void metrics_periodic(void) {
+    if (metric_prom_path[0] == '\0' || metric_prom_interval <= 0) return;
+    long long now = now_ns();
+    if (now - metric_prom_last_ns < (long long)metric_prom_interval * 1000000000LL) return;
+    metric_prom_last_ns = now;
+    write_metrics_prometheus(metric_prom_path);
+}
 
+static void show_metrics(void) {
+    print_metrics(stdout);
     char buf[MAX_INPUT];
-    printf("Nombre (actual: %s) [ENTER para mantener]: ", med_name[idx]);
+    printf("Archivo Prometheus (actual: %s) ['-' desactiva, ENTER mantener]: ",
+           metric_prom_path[0] ? metric_prom_path : "ninguno");
     read_line(buf, sizeof(buf)); trim(buf);
-    if (buf[0] != '\0') { strncpy(med_name[idx], buf, MAX_NAME_LEN-1); med_name[idx][MAX_NAME_LEN-1] = '\0'; }
-
-    double price;
-    printf("Precio (actual: %.2f) [ENTER para mantener]: ", med_price[idx]);
-    if (prompt_double("", &price)) med_price[idx] = price;
-
-    int stock;
-    printf("Stock (actual: %d) [ENTER para mantener]: ", med_stock[idx]);
-    if (prompt_int("", &stock)) med_stock[idx] = stock;
+    if (strcmp(buf, "-") == 0) { metric_prom_path[0] = '\0'; printf("Exportacion Prometheus desactivada.\n"); return; }
+    if (buf[0] != '\0') { strncpy(metric_prom_path, buf, sizeof(metric_prom_path) - 1); metric_prom_path[sizeof(metric_prom_path) - 1] = '\0'; }
+    if (metric_prom_path[0] == '\0') return;
+    int secs;
+    printf("Intervalo en segundos (actual: %d, 0 = solo ahora) [ENTER mantener]: ", metric_prom_interval);
+    if (prompt_int("", &secs) && secs >= 0) metric_prom_interval = secs;
+    if (write_metrics_prometheus(metric_prom_path)) printf("Metricas escritas en %s.\n", metric_prom_path);
+    else printf("No se pudo escribir %s.\n", metric_prom_path);
+    metric_prom_last_ns = now_ns();
+}
 
-    printf("Venta libre? (actual: %s) s/n [ENTER para mantener]: ", med_is_otc[idx] ? "s" : "n");
-    read_line(buf, sizeof(buf)); trim(buf);
-    if (buf[0] == 's' || buf[0] == 'S') med_is_otc[idx] = 1;
-    else if (buf[0] == 'n' || buf[0] == 'N') med_is_otc[idx] = 0;
+/* ------------- TRAZAS (compilar con -DFARMACIA_TRACE) ------------- */
+/* Puntos de traza del camino de venta. Sin FARMACIA_TRACE las macros no
+   generan codigo. Compiladas pero desactivadas cuestan una lectura de
+   trace_enabled y un salto. Activadas, cada tramo guarda nombre, inicio y
+   duracion en un buffer circular propio de cada hilo (se pisan los mas
+   viejos) y se exportan a pedido en formato Chrome trace-event JSON
+   (abrir con chrome://tracing o ui.perfetto.dev). */
+#ifdef FARMACIA_TRACE
+#define TRACE_RING 8192
 
-    int crit;
-    printf("Stock critico (actual: %d) [ENTER para mantener]: ", med_critical[idx]);
-    if (prompt_int("", &crit)) med_critical[idx] = crit;
+static int trace_enabled = 0;
+static _Thread_local const char *trace_name[TRACE_RING];
+static _Thread_local long long trace_start_ns[TRACE_RING];
+static _Thread_local long long trace_dur_ns[TRACE_RING];
+static _Thread_local unsigned long long trace_total = 0;   /* tramos grabados (incluye pisados) */
 
-    printf("Medicamento actualizado.\n");
+static void trace_record(const char *name, long long start) {
+    if (start == 0) return;   /* se activo a mitad del tramo */
+    unsigned slot = (unsigned)(trace_total++ % TRACE_RING);
+    trace_name[slot] = name;
+    trace_start_ns[slot] = start;
+    trace_dur_ns[slot] = now_ns() - start;
 }
 
-static void delete_medicine(void) {
-    int code;
-    if (!prompt_int("Codigo a eliminar (vaciar cancelar): ", &code)) return;
-    int idx = find_med_index_by_code(code);
-    if (idx == -1) { printf("No encontrado.\n"); return; }
-
-    char confirm[MAX_INPUT];
-    printf("Confirma eliminacion de '%s' (s/n): ", med_name[idx]);
-    read_line(confirm, sizeof(confirm));
-    if (tolower((unsigned char)confirm[0]) != 's') { printf("Eliminacion cancelada.\n"); return; }
+#define TRACE_BEGIN(var) long long var = __builtin_expect(trace_enabled, 0) ? now_ns() : 0
+#define TRACE_END(var, name) do { if (__builtin_expect(trace_enabled, 0)) trace_record(name, var); } while (0)
 
-    for (int i = idx; i < med_count - 1; ++i) {
-        med_code[i] = med_code[i+1];
-        strncpy(med_name[i], med_name[i+1], MAX_NAME_LEN);
-        med_price[i] = med_price[i+1];
-        med_stock[i] = med_stock[i+1];
-        med_is_otc[i] = med_is_otc[i+1];
-        med_critical[i] = med_critical[i+1];
+/* Exporta los tramos del hilo actual, del mas viejo al mas nuevo */
+static int trace_export_json(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return 0;
+    unsigned long long n = trace_total < TRACE_RING ? trace_total : TRACE_RING;
+    unsigned long long first = trace_total - n;
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (unsigned long long k = 0; k < n; ++k) {
+        unsigned slot = (unsigned)((first + k) % TRACE_RING);
+        fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"venta\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}\n",
+                k ? "," : "", trace_name[slot], trace_start_ns[slot] / 1e3, trace_dur_ns[slot] / 1e3);
     }
-    med_count--;
-    printf("Medicamento eliminado.\n");
+    fprintf(fp, "],\"displayTimeUnit\":\"ns\"}\n");
+    return fclose(fp) == 0;
 }
+#else
+#define TRACE_BEGIN(var) do { } while (0)
+#define TRACE_END(var, name) do { } while (0)
+#endif
 
-/* Imprime CSV de medicamentos por pantalla (no escribe archivo) */
-static void print_medicines_csv(void) {
-    printf("Codigo,Nombre,Precio,Stock,StockCritico,VentaLibre\n");
-    for (int i = 0; i < med_count; ++i) {
-        /* Reemplazar comas en los nombres para no romper CSV básico */
-        char safe_name[MAX_NAME_LEN];
-        strncpy(safe_name, med_name[i], MAX_NAME_LEN-1); safe_name[MAX_NAME_LEN-1] = '\0';
-        for (char *p = safe_name; *p; ++p) if (*p == ',') *p = ' ';
-        printf("%d,%s,%.2f,%d,%d,%d\n",
-               med_code[i], safe_name, med_price[i], med_stock[i], med_critical[i], med_is_otc[i]);
-    }
+static void configure_trace(void) {
+#ifdef FARMACIA_TRACE
+    char buf[MAX_INPUT];
+    printf("Trazas %s, %llu tramos grabados (buffer de %d).\n",
+           trace_enabled ? "ACTIVADAS" : "desactivadas", trace_total, TRACE_RING);
+    printf("a = activar, d = desactivar, o ruta de JSON a exportar (vaciar cancelar): ");
+    read_line(buf, sizeof(buf)); trim(buf);
+    if (buf[0] == '\0') return;
+    if (strcmp(buf, "a") == 0) { trace_enabled = 1; printf("Trazas activadas.\n"); }
+    else if (strcmp(buf, "d") == 0) { trace_enabled = 0; printf("Trazas desactivadas.\n"); }
+    else if (trace_export_json(buf)) printf("Trazas exportadas a %s.\n", buf);
+    else printf("No se pudo escribir %s.\n", buf);
+#else
+    printf("Trazas no compiladas (recompilar con -DFARMACIA_TRACE).\n");
+#endif
 }
 
-/* ------------- FUNCIONES DE VENTAS E INFORMES ------------- */
-static void sell_medicine(void) {
-    if (sale_count >= MAX_SALES) { printf("Limite de ventas alcanzado este mes.\n"); return; }
-
-    int code;
-    if (!prompt_int("Codigo a vender (vaciar cancelar): ", &code)) return;
-    int idx = find_med_index_by_code(code);
-    if (idx == -1) { printf("Codigo no existe.\n"); return; }
+/* ------------- BÚSQUEDAS ------------- */
+static unsigned med_index_hash(int code) {
+    /* hash multiplicativo (Knuth) para repartir codigos consecutivos */
+    return ((unsigned)code * 2654435761u) % MED_INDEX_SIZE;
+}
 
-    int qty;
-    if (!prompt_int("Cantidad a vender: ", &qty)) return;
-    if (qty <= 0) { printf("Cantidad invalida.\n"); return; }
-    if (qty > med_stock[idx]) { printf("Stock insuficiente.\n"); return; }
+/* Catalogo congelado: hash perfecto minimo estilo CHD ("hash y desplazar").
+   Los n codigos se reparten con h1 en unas n/MPH_BUCKET_AVG cubetas; al
+   congelar se elige para cada cubeta (de la mas llena a la mas vacia) un
+   piloto tal que h2(codigo, piloto) cae en posiciones 0..n-1 libres y
+   distintas para todas sus claves. Buscar es una cubeta, un piloto y una
+   posicion, sin sondeo ni colisiones. Cada posicion guarda codigo e indice
+   juntos (mph_slot[2p], mph_slot[2p+1]), asi la verificacion no va al
+   catalogo; la tabla de pilotos es chica y suele estar en cache. Cualquier alta o baja pasa por
+   med_index_insert / med_index_rebuild y descongela (las ediciones no
+   cambian los codigos, asi que no). La tabla y el espacio para armarla
+   crecen con el catalogo congelado (al doble, ver mph_reserve). */
+#define MPH_BUCKET_AVG 4
+#define MPH_MAX_BUCKET_KEYS 64
+#define MPH_MAX_PILOT (1 << 24)
 
-    int day;
-    if (!prompt_int("Dia de la venta (1-31): ", &day)) return;
-    if (day < 1 || day > DAYS_IN_MONTH) { printf("Dia invalido.\n"); return; }
+static int med_frozen = 0;
+static int mph_n = 0;
+static int mph_buckets = 0;
+static int mph_cap = 0;          /* claves con lugar; cubetas: mph_cap / MPH_BUCKET_AVG + 1 */
+static unsigned *mph_pilot;
+static int *mph_slot;            /* posicion p -> codigo, indice */
+/* espacio de mph_build */
+static int *mph_first;           /* claves de la cubeta b: mph_member[mph_first[b]..mph_first[b+1]) */
+static int *mph_fill;
+static int *mph_member;
+static int *mph_order;
+static unsigned char *mph_taken;
 
-    double total = qty * med_price[idx];
+/* Lugar para congelar keys codigos. 0 si no hubo memoria. */
+static int mph_reserve(int keys) {
+    if (mph_cap > 0 && keys <= mph_cap) return 1;
+    int ncap = mph_cap ? mph_cap : 1024;
+    while (ncap < keys) ncap *= 2;
+    if (ncap > MAX_MEDICINES) ncap = MAX_MEDICINES;
+    size_t nb = (size_t)(ncap / MPH_BUCKET_AVG + 1);
+    unsigned *pilot = realloc(mph_pilot, sizeof(pilot[0]) * nb);
+    if (pilot) mph_pilot = pilot;
+    int *slot = realloc(mph_slot, sizeof(slot[0]) * 2 * (size_t)ncap);
+    if (slot) mph_slot = slot;
+    int *first = realloc(mph_first, sizeof(first[0]) * (nb + 1));
+    if (first) mph_first = first;
+    int *fill = realloc(mph_fill, sizeof(fill[0]) * nb);
+    if (fill) mph_fill = fill;
+    int *member = realloc(mph_member, sizeof(member[0]) * (size_t)ncap);
+    if (member) mph_member = member;
+    int *order = realloc(mph_order, sizeof(order[0]) * nb);
+    if (order) mph_order = order;
+    unsigned char *taken = realloc(mph_taken, (size_t)ncap);
+    if (taken) mph_taken = taken;
+    if (!pilot || !slot || !first || !fill || !member || !order || !taken) return 0;
+    mph_cap = ncap;
+    return 1;
+}
 
-    sale_day[sale_count] = day;
-    sale_med_code[sale_count] = med_code[idx];
-    sale_qty[sale_count] = qty;
-    sale_amount[sale_count] = total;
-    if (med_is_otc[idx]) {
-        strcpy(sale_dni[sale_count], "-");
-    } else {
-        char dnibuf[32];
-        printf("Ingrese DNI del comprador (vaciar = NO registrar - advertencia legal): ");
-        read_line(dnibuf, sizeof(dnibuf));
-        trim(dnibuf);
-        if (dnibuf[0] == '\0') {
-            /* registramos '-' pero avisamos */
-            strcpy(sale_dni[sale_count], "-");
-            printf("Advertencia: venta RX sin registro de DNI.\n");
-        } else {
-            strncpy(sale_dni[sale_count], dnibuf, sizeof(sale_dni[sale_count]) - 1);
-            sale_dni[sale_count][sizeof(sale_dni[sale_count]) - 1] = '\0';
-        }
-    }
+static unsigned long long mph_mix(unsigned long long x) {
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
 
-    sale_count++;
-    med_stock[idx] -= qty;
+/* 32 bits altos de h llevados a 0..n-1 sin division */
+static unsigned mph_reduce(unsigned long long h, unsigned n) {
+    return (unsigned)(((h >> 32) * (unsigned long long)n) >> 32);
+}
 
-    printf("Venta registrada: $%.2f | Dia %d | Quedan %d unidades.\n", total, day, med_stock[idx]);
+/* h = mph_mix(codigo): los bits altos eligen la cubeta y h combinado con
+   el piloto la posicion (una multiplicacion mas por busqueda) */
+static unsigned mph_bucket_of(unsigned long long h) {
+    return mph_reduce(h, (unsigned)mph_buckets);
 }
 
-/* Informe mensual: total en pesos y ventas por dia */
-static void report_monthly(void) {
-    if (sale_count == 0) { printf("No hay ventas registradas este mes.\n"); return; }
-    double total_month = 0.0;
-    int sales_per_day[DAYS_IN_MONTH + 1];
-    for (int i = 0; i <= DAYS_IN_MONTH; ++i) sales_per_day[i] = 0;
-    for (int i = 0; i < sale_count; ++i) {
-        int d = sale_day[i];
-        if (d >= 1 && d <= DAYS_IN_MONTH) sales_per_day[d] += 1;
-        total_month += sale_amount[i];
-    }
-    printf("===== Informe mensual =====\n");
-    printf("Total importe: $%.2f\n", total_month);
-    printf("Ventas por dia (dia: cantidad):\n");
-    for (int d = 1; d <= DAYS_IN_MONTH; ++d) if (sales_per_day[d] > 0) printf("Dia %2d: %d\n", d, sales_per_day[d]);
-    printf("Operaciones totales en el mes: %d\n", sale_count);
+static unsigned mph_pos_of(unsigned long long h, unsigned pilot) {
+    unsigned long long x = h ^ ((unsigned long long)(pilot + 1) * 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 31)) * 0xbf58476d1ce4e5b9ULL;
+    return mph_reduce(x, (unsigned)mph_n);
 }
 
-/* Informe de un dia especifico */
-static void report_day(void) {
-    int day;
-    if (!prompt_int("Ingrese dia a consultar (1-31): ", &day)) return;
-    if (day < 1 || day > DAYS_IN_MONTH) { printf("Dia invalido.\n"); return; }
-    double total_day = 0.0;
-    int count_day = 0;
-    for (int i = 0; i < sale_count; ++i) if (sale_day[i] == day) { total_day += sale_amount[i]; count_day++; }
-    printf("Informe dia %d: %d operaciones | Total importe: $%.2f\n", day, count_day, total_day);
+static int mph_find(int code) {
+    if (mph_n == 0) return -1;
+    unsigned long long h = mph_mix((unsigned)code);
+    unsigned p = mph_pos_of(h, mph_pilot[mph_bucket_of(h)]);
+    return mph_slot[2 * p] == code ? mph_slot[2 * p + 1] : -1;
 }
 
-/* Mostrar ventas (CSV) por pantalla (no archivo) */
-static void print_sales_csv(void) {
-    printf("Dia,CodigoMedicamento,Cantidad,Importe,DNI\n");
-    for (int i = 0; i < sale_count; ++i) {
-        printf("%d,%d,%d,%.2f,%s\n", sale_day[i], sale_med_code[i], sale_qty[i], sale_amount[i], sale_dni[i]);
+/* Construye el hash perfecto sobre el catalogo actual (el que llama ya
+   dio lugar con mph_reserve). 0 si no se pudo. */
+static int mph_build(void) {
+    int *first = mph_first, *member = mph_member, *order = mph_order;
+    unsigned char *taken = mph_taken;
+    int size_count[MPH_MAX_BUCKET_KEYS + 2];
+    unsigned pos[MPH_MAX_BUCKET_KEYS];
+    unsigned long long h[MPH_MAX_BUCKET_KEYS];
+
+    med_frozen = 0;
+    mph_n = med_count;
+    mph_buckets = med_count / MPH_BUCKET_AVG + 1;
+    memset(first, 0, sizeof(first[0]) * (size_t)(mph_buckets + 1));
+    for (int i = 0; i < mph_n; ++i) first[mph_bucket_of(mph_mix((unsigned)MED_CODE(i))) + 1]++;
+    for (int b = 0; b < mph_buckets; ++b) {
+        if (first[b + 1] > MPH_MAX_BUCKET_KEYS) return 0;
+        first[b + 1] += first[b];
     }
-}
+    memcpy(mph_fill, first, sizeof(first[0]) * (size_t)mph_buckets);
+    for (int i = 0; i < mph_n; ++i) member[mph_fill[mph_bucket_of(mph_mix((unsigned)MED_CODE(i)))]++] = i;
+    /* cubetas de mayor a menor tamano (orden por conteo) */
+    memset(size_count, 0, sizeof(size_count));
+    for (int b = 0; b < mph_buckets; ++b) size_count[MPH_MAX_BUCKET_KEYS - (first[b + 1] - first[b]) + 1]++;
+    for (int k = 1; k <= MPH_MAX_BUCKET_KEYS + 1; ++k) size_count[k] += size_count[k - 1];
+    for (int b = 0; b < mph_buckets; ++b) order[size_count[MPH_MAX_BUCKET_KEYS - (first[b + 1] - first[b])]++] = b;
 
-/* Mostrar registros RX (ventas con receta) */
-static void show_rx_records(void) {
-    int found = 0;
-    printf("DIA | Codigo | Cant | DNI\n");
-    printf("-------------------------\n");
-    for (int i = 0; i < sale_count; ++i) {
-        /* identificar si el medicamento era RX: buscar med index por codigo */
-        int medidx = find_med_index_by_code(sale_med_code[i]);
-        int is_rx = 1;
-        if (medidx != -1) is_rx = !med_is_otc[medidx];
-        if (is_rx) {
-            found = 1;
-            printf("%3d | %6d | %4d | %s\n", sale_day[i], sale_med_code[i], sale_qty[i], sale_dni[i]);
+    memset(taken, 0, (size_t)mph_n);
+    for (int o = 0; o < mph_buckets; ++o) {
+        int b = order[o], len = first[b + 1] - first[b];
+        mph_pilot[b] = 0;
+        if (len == 0) continue;
+        for (int k = 0; k < len; ++k) h[k] = mph_mix((unsigned)MED_CODE(member[first[b] + k]));
+        unsigned pilot;
+        for (pilot = 0; pilot < MPH_MAX_PILOT; ++pilot) {
+            int ok = 1;
+            for (int k = 0; ok && k < len; ++k) {
+                pos[k] = mph_pos_of(h[k], pilot);
+                if (taken[pos[k]]) ok = 0;
+                for (int j = 0; ok && j < k; ++j) if (pos[j] == pos[k]) ok = 0;
+            }
+            if (ok) break;
+        }
+        if (pilot == MPH_MAX_PILOT) return 0;
+        mph_pilot[b] = pilot;
+        for (int k = 0; k < len; ++k) {
+            taken[pos[k]] = 1;
+            mph_slot[2 * pos[k]] = MED_CODE(member[first[b] + k]);
+            mph_slot[2 * pos[k] + 1] = member[first[b] + k];
         }
     }
-    if (!found) printf("No hay registros RX.\n");
+    med_frozen = 1;
+    return 1;
 }
 
-/* Reporte de stock critico (solo dueno) */
-static void report_stock_critical(void) {
-    int found = 0;
-    printf("Medicamentos en o por debajo del stock critico:\n");
-    for (int i = 0; i < med_count; ++i) {
-        if (med_stock[i] <= med_critical[i]) {
-            found = 1;
-            printf("Codigo %d | %s | Stock: %d | Critico: %d\n",
-                   med_code[i], med_name[i], med_stock[i], med_critical[i]);
+/* Ordena n pares (clave, valor) por clave (con signo): radix sort LSD de
+   cuatro pasadas de 8 bits, estable, O(n). Devuelve 0 si no hubo memoria
+   para el espacio auxiliar. */
+static int code_radix_sort(int *key, int *val, int n) {
+    if (n < 2) return 1;
+    int *tmp = malloc(sizeof(int) * (size_t)n * 2);
+    if (!tmp) return 0;
+    int *src_k = key, *src_v = val, *dst_k = tmp, *dst_v = tmp + n;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int count[257] = { 0 };
+        for (int i = 0; i < n; ++i) count[((((unsigned)src_k[i] ^ 0x80000000u) >> shift) & 0xff) + 1]++;
+        for (int d = 0; d < 256; ++d) count[d + 1] += count[d];
+        for (int i = 0; i < n; ++i) {
+            int d = count[(((unsigned)src_k[i] ^ 0x80000000u) >> shift) & 0xff]++;
+            dst_k[d] = src_k[i];
+            dst_v[d] = src_v[i];
         }
+        int *t = src_k; src_k = dst_k; dst_k = t;
+        t = src_v; src_v = dst_v; dst_v = t;
     }
-    if (!found) printf("Ningun medicamento esta por debajo del stock critico.\n");
+    free(tmp);   /* cuatro pasadas: el resultado quedo en key/val */
+    return 1;
 }
 
-/* Reset mensual: borrar ventas */
-static void reset_month(void) {
-    sale_count = 0;
-    printf("Datos de ventas del mes borrados.\n");
+/* Catalogo en orden de codigo, para cruzar listas ya ordenadas por codigo
+   (ver RECEPCION DE MERCADERIA): med_by_code_key[k] es el k-esimo codigo y
+   med_by_code_idx[k] su fila. Se arma entero recien cuando hace falta
+   (med_by_code_build); despues cada alta y cada baja lo corrigen en su
+   lugar (med_by_code_add / med_by_code_remove), salvo las cargas masivas
+   (ord_defer) y los reemplazos del catalogo entero, que lo invalidan. Los
+   dos arrays son un solo bloque que crece al doble con el catalogo. */
+static int *med_by_code_key;
+static int *med_by_code_idx;       /* med_by_code_key + med_by_code_cap */
+static int med_by_code_cap = 0;
+static int med_by_code_ok = 0;
+
+/* Lugar para rows entradas, conservando las primeras keep. 0 si no hubo
+   memoria (y el bloque queda como estaba). */
+static int med_by_code_reserve(int rows, int keep) {
+    if (rows <= med_by_code_cap) return 1;
+    int ncap = med_by_code_cap ? med_by_code_cap : 1024;
+    while (ncap < rows) ncap *= 2;
+    if (ncap > MAX_MEDICINES) ncap = MAX_MEDICINES;
+    int *buf = malloc(sizeof(int) * (size_t)ncap * 2);
+    if (!buf) return 0;
+    if (keep > 0) {
+        memcpy(buf, med_by_code_key, sizeof(int) * (size_t)keep);
+        memcpy(buf + ncap, med_by_code_idx, sizeof(int) * (size_t)keep);
+    }
+    free(med_by_code_key);
+    med_by_code_key = buf;
+    med_by_code_idx = buf + ncap;
+    med_by_code_cap = ncap;
+    return 1;
 }
 
-/* Cambiar contrasena del dueño */
-static void change_owner_password(void) {
-    char current[64], newp[64], conf[64];
+static int med_by_code_build(void) {
+    if (med_by_code_ok) return 1;
+    if (!med_by_code_reserve(med_count, 0)) return 0;
+    for (int i = 0; i < med_count; ++i) { med_by_code_key[i] = MED_CODE(i); med_by_code_idx[i] = i; }
+    med_by_code_ok = code_radix_sort(med_by_code_key, med_by_code_idx, med_count);
+    return med_by_code_ok;
+}
+
+/* Primera posicion k >= from (de las n entradas) con med_by_code_key[k] >=
+   code. Galopa desde from (saltos de 1, 2, 4...) y termina con busqueda
+   binaria: O(log d) si el codigo esta a d posiciones, asi que recorrer en
+   orden una lista de codigos ordenada no camina el catalogo entero. */
+static int med_by_code_seek(int from, int n, int code) {
+    int lo = from, step = 1;
+    while (lo + step <= n && med_by_code_key[lo + step - 1] < code) { lo += step; step *= 2; }
+    int hi = lo + step - 1 < n ? lo + step - 1 : n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (med_by_code_key[mid] < code) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Alta de (code, idx) con las med_count - 1 filas anteriores ya en orden */
+static void med_by_code_add(int code, int idx) {
+    if (!med_by_code_ok) return;
+    int n = med_count - 1;
+    if (!med_by_code_reserve(n + 1, n)) { med_by_code_ok = 0; return; }
+    int k = med_by_code_seek(0, n, code);
+    memmove(med_by_code_key + k + 1, med_by_code_key + k, sizeof(int) * (size_t)(n - k));
+    memmove(med_by_code_idx + k + 1, med_by_code_idx + k, sizeof(int) * (size_t)(n - k));
+    med_by_code_key[k] = code;
+    med_by_code_idx[k] = idx;
+}
+
+/* Baja de la fila idx (codigo code): las filas siguientes corren una
+   posicion, como en el catalogo. med_count ya no la cuenta. */
+static void med_by_code_remove(int code, int idx) {
+    if (!med_by_code_ok) return;
+    int n = med_count;
+    int k = med_by_code_seek(0, n + 1, code);
+    memmove(med_by_code_key + k, med_by_code_key + k + 1, sizeof(int) * (size_t)(n - k));
+    memmove(med_by_code_idx + k, med_by_code_idx + k + 1, sizeof(int) * (size_t)(n - k));
+    for (int j = 0; j < n; ++j) if (med_by_code_idx[j] > idx) med_by_code_idx[j]--;
+}
+
+static void med_index_insert(int code, int idx) {
+    med_frozen = 0;
+    unsigned h = med_index_hash(code);
+    while (med_index_slot[h] != 0) h = (h + 1) % MED_INDEX_SIZE;
+    med_index_slot[h] = idx + 1;
+}
+
+/* Reconstruye el indice completo (despues de eliminar, que corre posiciones) */
+static void med_index_rebuild(void) {
+    med_frozen = 0;
+    memset(med_index_slot, 0, sizeof(med_index_slot));
+    for (int i = 0; i < med_count; ++i) med_index_insert(MED_CODE(i), i);
+}
+
+static int med_index_find(int code) {
+    unsigned h = med_index_hash(code);
+    while (med_index_slot[h] != 0) {
+        int idx = med_index_slot[h] - 1;
+        if (MED_CODE(idx) == code) return idx;
+        h = (h + 1) % MED_INDEX_SIZE;
+    }
+    return -1;
+}
+
+static int find_med_index_by_code(int code) {
+    return med_frozen ? mph_find(code) : med_index_find(code);
+}
+
+/* ------------- CUBO PRODUCTO x TIEMPO ------------- */
+/* Mes abierto: med_cube_* (producto x dia). Al reiniciar el mes se sella:
+   solo los productos con ventas se guardan en forma compacta, con 5
+   totales semanales (dias 1-7, 8-14, 15-21, 22-28, 29-31), ordenados por
+   codigo dentro de cada mes para buscarlos por busqueda binaria.
+   Semana, mes y anio se obtienen sumando esos casilleros. */
+#define CUBE_WEEKS 5
+#define MAX_SEALED_MONTHS 24
+#ifndef MAX_SEALED_ROWS
+#define MAX_SEALED_ROWS 65536
+#endif
+
+static int cube_year = 0, cube_month = 0;    /* mes abierto (0 = sin fijar) */
+
+static int sealed_month_count = 0;
+static int sealed_year[MAX_SEALED_MONTHS];
+static int sealed_month[MAX_SEALED_MONTHS];
+static int sealed_first[MAX_SEALED_MONTHS];  /* primera fila del mes */
+static int sealed_rows_in[MAX_SEALED_MONTHS];
+
+static int sealed_row_count = 0;
+static int sealed_code[MAX_SEALED_ROWS];
+static int sealed_units[MAX_SEALED_ROWS][CUBE_WEEKS];
+static double sealed_amount[MAX_SEALED_ROWS][CUBE_WEEKS];
+
+static int cube_week_of_day(int day) {
+    return (day - 1) / 7;
+}
+
+static void cube_fix_month(void) {
+    if (cube_month != 0) return;
+    time_t now = time(NULL);
+    struct tm tm = *localtime(&now);
+    cube_year = tm.tm_year + 1900;
+    cube_month = tm.tm_mon + 1;
+}
+
+/* Lugar en el cubo para rows productos. 0 si no hubo memoria. */
+static int cube_reserve(int rows) {
+    if (rows <= cube_cap) return 1;
+    int ncap = cube_cap ? cube_cap : 1024;
+    while (ncap < rows) ncap *= 2;
+    if (ncap > MAX_MEDICINES) ncap = MAX_MEDICINES;
+    int (*units)[DAYS_IN_MONTH + 1] = realloc(med_cube_units, sizeof(units[0]) * (size_t)ncap);
+    if (units) med_cube_units = units;
+    double (*amount)[DAYS_IN_MONTH + 1] = realloc(med_cube_amount, sizeof(amount[0]) * (size_t)ncap);
+    if (amount) med_cube_amount = amount;
+    if (!units || !amount) return 0;
+    cube_cap = ncap;
+    return 1;
+}
+
+static void cube_clear_row(int idx) {
+    memset(med_cube_units[idx], 0, sizeof(med_cube_units[idx]));
+    memset(med_cube_amount[idx], 0, sizeof(med_cube_amount[idx]));
+}
+
+static void cube_add(int idx, int day, int qty, double amount) {
+    med_cube_units[idx][day] += qty;
+    med_cube_amount[idx][day] += amount;
+}
+
+static int cube_cmp_by_code(const void *a, const void *b) {
+    int ca = MED_CODE(*(const int *)a), cb = MED_CODE(*(const int *)b);
+    return (ca > cb) - (ca < cb);
+}
+
+/* Sella el mes abierto y abre el siguiente. Devuelve 0 si no hay lugar
+   (o memoria para ordenar). */
+static int cube_seal_month(void) {
+    int *order = malloc(sizeof(int) * (size_t)(med_count > 0 ? med_count : 1));
+    if (!order) return 0;
+    cube_fix_month();
+    int n = 0;
+    for (int i = 0; i < med_count; ++i) {
+        int any = 0;
+        for (int d = 1; d <= DAYS_IN_MONTH && !any; ++d) any = med_cube_units[i][d] != 0;
+        if (any) order[n++] = i;
+    }
+    if (sealed_month_count >= MAX_SEALED_MONTHS || sealed_row_count + n > MAX_SEALED_ROWS) { free(order); return 0; }
+    qsort(order, (size_t)n, sizeof(order[0]), cube_cmp_by_code);
+
+    int m = sealed_month_count++;
+    sealed_year[m] = cube_year;
+    sealed_month[m] = cube_month;
+    sealed_first[m] = sealed_row_count;
+    sealed_rows_in[m] = n;
+    for (int k = 0; k < n; ++k) {
+        int i = order[k], r = sealed_row_count++;
+        sealed_code[r] = MED_CODE(i);
+        memset(sealed_units[r], 0, sizeof(sealed_units[r]));
+        memset(sealed_amount[r], 0, sizeof(sealed_amount[r]));
+        for (int d = 1; d <= DAYS_IN_MONTH; ++d) {
+            sealed_units[r][cube_week_of_day(d)] += med_cube_units[i][d];
+            sealed_amount[r][cube_week_of_day(d)] += med_cube_amount[i][d];
+        }
+    }
+    free(order);
+    for (int i = 0; i < med_count; ++i) cube_clear_row(i);
+
+    /* proximo mes: el del reloj, o el siguiente al sellado si el reloj no avanzo */
+    time_t now = time(NULL);
+    struct tm tm = *localtime(&now);
+    int y = tm.tm_year + 1900, mo = tm.tm_mon + 1;
+    if (y * 12 + mo <= cube_year * 12 + cube_month) {
+        mo = cube_month % 12 + 1;
+        y = cube_year + (cube_month == 12);
+    }
+    cube_year = y;
+    cube_month = mo;
+    return 1;
+}
+
+/* Fila sellada del codigo en el mes m, o -1 si no vendio ese mes */
+static int cube_sealed_find(int m, int code) {
+    int lo = sealed_first[m], hi = sealed_first[m] + sealed_rows_in[m];
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (sealed_code[mid] < code) lo = mid + 1; else hi = mid;
+    }
+    return (lo < sealed_first[m] + sealed_rows_in[m] && sealed_code[lo] == code) ? lo : -1;
+}
+
+static int cube_sealed_month_index(int year, int month) {
+    for (int m = sealed_month_count - 1; m >= 0; --m)
+        if (sealed_year[m] == year && sealed_month[m] == month) return m;
+    return -1;
+}
+
+/* Totales semanales de un producto en un mes (abierto o sellado) */
+static int cube_month_weeks(int code, int year, int month, int units[CUBE_WEEKS], double amount[CUBE_WEEKS]) {
+    for (int w = 0; w < CUBE_WEEKS; ++w) { units[w] = 0; amount[w] = 0.0; }
+    cube_fix_month();
+    if (year == cube_year && month == cube_month) {
+        int idx = find_med_index_by_code(code);
+        if (idx == -1) return 0;
+        for (int d = 1; d <= DAYS_IN_MONTH; ++d) {
+            units[cube_week_of_day(d)] += med_cube_units[idx][d];
+            amount[cube_week_of_day(d)] += med_cube_amount[idx][d];
+        }
+        return 1;
+    }
+    int m = cube_sealed_month_index(year, month);
+    if (m == -1) return 0;
+    int r = cube_sealed_find(m, code);
+    if (r == -1) return 1;
+    for (int w = 0; w < CUBE_WEEKS; ++w) { units[w] = sealed_units[r][w]; amount[w] = sealed_amount[r][w]; }
+    return 1;
+}
+
+/* Informe por producto sin recorrer ventas: d = dias del mes abierto,
+   s = semanas del trimestre, m = meses del anio, a = total del anio */
+static void report_product_rollup(int code, char level) {
+    cube_fix_month();
+    int units[CUBE_WEEKS];
+    double amount[CUBE_WEEKS];
+    if (level == 'd') {
+        int idx = find_med_index_by_code(code);
+        if (idx == -1) { printf("Codigo no existe.\n"); return; }
+        printf("Producto %d - %02d/%d por dia:\n", code, cube_month, cube_year);
+        for (int d = 1; d <= DAYS_IN_MONTH; ++d)
+            if (med_cube_units[idx][d] > 0)
+                printf("Dia %2d: %6d u | $%.2f\n", d, med_cube_units[idx][d], med_cube_amount[idx][d]);
+        return;
+    }
+    int first = (level == 's') ? ((cube_month - 1) / 3) * 3 + 1 : 1;
+    int last = (level == 's') ? first + 2 : 12;
+    long long year_units = 0;
+    double year_amount = 0.0;
+    if (level == 's') printf("Producto %d - trimestre %d/%d por semana:\n", code, (first - 1) / 3 + 1, cube_year);
+    else if (level == 'm') printf("Producto %d - %d por mes:\n", code, cube_year);
+    for (int mo = first; mo <= last; ++mo) {
+        if (!cube_month_weeks(code, cube_year, mo, units, amount)) continue;
+        long long mu = 0;
+        double ma = 0.0;
+        for (int w = 0; w < CUBE_WEEKS; ++w) {
+            if (level == 's' && units[w] > 0) printf("%02d/%d semana %d: %6d u | $%.2f\n", mo, cube_year, w + 1, units[w], amount[w]);
+            mu += units[w];
+            ma += amount[w];
+        }
+        if (level == 'm' && mu > 0) printf("%02d/%d: %8lld u | $%.2f\n", mo, cube_year, mu, ma);
+        year_units += mu;
+        year_amount += ma;
+    }
+    if (level == 'a' || level == 'm') printf("Total %d: %lld u | $%.2f\n", cube_year, year_units, year_amount);
+}
+
+static void report_product_rollup_prompt(void) {
+    int code;
+    if (!prompt_int("Codigo del producto (vaciar cancelar): ", &code)) return;
+    char buf[MAX_INPUT];
+    printf("Nivel: d = por dia, s = por semana del trimestre, m = por mes, a = anio: ");
+    read_line(buf, sizeof(buf)); trim(buf);
+    char level = (char)tolower((unsigned char)buf[0]);
+    if (level != 'd' && level != 's' && level != 'm' && level != 'a') { printf("Nivel invalido.\n"); return; }
+    report_product_rollup(code, level);
+}
+
+/* ------------- DEMANDA ESTIMADA (PROMEDIO MOVIL EXPONENCIAL) ------------- */
+/* Por producto (filas paralelas a med_*, como el cubo): unidades vendidas
+   por dia como promedio exponencial (EWMA, alfa = 2 / (DEMAND_SPAN_DAYS + 1))
+   y su varianza, sin guardar ventas. Cada venta cuesta O(1):
+   - mismo dia que la anterior: se suma a dem_pending
+   - dia nuevo: el dia pendiente entra al promedio con sus unidades y los k
+     dias sin ventas del medio de una vez, con la forma cerrada de k ceros
+     seguidos: q = (1 - alfa)^k, media' = q * media,
+     var' = q * (var + media^2 * (1 - q)).
+   Los dias son absolutos (dia del mes abierto del cubo), asi la estimacion
+   sigue de un mes al otro aunque se borren las ventas. Es la demanda de
+   este local (sucursal 0). */
+#ifndef DEMAND_SPAN_DAYS
+#define DEMAND_SPAN_DAYS 14
+#endif
+#ifndef DEMAND_LEAD_DAYS
+#define DEMAND_LEAD_DAYS 3       /* dias desde que se pide hasta que llega */
+#endif
+#ifndef DEMAND_REVIEW_DAYS
+#define DEMAND_REVIEW_DAYS 7     /* cada cuantos dias se hace el pedido */
+#endif
+#define DEMAND_Z 1.645           /* nivel de servicio del 95% (normal) */
+
+static double dem_rate[MAX_MEDICINES];      /* unidades por dia, hasta dem_last_day - 1 */
+static double dem_var[MAX_MEDICINES];
+static int dem_last_day[MAX_MEDICINES];     /* ultimo dia con ventas (0 = nunca vendio) */
+static int dem_pending[MAX_MEDICINES];      /* unidades de ese dia, aun sin promediar */
+static int dem_days[MAX_MEDICINES];         /* dias ya promediados */
+static int dem_clock = 0;                   /* ultimo dia con ventas de cualquier producto */
+
+/* Dias desde 1970-01-01 del dia day del mes abierto */
+static int demand_day_number(int day) {
+    cube_fix_month();
+    int y = cube_year - (cube_month <= 2), m = cube_month;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* pow y sqrt propias: el programa se compila sin -lm */
+static double demand_pow(double b, int k) {
+    double r = 1.0;
+    for (; k > 0; k >>= 1, b *= b) if (k & 1) r *= b;
+    return r;
+}
+
+static double demand_sqrt(double x) {
+    if (!(x > 0.0)) return 0.0;
+    double r = x > 1.0 ? x : 1.0, prev = 0.0;
+    for (int k = 0; k < 200 && r != prev; ++k) { prev = r; r = 0.5 * (r + x / r); }
+    return r;
+}
+
+/* Unidades enteras que cubren x (0 si x <= 0) */
+static int demand_units_up(double x) {
+    if (!(x > 0.0)) return 0;
+    int n = (int)x;
+    return n + (x > n);
+}
+
+static void demand_clear_row(int idx) {
+    dem_rate[idx] = dem_var[idx] = 0.0;
+    dem_last_day[idx] = dem_pending[idx] = dem_days[idx] = 0;
+}
+
+static void demand_copy_row(int dst, int src) {
+    dem_rate[dst] = dem_rate[src];
+    dem_var[dst] = dem_var[src];
+    dem_last_day[dst] = dem_last_day[src];
+    dem_pending[dst] = dem_pending[src];
+    dem_days[dst] = dem_days[src];
+}
+
+/* Estimacion de la fila idx con los dias hasta upto inclusive cerrados
+   (no modifica la fila) */
+static void demand_estimate(int idx, int upto, double *rate, double *var) {
+    double a = 2.0 / (DEMAND_SPAN_DAYS + 1), m = dem_rate[idx], v = dem_var[idx];
+    int last = dem_last_day[idx];
+    if (last == 0) { *rate = *var = 0.0; return; }
+    double x = dem_pending[idx];
+    if (dem_days[idx] == 0) { m = x; v = 0.0; }
+    else {
+        double diff = x - m, incr = a * diff;
+        m += incr;
+        v = (1.0 - a) * (v + diff * incr);
+    }
+    if (upto > last) {
+        double q = demand_pow(1.0 - a, upto - last);
+        v = q * (v + m * m * (1.0 - q));
+        m *= q;
+    }
+    *rate = m;
+    *var = v;
+}
+
+/* Venta de qty unidades de la fila idx el dia day del mes abierto */
+static void demand_add(int idx, int day, int qty) {
+    int d = demand_day_number(day);
+    if (d > dem_clock) dem_clock = d;
+    if (dem_last_day[idx] == 0) { dem_last_day[idx] = d; dem_pending[idx] = qty; return; }
+    if (d <= dem_last_day[idx]) { dem_pending[idx] += qty; return; }   /* mismo dia (o uno anterior cargado tarde) */
+    demand_estimate(idx, d - 1, &dem_rate[idx], &dem_var[idx]);
+    dem_days[idx] += d - dem_last_day[idx];
+    dem_last_day[idx] = d;
+    dem_pending[idx] = qty;
+}
+
+/* ------------- HISTORIAL DE PRECIOS ------------- */
+/* Cada producto (por codigo, aunque despues se elimine) tiene una lista de
+   precios que solo crece: (vigente desde ts, precio). Los productos van
+   en arrays paralelos en orden de llegada (ph_*[p]) y un hash codigo -> p
+   los encuentra (ph_slot guarda p+1, 0 = casilla vacia). La primera
+   version va en ph_first_* (sin malloc por producto, asi importar
+   catalogos grandes no reserva memoria por fila); los cambios siguientes
+   en un array dinamico. Los arrays y el hash crecen al doble con los
+   productos (price_hist_reserve), hasta MAX_PRICE_PRODUCTS.
+   Como la lista esta ordenada por ts, el precio vigente en un momento se
+   busca por busqueda binaria. */
+#ifndef MAX_PRICE_PRODUCTS
+#define MAX_PRICE_PRODUCTS (2 * MAX_MEDICINES + 1)
+#endif
+
+static int ph_count = 0;                /* productos con historial */
+static int ph_products_cap = 0;         /* lugar en ph_code..ph_more_price */
+static int ph_bits = 0;                 /* el hash tiene 1 << ph_bits casillas */
+static int *ph_slot;
+static int *ph_code;
+static int *ph_len;                     /* versiones totales */
+static int *ph_cap;                     /* capacidad de ph_more_* */
+static long long *ph_first_ts;
+static double *ph_first_price;
+static long long **ph_more_ts;          /* versiones 1..len-1 */
+static double **ph_more_price;
+
+/* Casilla del hash donde esta (o iria) code */
+static unsigned price_hist_probe(int code) {
+    unsigned mask = (1u << ph_bits) - 1;
+    unsigned h = ((unsigned)code * 2654435761u) >> (32 - ph_bits);
+    while (ph_slot[h] != 0 && ph_code[ph_slot[h] - 1] != code) h = (h + 1) & mask;
+    return h;
+}
+
+/* Lugar para rows productos, con el hash a lo sumo a la mitad. 0 si no
+   hubo memoria. */
+static int price_hist_reserve(int rows) {
+    if (rows > ph_products_cap) {
+        int ncap = ph_products_cap ? ph_products_cap : 1024;
+        while (ncap < rows) ncap *= 2;
+        if (ncap > MAX_PRICE_PRODUCTS) ncap = MAX_PRICE_PRODUCTS;
+        int *code = realloc(ph_code, sizeof(code[0]) * (size_t)ncap);
+        if (code) ph_code = code;
+        int *len = realloc(ph_len, sizeof(len[0]) * (size_t)ncap);
+        if (len) ph_len = len;
+        int *cap = realloc(ph_cap, sizeof(cap[0]) * (size_t)ncap);
+        if (cap) ph_cap = cap;
+        long long *first_ts = realloc(ph_first_ts, sizeof(first_ts[0]) * (size_t)ncap);
+        if (first_ts) ph_first_ts = first_ts;
+        double *first_price = realloc(ph_first_price, sizeof(first_price[0]) * (size_t)ncap);
+        if (first_price) ph_first_price = first_price;
+        long long **more_ts = realloc(ph_more_ts, sizeof(more_ts[0]) * (size_t)ncap);
+        if (more_ts) ph_more_ts = more_ts;
+        double **more_price = realloc(ph_more_price, sizeof(more_price[0]) * (size_t)ncap);
+        if (more_price) ph_more_price = more_price;
+        if (!code || !len || !cap || !first_ts || !first_price || !more_ts || !more_price) return 0;
+        ph_products_cap = ncap;
+    }
+    if (ph_bits > 0 && 2 * (long long)rows <= (1LL << ph_bits)) return 1;
+    int bits = ph_bits ? ph_bits : 11;
+    while ((1LL << bits) < 2 * (long long)rows) bits++;
+    int *slot = calloc((size_t)1 << bits, sizeof(int));
+    if (!slot) return 0;
+    free(ph_slot);
+    ph_slot = slot;
+    ph_bits = bits;
+    for (int p = 0; p < ph_count; ++p) ph_slot[price_hist_probe(ph_code[p])] = p + 1;
+    return 1;
+}
+
+/* Producto del codigo (lo agrega si create), -1 si no esta o no hay lugar */
+static int price_hist_slot(int code, int create) {
+    if (ph_bits > 0) {
+        unsigned h = price_hist_probe(code);
+        if (ph_slot[h] != 0) return ph_slot[h] - 1;
+    }
+    if (!create || ph_count >= MAX_PRICE_PRODUCTS || !price_hist_reserve(ph_count + 1)) return -1;
+    int p = ph_count++;
+    ph_code[p] = code;
+    ph_len[p] = ph_cap[p] = 0;
+    ph_more_ts[p] = NULL;
+    ph_more_price[p] = NULL;
+    ph_slot[price_hist_probe(code)] = p + 1;
+    return p;
+}
+
+static long long price_hist_ts(int slot, int k) {
+    return k == 0 ? ph_first_ts[slot] : ph_more_ts[slot][k - 1];
+}
+
+static double price_hist_price(int slot, int k) {
+    return k == 0 ? ph_first_price[slot] : ph_more_price[slot][k - 1];
+}
+
+/* Registra el precio vigente desde ts (si cambio). 0 si no hubo lugar. */
+static int price_hist_add(int code, long long ts, double price) {
+    int slot = price_hist_slot(code, 1);
+    if (slot < 0) return 0;
+    int n = ph_len[slot];
+    if (n == 0) { ph_first_ts[slot] = ts; ph_first_price[slot] = price; ph_len[slot] = 1; return 1; }
+    if (price_hist_price(slot, n - 1) == price) return 1;
+    long long last = price_hist_ts(slot, n - 1);
+    if (ts <= last) ts = last + 1;
+    if (n - 1 >= ph_cap[slot]) {
+        int ncap = ph_cap[slot] ? ph_cap[slot] * 2 : 4;
+        long long *nt = realloc(ph_more_ts[slot], sizeof(long long) * (size_t)ncap);
+        if (nt) ph_more_ts[slot] = nt;
+        double *np = realloc(ph_more_price[slot], sizeof(double) * (size_t)ncap);
+        if (np) ph_more_price[slot] = np;
+        if (!nt || !np) return 0;
+        ph_cap[slot] = ncap;
+    }
+    ph_more_ts[slot][n - 1] = ts;
+    ph_more_price[slot][n - 1] = price;
+    ph_len[slot] = n + 1;
+    return 1;
+}
+
+/* Version vigente en ts (la ultima con desde <= ts), -1 si no existia */
+static int price_hist_find(int slot, long long ts) {
+    int lo = 0, hi = ph_len[slot];
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (price_hist_ts(slot, mid) <= ts) lo = mid + 1; else hi = mid;
+    }
+    return lo - 1;
+}
+
+static void price_hist_clear(void) {
+    for (int p = 0; p < ph_count; ++p) {
+        free(ph_more_ts[p]);
+        free(ph_more_price[p]);
+    }
+    ph_count = 0;
+    if (ph_bits > 0) memset(ph_slot, 0, sizeof(ph_slot[0]) << ph_bits);
+}
+
+/* Precio del codigo vigente en ts; devuelve 0 si no hay historial */
+static int price_as_of(int code, long long ts, double *out) {
+    int slot = price_hist_slot(code, 0);
+    if (slot < 0) return 0;
+    int k = price_hist_find(slot, ts);
+    if (k < 0) return 0;
+    *out = price_hist_price(slot, k);
+    return 1;
+}
+
+/* ------------- INDICES ORDENADOS DEL CATALOGO ------------- */
+/* Orden por nombre, precio, stock y cobertura (stock / critico) sin
+   reordenar el catalogo en cada listado. Cada indice son tres tramos
+   ordenados de posiciones del catalogo, de mas viejo a mas nuevo: el
+   principal (todo el catalogo), uno intermedio de hasta ORD_MID_MAX y un
+   lote de cambios recientes de hasta ORD_DELTA_MAX (este se ordena recien
+   cuando alguien lo lee). Un alta o una edicion no mueven los tramos:
+   suben la version de la fila en ese indice y la agregan al lote;
+   la entrada vieja queda obsoleta (su version ya no coincide) y se saltea
+   al recorrer. Si la fila ya estaba en el lote se actualiza ahi mismo
+   (editar diez veces el mismo producto ocupa un lugar). Lote lleno: se
+   intercala con el intermedio; intermedio lleno: con el principal. Asi un
+   cambio cuesta O(1) amortizado mas O(n / ORD_MID_MAX), no O(n).
+   Las ventas y recepciones no tocan los indices: marcan la fila en
+   ord_dirty (un byte, una sola vez por fila) y el stock y la cobertura se
+   ponen al dia en la proxima lectura de esos dos indices (ord_ready).
+   Un indice marcado en ord_stale (despues de ord_rebuild, o con demasiadas
+   filas marcadas) se arma entero recien cuando alguien lo lee.
+   Un rango es una busqueda binaria por tramo e intercalar los tres:
+   O(log n + k), mas las obsoletas que caigan dentro del rango.
+   Las claves numericas se copian en ord_*_key (el orden no depende del
+   valor actual de la fila). El nombre no se copia: un cambio de nombre
+   saca la entrada de los tres tramos en el momento (las ediciones son
+   raras). Las cargas masivas (importar, recuperar la bitacora) van entre
+   ord_defer/ord_resume: las altas se ordenan juntas y se intercalan una
+   sola vez en nombre y precio; stock y cobertura quedan para la primera
+   lectura. Los arrays por fila crecen con el catalogo (ord_reserve, al
+   doble); no se reservan de entrada para MAX_MEDICINES filas. */
+#define ORD_CATALOG -1   /* sin indice: orden del catalogo (solo paginas) */
+#define ORD_NAME 0
+#define ORD_PRICE 1
+#define ORD_STOCK 2
+#define ORD_COVER 3      /* stock / critico (critico 0 cuenta como 1) */
+#define ORD_KEYS 4
+#ifndef ORD_DELTA_MAX
+#define ORD_DELTA_MAX 1024
+#endif
+#ifndef ORD_MID_MAX
+#define ORD_MID_MAX 32768
+#endif
+#define ORD_MID_CAP (ORD_MID_MAX + ORD_DELTA_MAX)
+#define ORD_RUNS 3       /* 0 = principal, 1 = intermedio, 2 = lote */
+
+static const char *ord_key_names[ORD_KEYS] = { "nombre", "precio", "stock", "cobertura" };
+
+static int ord_n[ORD_KEYS][ORD_RUNS];
+static int ord_cap = 0;                             /* filas con lugar en los arrays por fila */
+static int *ord_main_idx[ORD_KEYS];                 /* ord_cap + ORD_MID_CAP entradas */
+static double *ord_main_key[ORD_KEYS];
+static int *ord_main_ver[ORD_KEYS];                 /* version con la que entro */
+static int ord_mid_idx[ORD_KEYS][ORD_MID_CAP];
+static double ord_mid_key[ORD_KEYS][ORD_MID_CAP];
+static int ord_mid_ver[ORD_KEYS][ORD_MID_CAP];
+static int ord_delta_idx[ORD_KEYS][ORD_DELTA_MAX];
+static double ord_delta_key[ORD_KEYS][ORD_DELTA_MAX];
+static int ord_delta_ver[ORD_KEYS][ORD_DELTA_MAX];
+static int ord_delta_sorted[ORD_KEYS];
+static int *ord_delta_pos[ORD_KEYS];                /* lugar en el lote + 1 (0 = no esta) */
+static int *ord_row_ver[ORD_KEYS];                  /* version vigente de cada fila */
+static int ord_sort_k;                              /* indice que esta ordenando qsort */
+static int ord_deferred = 0;
+static int ord_defer_base = 0;                      /* med_count al empezar la carga */
+static int ord_defer_other = 0;                     /* hubo algo ademas de altas */
+static int ord_stale[ORD_KEYS];                     /* hay que armarlo entero antes de leerlo */
+static unsigned char *ord_dirty;                    /* stock cambiado, sin pasar a los indices */
+static int *ord_dirty_idx;                          /* las filas marcadas, en orden de marca */
+static int ord_dirty_n = 0;
+
+static int *ord_run_idx(int k, int r) { return r == 0 ? ord_main_idx[k] : r == 1 ? ord_mid_idx[k] : ord_delta_idx[k]; }
+static double *ord_run_key(int k, int r) { return r == 0 ? ord_main_key[k] : r == 1 ? ord_mid_key[k] : ord_delta_key[k]; }
+static int *ord_run_ver(int k, int r) { return r == 0 ? ord_main_ver[k] : r == 1 ? ord_mid_ver[k] : ord_delta_ver[k]; }
+
+static double ord_value(int k, int idx) {
+    switch (k) {
+        case ORD_PRICE: return MED_PRICE(idx);
+        case ORD_STOCK: return MED_STOCK(idx);
+        case ORD_COVER: return (double)MED_STOCK(idx) / (MED_CRIT(idx) > 0 ? MED_CRIT(idx) : 1);
+        default: return 0.0;
+    }
+}
+
+/* Orden de (clave, fila); el desempate por fila hace unica cada entrada */
+static int ord_cmp(int k, int ia, double ka, int ib, double kb) {
+    if (k == ORD_NAME) {
+        int c = strcmp(MED_NAME(ia), MED_NAME(ib));
+        if (c) return c;
+    } else if (ka != kb) return ka < kb ? -1 : 1;
+    return (ia > ib) - (ia < ib);
+}
+
+static int ord_cmp_rows(const void *a, const void *b) {
+    int ia = *(const int *)a, ib = *(const int *)b;
+    return ord_cmp(ord_sort_k, ia, ord_value(ord_sort_k, ia), ib, ord_value(ord_sort_k, ib));
+}
+
+/* Mergesort de abajo hacia arriba sobre los tres arrays del lote (sin
+   qsort: la comparacion de claves numericas queda en linea) */
+static void ord_sort_delta(int k) {
+    if (ord_delta_sorted[k]) return;
+    int d = ord_n[k][2], tmp_idx[ORD_DELTA_MAX], tmp_ver[ORD_DELTA_MAX];
+    double tmp_key[ORD_DELTA_MAX];
+    int *si = ord_delta_idx[k], *sv = ord_delta_ver[k], *ti = tmp_idx, *tv = tmp_ver;
+    double *sk = ord_delta_key[k], *tk = tmp_key;
+    for (int width = 1; width < d; width *= 2) {
+        for (int lo = 0; lo < d; lo += 2 * width) {
+            int mid = lo + width < d ? lo + width : d, hi = lo + 2 * width < d ? lo + 2 * width : d;
+            int a = lo, b = mid, w = lo;
+            while (a < mid && b < hi) {
+                /* sin saltos en la comparacion: con claves al azar el
+                   predictor falla la mitad de las veces */
+                int from_b = k == ORD_NAME ? ord_cmp(k, si[b], sk[b], si[a], sk[a]) < 0
+                                           : (sk[b] < sk[a]) | ((sk[b] == sk[a]) & (si[b] < si[a]));
+                int j = from_b ? b : a;
+                ti[w] = si[j]; tk[w] = sk[j]; tv[w] = sv[j];
+                w++; b += from_b; a += !from_b;
+            }
+            for (; a < mid; ++a, ++w) { ti[w] = si[a]; tk[w] = sk[a]; tv[w] = sv[a]; }
+            for (; b < hi; ++b, ++w) { ti[w] = si[b]; tk[w] = sk[b]; tv[w] = sv[b]; }
+        }
+        int *xi = si; si = ti; ti = xi;
+        int *xv = sv; sv = tv; tv = xv;
+        double *xk = sk; sk = tk; tk = xk;
+    }
+    if (si != ord_delta_idx[k]) {
+        memcpy(ord_delta_idx[k], si, sizeof(si[0]) * (size_t)d);
+        memcpy(ord_delta_key[k], sk, sizeof(sk[0]) * (size_t)d);
+        memcpy(ord_delta_ver[k], sv, sizeof(sv[0]) * (size_t)d);
+    }
+    for (int j = 0; j < d; ++j) ord_delta_pos[k][ord_delta_idx[k][j]] = j + 1;
+    ord_delta_sorted[k] = 1;
+}
+
+/* Intercala m entradas ordenadas con el tramo r desde el final (en el
+   mismo lugar: cada tramo tiene lugar para el siguiente entero) y tira las
+   obsoletas. Para no leer ord_row_ver al azar por cada entrada del tramo
+   (el principal es todo el catalogo), ahi se tiran las filas que traen
+   version nueva (marcadas en ord_merge_mark, que entra en cache); alguna
+   obsoleta por un cambio posterior puede quedar y se saltea al leer. */
+static unsigned char *ord_merge_mark;              /* ord_cap / 8 + 1 bytes */
+
+/* Lugar para rows filas en los arrays por fila. 0 si no hubo memoria (lo
+   que ya estaba queda igual). */
+static int ord_reserve(int rows) {
+    if (rows <= ord_cap) return 1;
+    int ncap = ord_cap ? ord_cap : 1024;
+    while (ncap < rows) ncap *= 2;
+    if (ncap > MAX_MEDICINES) ncap = MAX_MEDICINES;
+    size_t mcap = (size_t)ncap + ORD_MID_CAP, old_mark = ord_cap ? (size_t)ord_cap / 8 + 1 : 0;
+    for (int k = 0; k < ORD_KEYS; ++k) {
+        int *mi = realloc(ord_main_idx[k], sizeof(int) * mcap);
+        if (mi) ord_main_idx[k] = mi;
+        double *mk = realloc(ord_main_key[k], sizeof(double) * mcap);
+        if (mk) ord_main_key[k] = mk;
+        int *mv = realloc(ord_main_ver[k], sizeof(int) * mcap);
+        if (mv) ord_main_ver[k] = mv;
+        int *dp = realloc(ord_delta_pos[k], sizeof(int) * (size_t)ncap);
+        if (dp) ord_delta_pos[k] = dp;
+        int *rv = realloc(ord_row_ver[k], sizeof(int) * (size_t)ncap);
+        if (rv) ord_row_ver[k] = rv;
+        if (!mi || !mk || !mv || !dp || !rv) return 0;
+        memset(dp + ord_cap, 0, sizeof(int) * (size_t)(ncap - ord_cap));
+        memset(rv + ord_cap, 0, sizeof(int) * (size_t)(ncap - ord_cap));
+    }
+    unsigned char *dirty = realloc(ord_dirty, (size_t)ncap);
+    if (dirty) ord_dirty = dirty;
+    int *dirty_idx = realloc(ord_dirty_idx, sizeof(int) * (size_t)ncap);
+    if (dirty_idx) ord_dirty_idx = dirty_idx;
+    if (!dirty || !dirty_idx) return 0;
+    memset(dirty + ord_cap, 0, (size_t)(ncap - ord_cap));
+    unsigned char *mark = realloc(ord_merge_mark, (size_t)ncap / 8 + 1);
+    if (!mark) return 0;
+    memset(mark + old_mark, 0, (size_t)ncap / 8 + 1 - old_mark);
+    ord_merge_mark = mark;
+    ord_cap = ncap;
+    return 1;
+}
+
+static void ord_merge(int k, int r, const int *midx, const double *mkey, const int *mver, int m) {
+    int *ridx = ord_run_idx(k, r), *rver = ord_run_ver(k, r);
+    double *rkey = ord_run_key(k, r);
+    int i = ord_n[k][r] - 1, j = m - 1, w = ord_n[k][r] + m;
+    for (int t = 0; t < m; ++t) ord_merge_mark[midx[t] >> 3] |= (unsigned char)(1u << (midx[t] & 7));
+    while (i >= 0 || j >= 0) {
+        int from_new = i < 0 || (j >= 0 && ord_cmp(k, midx[j], mkey[j], ridx[i], rkey[i]) > 0);
+        int idx = from_new ? midx[j] : ridx[i];
+        double key = from_new ? mkey[j] : rkey[i];
+        int ver = from_new ? mver[j--] : rver[i--];
+        if (from_new ? ver != ord_row_ver[k][idx] : (ord_merge_mark[idx >> 3] >> (idx & 7)) & 1) continue;
+        --w;
+        ridx[w] = idx; rkey[w] = key; rver[w] = ver;
+    }
+    for (int t = 0; t < m; ++t) ord_merge_mark[midx[t] >> 3] = 0;
+    int n = ord_n[k][r] + m - w;
+    memmove(ridx, ridx + w, sizeof(ridx[0]) * (size_t)n);
+    memmove(rkey, rkey + w, sizeof(rkey[0]) * (size_t)n);
+    memmove(rver, rver + w, sizeof(rver[0]) * (size_t)n);
+    ord_n[k][r] = n;
+}
+
+/* Baja el lote al intermedio y, si se lleno (o all), el intermedio al
+   principal */
+static void ord_flush(int k, int all) {
+    ord_sort_delta(k);
+    ord_merge(k, 1, ord_delta_idx[k], ord_delta_key[k], ord_delta_ver[k], ord_n[k][2]);
+    for (int j = 0; j < ord_n[k][2]; ++j) ord_delta_pos[k][ord_delta_idx[k][j]] = 0;
+    ord_n[k][2] = 0;
+    if (all || ord_n[k][1] >= ORD_MID_MAX) {
+        ord_merge(k, 0, ord_mid_idx[k], ord_mid_key[k], ord_mid_ver[k], ord_n[k][1]);
+        ord_n[k][1] = 0;
+    }
+}
+
+/* La fila idx cambio de clave (o es nueva) en el indice k */
+static void ord_touch(int k, int idx) {
+    if (ord_deferred) { if (idx < ord_defer_base) ord_defer_other = 1; return; }
+    if (ord_stale[k]) return;
+    int d = ord_delta_pos[k][idx] - 1;
+    if (d >= 0) {
+        ord_delta_key[k][d] = ord_value(k, idx);
+        ord_delta_sorted[k] = ord_n[k][2] == 1;
+        return;
+    }
+    if (ord_n[k][2] == ORD_DELTA_MAX) ord_flush(k, 0);
+    d = ord_n[k][2]++;
+    ord_delta_idx[k][d] = idx;
+    ord_delta_key[k][d] = ord_value(k, idx);
+    ord_delta_ver[k][d] = ++ord_row_ver[k][idx];
+    ord_delta_pos[k][idx] = d + 1;
+    ord_delta_sorted[k] = d == 0;
+}
+
+/* Antes de cambiarle el nombre a idx: sacarla del indice por nombre. Cada
+   tramo esta ordenado por el nombre actual; una entrada con el nombre
+   viejo quedaria fuera de lugar. */
+static void ord_name_remove(int idx) {
+    if (ord_deferred) { ord_defer_other = 1; return; }
+    if (ord_stale[ORD_NAME]) return;
+    int k = ORD_NAME;
+    for (int r = 0; r < ORD_RUNS; ++r) {
+        int *ridx = ord_run_idx(k, r), *rver = ord_run_ver(k, r), n = ord_n[k][r], w = 0;
+        double *rkey = ord_run_key(k, r);
+        for (int i = 0; i < n; ++i) {
+            if (ridx[i] == idx) continue;
+            if (w != i) { ridx[w] = ridx[i]; rkey[w] = rkey[i]; rver[w] = rver[i]; }
+            w++;
+        }
+        ord_n[k][r] = w;
+    }
+    ord_delta_pos[k][idx] = 0;
+    for (int j = 0; j < ord_n[k][2]; ++j) ord_delta_pos[k][ord_delta_idx[k][j]] = j + 1;
+}
+
+/* El stock de idx cambio (venta, recepcion, alta): stock y cobertura lo
+   ven en su proxima lectura */
+static void ord_stock_changed(int idx) {
+    if (ord_dirty[idx]) return;
+    ord_dirty[idx] = 1;
+    ord_dirty_idx[ord_dirty_n++] = idx;
+}
+
+static void ord_insert(int idx) {
+    for (int k = 0; k < ORD_KEYS; ++k) { ord_row_ver[k][idx] = 0; ord_delta_pos[k][idx] = 0; }
+    ord_touch(ORD_NAME, idx);
+    ord_touch(ORD_PRICE, idx);
+    ord_stock_changed(idx);
+}
+
+/* Se borro la fila idx y las siguientes bajaron un lugar (med_count ya
+   descontado). Bajar una fila no cambia el orden relativo. */
+static void ord_delete_shift(int idx) {
+    if (ord_deferred) { ord_defer_other = 1; return; }
+    int w = 0;
+    for (int j = 0; j < ord_dirty_n; ++j) {
+        int row = ord_dirty_idx[j];
+        if (row != idx) ord_dirty_idx[w++] = row > idx ? row - 1 : row;
+    }
+    ord_dirty_n = w;
+    memmove(ord_dirty + idx, ord_dirty + idx + 1, (size_t)(med_count - idx));
+    ord_dirty[med_count] = 0;
+    for (int k = 0; k < ORD_KEYS; ++k) {
+        if (ord_stale[k]) continue;
+        for (int r = 0; r < ORD_RUNS; ++r) {
+            int *ridx = ord_run_idx(k, r), *rver = ord_run_ver(k, r), n = ord_n[k][r], w = 0;
+            double *rkey = ord_run_key(k, r);
+            for (int i = 0; i < n; ++i) {
+                int row = ridx[i];
+                if (row == idx) continue;
+                ridx[w] = row > idx ? row - 1 : row; rkey[w] = rkey[i]; rver[w] = rver[i];
+                w++;
+            }
+            ord_n[k][r] = w;
+        }
+        memmove(ord_row_ver[k] + idx, ord_row_ver[k] + idx + 1, sizeof(ord_row_ver[k][0]) * (size_t)(med_count - idx));
+        memset(ord_delta_pos[k] + idx, 0, sizeof(ord_delta_pos[k][0]) * (size_t)(med_count + 1 - idx));
+        for (int j = 0; j < ord_n[k][2]; ++j) ord_delta_pos[k][ord_delta_idx[k][j]] = j + 1;
+    }
+}
+
+/* Arma el indice k desde cero con todo el catalogo */
+static void ord_build(int k) {
+    for (int i = 0; i < med_count; ++i) ord_main_idx[k][i] = i;
+    ord_sort_k = k;
+    if (med_count > 0) qsort(ord_main_idx[k], (size_t)med_count, sizeof(ord_main_idx[k][0]), ord_cmp_rows);
+    for (int i = 0; i < med_count; ++i) {
+        ord_main_key[k][i] = ord_value(k, ord_main_idx[k][i]);
+        ord_main_ver[k][i] = 0;
+        ord_row_ver[k][i] = 0;
+        ord_delta_pos[k][i] = 0;
+    }
+    ord_n[k][0] = med_count;
+    ord_n[k][1] = ord_n[k][2] = 0;
+    ord_delta_sorted[k] = 1;
+    ord_stale[k] = 0;
+}
+
+/* Desde cero (tras cargar una imagen o vaciar el catalogo; ord_reserve ya
+   dio lugar para med_count filas). Cada indice se arma en su primera
+   lectura. */
+static void ord_rebuild(void) {
+    for (int k = 0; k < ORD_KEYS; ++k) {
+        ord_n[k][0] = ord_n[k][1] = ord_n[k][2] = 0;
+        ord_stale[k] = 1;
+    }
+    for (int j = 0; j < ord_dirty_n; ++j) ord_dirty[ord_dirty_idx[j]] = 0;
+    ord_dirty_n = 0;
+}
+
+/* Antes de leer el indice k: lo arma si hace falta y, para stock y
+   cobertura, le pasa las filas marcadas por ord_stock_changed. Con mas de
+   un octavo del catalogo marcado sale mas barato armarlos de nuevo. */
+static void ord_ready(int k) {
+    if ((k == ORD_STOCK || k == ORD_COVER) && ord_dirty_n > 0) {
+        int rebuild = ord_dirty_n > med_count / 8;
+        for (int j = 0; j < ord_dirty_n; ++j) {
+            int idx = ord_dirty_idx[j];
+            ord_dirty[idx] = 0;
+            if (!rebuild) { ord_touch(ORD_STOCK, idx); ord_touch(ORD_COVER, idx); }
+        }
+        ord_dirty_n = 0;
+        if (rebuild) ord_stale[ORD_STOCK] = ord_stale[ORD_COVER] = 1;
+    }
+    if (ord_stale[k]) ord_build(k);
+}
+
+static void ord_defer(void) {
+    ord_deferred = 1;
+    ord_defer_base = med_count;
+    ord_defer_other = 0;
+}
+
+/* Fin de la carga: si solo hubo altas, se ordenan las filas nuevas y se
+   intercalan con el principal (O(m log m + n)) por nombre y por precio;
+   en stock y cobertura ya estan marcadas (ord_insert) y entran en la
+   proxima lectura. Si hubo algo mas, se rehace todo. */
+static void ord_resume(void) {
+    ord_deferred = 0;
+    int m = med_count - ord_defer_base;
+    if (m <= 0 && !ord_defer_other) return;
+    int *idx = ord_defer_other ? NULL : malloc(sizeof(int) * (size_t)m * 2);
+    double *key = idx ? malloc(sizeof(double) * (size_t)m) : NULL;
+    if (!key) { free(idx); ord_rebuild(); return; }
+    int *ver = idx + m;
+    for (int k = 0; k < ORD_KEYS; ++k) {
+        if (k == ORD_STOCK || k == ORD_COVER || ord_stale[k]) continue;   /* ver ord_ready */
+        ord_flush(k, 1);
+        for (int j = 0; j < m; ++j) {
+            idx[j] = ord_defer_base + j;
+            ord_row_ver[k][idx[j]] = ord_delta_pos[k][idx[j]] = ver[j] = 0;
+        }
+        ord_sort_k = k;
+        qsort(idx, (size_t)m, sizeof(idx[0]), ord_cmp_rows);
+        for (int j = 0; j < m; ++j) key[j] = ord_value(k, idx[j]);
+        ord_merge(k, 0, idx, key, ver, m);
+    }
+    free(idx);
+    free(key);
+}
+
+/* Recorrido en orden (un solo recorrido activo a la vez, como el resto
+   del estado de este archivo). lo/hi acotan la clave numerica, inclusive. */
+static int ord_it_k, ord_it_desc, ord_it_pos[ORD_RUNS];
+static double ord_it_lo, ord_it_hi;
+static double ord_it_last_key;     /* clave de la ultima fila devuelta */
+
+/* Signo de (entrada pos del tramo r) - (pivote); para nombre el pivote es
+   pname (NULL = antes de todo) */
+static int ord_cmp_pivot(int k, int r, int pos, double pkey, const char *pname, int pidx) {
+    int idx = ord_run_idx(k, r)[pos];
+    if (k == ORD_NAME) {
+        int c = pname ? strcmp(MED_NAME(idx), pname) : 1;
+        if (c) return c;
+    } else {
+        double key = ord_run_key(k, r)[pos];
+        if (key != pkey) return key < pkey ? -1 : 1;
+    }
+    return (idx > pidx) - (idx < pidx);
+}
+
+/* Cuantas entradas del tramo r son menores que el pivote (o <= si le) */
+static int ord_rank(int k, int r, double pkey, const char *pname, int pidx, int le) {
+    int lo = 0, hi = ord_n[k][r];
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = ord_cmp_pivot(k, r, mid, pkey, pname, pidx);
+        if (c < 0 || (le && c == 0)) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Recorrido que sigue despues de la fila (after_key | after_name,
+   after_idx) en el sentido pedido; resume = 0 empieza desde el borde */
+static void ord_scan_from(int k, int desc, double lo, double hi, int resume,
+                          double after_key, const char *after_name, int after_idx) {
+    ord_ready(k);
+    ord_sort_delta(k);
+    ord_it_k = k; ord_it_desc = desc; ord_it_lo = lo; ord_it_hi = hi;
+    for (int r = 0; r < ORD_RUNS; ++r) {
+        int n = ord_n[k][r];
+        if (resume) ord_it_pos[r] = desc ? ord_rank(k, r, after_key, after_name, after_idx, 0) - 1
+                                         : ord_rank(k, r, after_key, after_name, after_idx, 1);
+        else if (k == ORD_NAME) ord_it_pos[r] = desc ? n - 1 : 0;
+        else if (!desc) ord_it_pos[r] = ord_rank(k, r, lo, NULL, -1, 1);
+        else ord_it_pos[r] = ord_rank(k, r, hi, NULL, MAX_MEDICINES, 0) - 1;
+    }
+}
+
+static void ord_scan_begin(int k, int desc, double lo, double hi) {
+    ord_scan_from(k, desc, lo, hi, 0, 0.0, NULL, 0);
+}
+
+/* Proxima fila del recorrido, -1 al terminar */
+static int ord_scan_next(void) {
+    int k = ord_it_k, step = ord_it_desc ? -1 : 1;
+    for (;;) {
+        int best = -1;
+        for (int r = 0; r < ORD_RUNS; ++r) {
+            int p = ord_it_pos[r];
+            if (p < 0 || p >= ord_n[k][r]) continue;
+            if (best >= 0) {
+                int q = ord_it_pos[best];
+                int c = ord_cmp(k, ord_run_idx(k, r)[p], ord_run_key(k, r)[p], ord_run_idx(k, best)[q], ord_run_key(k, best)[q]);
+                if (ord_it_desc ? c <= 0 : c >= 0) continue;
+            }
+            best = r;
+        }
+        if (best < 0) return -1;
+        int p = ord_it_pos[best];
+        int idx = ord_run_idx(k, best)[p], ver = ord_run_ver(k, best)[p];
+        double key = ord_run_key(k, best)[p];
+        ord_it_pos[best] += step;
+        if (k != ORD_NAME && (ord_it_desc ? key < ord_it_lo : key > ord_it_hi)) return -1;
+        if (ver == ord_row_ver[k][idx]) { ord_it_last_key = key; return idx; }
+    }
+}
+
+/* ------------- INSTANTANEAS DE LOS CURSORES (EPOCAS + COPIA AL ESCRIBIR) ------------- */
+/* Un cursor de paginacion fija una instantanea al crearse: todas sus
+   paginas ven el catalogo como estaba en ese momento, aunque entre una y
+   otra se venda, se edite o se borre. Las ventas no esperan.
+   - Cada fila lleva la epoca de su ultima escritura (med_row_epoch) y un
+     numero de alta que no cambia (med_row_seq). El alta es el orden del
+     catalogo y el desempate de los demas ordenes.
+   - Antes de pisar o borrar una fila, snap_row_cow() guarda el contenido
+     actual en la lista de versiones (ver_*) si alguna instantanea fijada
+     todavia lo ve. Sin instantaneas fijadas no guarda ni marca nada.
+   - Una pagina intercala las filas que no cambiaron desde la instantanea
+     (recorridas por posicion o con ord_scan_*) con las versiones guardadas
+     que esa instantanea ve (snap_walk_*).
+   Una instantanea se suelta en la ultima pagina, con farm_cursor_close o,
+   si hacen falta mas de MAX_SNAPSHOTS, la usada hace mas tiempo. Ahi se
+   liberan las versiones que ya no ve nadie. Si la lista de versiones se
+   llena, la escritura tampoco espera: se sueltan las instantaneas que
+   necesitarian la copia y sus cursores devuelven FARM_ERR_SNAPSHOT. */
+#define MAX_SNAPSHOTS 8
+#ifndef SNAP_MAX_VERSIONS
+#define SNAP_MAX_VERSIONS 65536
+#endif
+
+static long long snap_epoch_now = 1;
+static int snap_rows_cap = 0;                 /* filas con lugar en med_row_* */
+static long long *med_row_epoch;              /* epoca de la ultima escritura */
+static long long *med_row_seq;                /* numero de alta */
+static int *med_row_ver;                      /* version guardada mas nueva + 1 (0 = ninguna) */
+static long long snap_next_seq = 1;
+
+static long long snap_epoch[MAX_SNAPSHOTS];   /* 0 = libre */
+static long long snap_used[MAX_SNAPSHOTS];    /* ultimo uso (para soltar la mas vieja) */
+static long long snap_clock = 0;
+static int snap_pins = 0;
+static long long snap_newest = 0;             /* epoca de la instantanea fijada mas nueva */
+
+static int ver_count = 0, ver_cap = 0;
+static int *ver_code, *ver_stock, *ver_otc, *ver_crit;
+static int *ver_prev;                         /* version anterior de la misma fila + 1 (siempre menor) */
+static double *ver_price;
+static char (*ver_name)[MAX_NAME_LEN];
+static long long *ver_seq;
+static long long *ver_written, *ver_gone;     /* la ven las epocas e con written < e <= gone */
+
+/* Lugar para rows filas en med_row_*. 0 si no hubo memoria. */
+static int snap_reserve(int rows) {
+    if (rows <= snap_rows_cap) return 1;
+    int ncap = snap_rows_cap ? snap_rows_cap : 1024;
+    while (ncap < rows) ncap *= 2;
+    if (ncap > MAX_MEDICINES) ncap = MAX_MEDICINES;
+    long long *ep = realloc(med_row_epoch, sizeof(ep[0]) * (size_t)ncap);
+    if (ep) med_row_epoch = ep;
+    long long *sq = realloc(med_row_seq, sizeof(sq[0]) * (size_t)ncap);
+    if (sq) med_row_seq = sq;
+    int *rv = realloc(med_row_ver, sizeof(rv[0]) * (size_t)ncap);
+    if (rv) med_row_ver = rv;
+    if (!ep || !sq || !rv) return 0;
+    snap_rows_cap = ncap;
+    return 1;
+}
+
+/* Lugar para una version mas (al doble, hasta SNAP_MAX_VERSIONS). 0 si no hay. */
+static int snap_ver_reserve(void) {
+    if (ver_count < ver_cap) return 1;
+    if (ver_cap >= SNAP_MAX_VERSIONS) return 0;
+    int ncap = ver_cap ? 2 * ver_cap : 256;
+    if (ncap > SNAP_MAX_VERSIONS) ncap = SNAP_MAX_VERSIONS;
+#define SNAP_GROW(col) do { void *p = realloc(col, sizeof(col[0]) * (size_t)ncap); if (!p) return 0; col = p; } while (0)
+    SNAP_GROW(ver_code); SNAP_GROW(ver_stock); SNAP_GROW(ver_otc); SNAP_GROW(ver_crit); SNAP_GROW(ver_prev);
+    SNAP_GROW(ver_price); SNAP_GROW(ver_name); SNAP_GROW(ver_seq); SNAP_GROW(ver_written); SNAP_GROW(ver_gone);
+#undef SNAP_GROW
+    ver_cap = ncap;
+    return 1;
+}
+
+static int snap_sees(int v, long long e) {
+    return ver_written[v] < e && e <= ver_gone[v];
+}
+
+static void snap_ver_move(int to, int from) {
+    ver_code[to] = ver_code[from];
+    ver_stock[to] = ver_stock[from];
+    ver_otc[to] = ver_otc[from];
+    ver_crit[to] = ver_crit[from];
+    ver_price[to] = ver_price[from];
+    memcpy(ver_name[to], ver_name[from], MAX_NAME_LEN);
+    ver_seq[to] = ver_seq[from];
+    ver_written[to] = ver_written[from];
+    ver_gone[to] = ver_gone[from];
+}
+
+/* Tira las versiones que ya no ve ninguna instantanea fijada y rehace las
+   cadenas por fila. Una cadena de una fila que se quedo sin versiones
+   puede apuntar a cualquier lado: snap_find_version verifica cada paso. */
+static void snap_reclaim(void) {
+    int w = 0;
+    for (int v = 0; v < ver_count; ++v) {
+        int seen = 0;
+        for (int s = 0; s < MAX_SNAPSHOTS && !seen; ++s) seen = snap_epoch[s] && snap_sees(v, snap_epoch[s]);
+        if (!seen) continue;
+        if (w != v) snap_ver_move(w, v);
+        w++;
+    }
+    ver_count = w;
+    for (int v = 0; v < w; ++v) {
+        int idx = find_med_index_by_code(ver_code[v]);
+        if (idx != -1) med_row_ver[idx] = 0;
+    }
+    for (int v = 0; v < w; ++v) {
+        int idx = find_med_index_by_code(ver_code[v]);
+        ver_prev[v] = idx != -1 ? med_row_ver[idx] : 0;
+        if (idx != -1) med_row_ver[idx] = v + 1;
+    }
+}
+
+/* Suelta la instantanea s sin liberar versiones */
+static void snap_drop(int s) {
+    if (!snap_epoch[s]) return;
+    snap_epoch[s] = 0;
+    snap_pins--;
+    snap_newest = 0;
+    for (int t = 0; t < MAX_SNAPSHOTS; ++t) if (snap_epoch[t] > snap_newest) snap_newest = snap_epoch[t];
+}
+
+static void snap_release(int s) {
+    snap_drop(s);
+    snap_reclaim();
+}
+
+/* Fija una instantanea del estado actual; devuelve su lugar */
+static int snap_pin(void) {
+    int s = 0;
+    for (int t = 0; t < MAX_SNAPSHOTS; ++t) {
+        if (!snap_epoch[t]) { s = t; break; }
+        if (snap_used[t] < snap_used[s]) s = t;
+    }
+    if (snap_epoch[s]) snap_release(s);   /* todas en uso: la usada hace mas tiempo */
+    snap_epoch[s] = ++snap_epoch_now;
+    snap_used[s] = ++snap_clock;
+    snap_pins++;
+    snap_newest = snap_epoch[s];
+    return s;
+}
+
+/* 1 si la instantanea s de un cursor sigue fijada con esa epoca */
+static int snap_valid(int s, long long epoch) {
+    if (s < 0 || s >= MAX_SNAPSHOTS || epoch <= 0 || snap_epoch[s] != epoch) return 0;
+    snap_used[s] = ++snap_clock;
+    return 1;
+}
+
+/* El estado se reemplazo entero (imagen cargada, catalogo vaciado): se
+   sueltan todas y las filas actuales se numeran desde 1 (snap_reserve ya
+   dio lugar para med_count filas) */
+static void snap_clear(void) {
+    for (int s = 0; s < MAX_SNAPSHOTS; ++s) snap_epoch[s] = 0;
+    snap_pins = 0;
+    snap_newest = 0;
+    ver_count = 0;
+    for (int i = 0; i < med_count; ++i) {
+        med_row_epoch[i] = 0;
+        med_row_seq[i] = i + 1;
+        med_row_ver[i] = 0;
+    }
+    snap_next_seq = med_count + 1;
+}
+
+/* Fila nueva en idx: ninguna instantanea ya fijada la ve */
+static void snap_row_new(int idx) {
+    med_row_epoch[idx] = snap_epoch_now;
+    med_row_seq[idx] = snap_next_seq++;
+    med_row_ver[idx] = 0;
+}
+
+/* Antes de pisar o borrar la fila idx */
+static void snap_row_cow(int idx) {
+    if (snap_pins == 0) return;
+    long long w = med_row_epoch[idx];
+    med_row_epoch[idx] = snap_epoch_now;
+    if (w >= snap_newest) return;   /* ninguna instantanea fijada ve este contenido */
+    if (!snap_ver_reserve()) {
+        /* lista llena: se sueltan las que verian la copia */
+        for (int s = 0; s < MAX_SNAPSHOTS; ++s) if (snap_epoch[s] > w) snap_drop(s);
+        snap_reclaim();
+        return;
+    }
+    int v = ver_count++, head = med_row_ver[idx];
+    ver_code[v] = MED_CODE(idx);
+    memcpy(ver_name[v], MED_NAME(idx), MAX_NAME_LEN);
+    ver_price[v] = MED_PRICE(idx);
+    ver_stock[v] = MED_STOCK(idx);
+    ver_otc[v] = MED_OTC(idx);
+    ver_crit[v] = MED_CRIT(idx);
+    ver_seq[v] = med_row_seq[idx];
+    ver_written[v] = w;
+    ver_gone[v] = snap_epoch_now;
+    ver_prev[v] = head <= v ? head : 0;
+    med_row_ver[idx] = v + 1;
+}
+
+/* Version de code que ve la instantanea e; -1 si no hay (la fila no
+   cambio desde e o no existia) */
+static int snap_find_version(long long e, int code) {
+    int idx = find_med_index_by_code(code);
+    for (int v = idx != -1 ? med_row_ver[idx] - 1 : -1; v >= 0 && v < ver_count; v = ver_prev[v] - 1)
+        if (ver_code[v] == code && snap_sees(v, e)) return v;
+    for (int v = ver_count - 1; v >= 0; --v)   /* fila borrada o dada de alta de nuevo */
+        if (ver_code[v] == code && snap_sees(v, e)) return v;
+    return -1;
+}
+
+/* Recorrido de una pagina sobre la instantanea e. Una fila del recorrido
+   es >= 0 (fila actual del catalogo, sin cambios desde e) o SNAP_REF(v)
+   (version v). Como ord_scan_*, un solo recorrido a la vez. */
+#define SNAP_REF(v) (-(v) - 2)
+static int *snap_walk_ver;           /* versiones que caen en el recorrido, en orden */
+static int snap_walk_cap = 0, snap_walk_n = 0, snap_walk_pos = 0;
+static int snap_walk_k, snap_walk_desc;
+static int snap_walk_row = 0;        /* ORD_CATALOG: proxima posicion a mirar */
+static int snap_walk_next_row = -1;  /* proxima fila del catalogo del recorrido, -1 = no hay */
+static long long snap_walk_e;
+
+static int snap_ref_code(int r) { return r >= 0 ? MED_CODE(r) : ver_code[-r - 2]; }
+static const char *snap_ref_name(int r) { return r >= 0 ? MED_NAME(r) : ver_name[-r - 2]; }
+static long long snap_ref_seq(int r) { return r >= 0 ? med_row_seq[r] : ver_seq[-r - 2]; }
+
+static double snap_ref_value(int k, int r) {
+    if (r >= 0) return ord_value(k, r);
+    int v = -r - 2;
+    switch (k) {
+        case ORD_PRICE: return ver_price[v];
+        case ORD_STOCK: return ver_stock[v];
+        case ORD_COVER: return (double)ver_stock[v] / (ver_crit[v] > 0 ? ver_crit[v] : 1);
+        default: return 0.0;
+    }
+}
+
+static void snap_ref_get(int r, char *name, double *price, int *stock, int *is_otc, int *crit) {
+    int v = -r - 2;
+    if (name) { strncpy(name, snap_ref_name(r), MAX_NAME_LEN - 1); name[MAX_NAME_LEN - 1] = '\0'; }
+    if (price) *price = r >= 0 ? MED_PRICE(r) : ver_price[v];
+    if (stock) *stock = r >= 0 ? MED_STOCK(r) : ver_stock[v];
+    if (is_otc) *is_otc = r >= 0 ? MED_OTC(r) : ver_otc[v];
+    if (crit) *crit = r >= 0 ? MED_CRIT(r) : ver_crit[v];
+}
+
+/* Signo de (fila r) - (pivote) en orden ascendente por k; ORD_CATALOG
+   ordena solo por alta */
+static int snap_cmp_pivot(int k, int r, double pkey, const char *pname, long long pseq) {
+    if (k == ORD_NAME) {
+        int c = strcmp(snap_ref_name(r), pname);
+        if (c) return c;
+    } else if (k != ORD_CATALOG) {
+        double key = snap_ref_value(k, r);
+        if (key != pkey) return key < pkey ? -1 : 1;
+    }
+    long long seq = snap_ref_seq(r);
+    return (seq > pseq) - (seq < pseq);
+}
+
+static int snap_cmp_refs(int k, int a, int b) {
+    return snap_cmp_pivot(k, a, snap_ref_value(k, b), snap_ref_name(b), snap_ref_seq(b));
+}
+
+static int snap_cmp_walk(const void *a, const void *b) {
+    int c = snap_cmp_refs(snap_walk_k, SNAP_REF(*(const int *)a), SNAP_REF(*(const int *)b));
+    return snap_walk_desc ? -c : c;
+}
+
+/* Cuantas filas del catalogo tienen alta < seq (o <= si le) */
+static int snap_seq_rank(long long seq, int le) {
+    int lo = 0, hi = med_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (med_row_seq[mid] < seq || (le && med_row_seq[mid] == seq)) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Proxima fila del catalogo que no cambio desde la instantanea */
+static int snap_walk_row_next(void) {
+    if (snap_walk_k == ORD_CATALOG) {
+        while (snap_walk_row < med_count && med_row_epoch[snap_walk_row] >= snap_walk_e) snap_walk_row++;
+        return snap_walk_row < med_count ? snap_walk_row++ : -1;
+    }
+    int idx;
+    while ((idx = ord_scan_next()) != -1 && med_row_epoch[idx] >= snap_walk_e) {}
+    return idx;
+}
+
+/* Recorrido por k (ORD_CATALOG u ORD_*) de lo que ve la instantanea e,
+   despues del pivote (pkey | pname, pseq) si resume. 0 si no hubo memoria. */
+static int snap_walk_begin(long long e, int k, int desc, double lo, double hi, int resume,
+                           double pkey, const char *pname, long long pseq) {
+    if (ver_count > snap_walk_cap) {
+        int *buf = realloc(snap_walk_ver, sizeof(int) * (size_t)ver_cap);
+        if (!buf) return 0;
+        snap_walk_ver = buf;
+        snap_walk_cap = ver_cap;
+    }
+    snap_walk_e = e; snap_walk_k = k; snap_walk_desc = desc;
+    snap_walk_n = snap_walk_pos = 0;
+    for (int v = 0; v < ver_count; ++v) {
+        if (!snap_sees(v, e)) continue;
+        if (k != ORD_CATALOG && k != ORD_NAME) {
+            double key = snap_ref_value(k, SNAP_REF(v));
+            if (key < lo || key > hi) continue;
+        }
+        if (resume) {
+            int c = snap_cmp_pivot(k, SNAP_REF(v), pkey, pname, pseq);
+            if (desc ? c >= 0 : c <= 0) continue;
+        }
+        snap_walk_ver[snap_walk_n++] = v;
+    }
+    if (snap_walk_n > 1) qsort(snap_walk_ver, (size_t)snap_walk_n, sizeof(snap_walk_ver[0]), snap_cmp_walk);
+    if (k == ORD_CATALOG) snap_walk_row = resume ? snap_seq_rank(pseq, 1) : 0;
+    else ord_scan_from(k, desc, lo, hi, resume, pkey, pname,
+                       desc ? snap_seq_rank(pseq, 0) : snap_seq_rank(pseq, 1) - 1);
+    snap_walk_next_row = snap_walk_row_next();
+    return 1;
+}
+
+/* Proxima fila del recorrido; -1 al terminar */
+static int snap_walk_next(void) {
+    int row = snap_walk_next_row;
+    if (snap_walk_pos < snap_walk_n) {
+        int r = SNAP_REF(snap_walk_ver[snap_walk_pos]);
+        int c = row == -1 ? 0 : snap_cmp_refs(snap_walk_k, r, row);
+        if (row == -1 || (snap_walk_desc ? c > 0 : c < 0)) { snap_walk_pos++; return r; }
+    }
+    if (row != -1) snap_walk_next_row = snap_walk_row_next();
+    return row;
+}
+
+/* ------------- OPERACIONES DEL NUCLEO (sin pantalla ni teclado) ------------- */
+/* Cambios de estado compartidos por el menu, la importacion y la
+   aplicacion de la bitacora (recuperacion y replica). El que llama ya
+   valido los datos (codigo no repetido, lugar disponible, etc.). */
+/* ts = desde cuando rige el precio (para el historial de precios).
+   Devuelve -1 (y no agrega nada) si no hubo memoria para los indices. */
+static int med_insert(int code, const char *name, size_t name_len, double price, int stock, int is_otc, int crit, long long ts) {
+    if (!ord_reserve(med_count + 1) || !branch_stock_reserve(med_count + 1) || !snap_reserve(med_count + 1) ||
+        !cube_reserve(med_count + 1)) return -1;
+    int idx = med_count++;
+    if (name_len > MAX_NAME_LEN - 1) name_len = MAX_NAME_LEN - 1;
+    MED_CODE(idx) = code;
+    memcpy(MED_NAME(idx), name, name_len); MED_NAME(idx)[name_len] = '\0';
+    MED_PRICE(idx) = price;
+    MED_STOCK(idx) = stock;
+    MED_OTC(idx) = is_otc;
+    MED_CRIT(idx) = crit;
+    med_index_insert(code, idx);
+    if (ord_deferred) med_by_code_ok = 0;   /* carga masiva: se arma de nuevo si hace falta */
+    else med_by_code_add(code, idx);
+    snap_row_new(idx);
+    ord_insert(idx);
+    cube_clear_row(idx);
+    demand_clear_row(idx);
+    for (int p = 0; p < BRANCH_PARTS; ++p) branch_stock[p][idx] = 0;   /* en las demas sucursales arranca sin stock */
+    price_hist_add(code, ts, price);
+    return idx;
+}
+
+static void med_update(int idx, const char *name, double price, int stock, int is_otc, int crit, long long ts) {
+    snap_row_cow(idx);
+    price_hist_add(MED_CODE(idx), ts, price);
+    int renamed = strncmp(MED_NAME(idx), name, MAX_NAME_LEN - 1) != 0;
+    int restock = stock != MED_STOCK(idx) || crit != MED_CRIT(idx);
+    int reprice = price != MED_PRICE(idx);
+    if (renamed) ord_name_remove(idx);
+    strncpy(MED_NAME(idx), name, MAX_NAME_LEN-1); MED_NAME(idx)[MAX_NAME_LEN-1] = '\0';
+    MED_PRICE(idx) = price;
+    MED_STOCK(idx) = stock;
+    MED_OTC(idx) = is_otc;
+    MED_CRIT(idx) = crit;
+    if (renamed) ord_touch(ORD_NAME, idx);
+    if (reprice) ord_touch(ORD_PRICE, idx);
+    if (restock) ord_stock_changed(idx);
+}
+
+static void med_delete_at(int idx) {
+    int code = MED_CODE(idx);
+    snap_row_cow(idx);
+    for (int i = idx; i < med_count - 1; ++i) {
+        MED_CODE(i) = MED_CODE(i+1);
+        strncpy(MED_NAME(i), MED_NAME(i+1), MAX_NAME_LEN);
+        MED_PRICE(i) = MED_PRICE(i+1);
+        MED_STOCK(i) = MED_STOCK(i+1);
+        MED_OTC(i) = MED_OTC(i+1);
+        MED_CRIT(i) = MED_CRIT(i+1);
+        memcpy(med_cube_units[i], med_cube_units[i+1], sizeof(med_cube_units[i]));
+        memcpy(med_cube_amount[i], med_cube_amount[i+1], sizeof(med_cube_amount[i]));
+        demand_copy_row(i, i + 1);
+    }
+    med_count--;
+    for (int p = 0; p < BRANCH_PARTS; ++p)
+        memmove(branch_stock[p] + idx, branch_stock[p] + idx + 1, sizeof(branch_stock[p][0]) * (size_t)(med_count - idx));
+    memmove(med_row_epoch + idx, med_row_epoch + idx + 1, sizeof(med_row_epoch[0]) * (size_t)(med_count - idx));
+    memmove(med_row_seq + idx, med_row_seq + idx + 1, sizeof(med_row_seq[0]) * (size_t)(med_count - idx));
+    memmove(med_row_ver + idx, med_row_ver + idx + 1, sizeof(med_row_ver[0]) * (size_t)(med_count - idx));
+    med_index_rebuild();
+    med_by_code_remove(code, idx);
+    ord_delete_shift(idx);
+}
+
+/* Solo la fila de la venta, sin tocar el stock. Devuelve la posicion. */
+static int sale_record(long long ts, int day, int code, int qty, double amount, const char *dni) {
+    int i = sale_count;
+    SALE_TS(i) = ts;
+    if (ts > sale_last_ts) sale_last_ts = ts;
+    SALE_DAY(i) = day;
+    SALE_CODE(i) = code;
+    SALE_QTY(i) = qty;
+    SALE_AMOUNT(i) = amount;
+    strncpy(SALE_DNI(i), dni, sizeof(SALE_DNI(i)) - 1); SALE_DNI(i)[sizeof(SALE_DNI(i)) - 1] = '\0';
+    sale_count++;
+    return i;
+}
+
+/* Lo vendido sale del stock de idx y se suma al cubo y a la demanda */
+static void sale_take_stock(int idx, int day, int qty, double amount) {
+    snap_row_cow(idx);
+    MED_STOCK(idx) -= qty;
+    ord_stock_changed(idx);
+    cube_add(idx, day, qty, amount);
+    demand_add(idx, day, qty);
+}
+
+/* Agrega una venta ya calculada y descuenta stock del producto idx
+   (idx = -1 si el producto ya no esta en el catalogo). Devuelve la posicion. */
+static int sale_append(int idx, long long ts, int day, int code, int qty, double amount, const char *dni) {
+    int i = sale_record(ts, day, code, qty, amount, dni);
+    if (idx != -1) sale_take_stock(idx, day, qty, amount);
+    return i;
+}
+
+/* Borra las ventas del mes de todas las sucursales (el resumen que queda
+   sellado en el cubo es el de la sucursal 0) */
+static int sales_reset(void) {
+    int sealed = cube_seal_month();
+    sale_seq_base += sale_count;
+    sale_count = 0;
+    for (int p = 0; p < BRANCH_PARTS; ++p) BRANCH_SALES(p) = 0;
+    return sealed;
+}
+
+/* ------------- SUCURSALES: PARTICIONES E INFORMES CONSOLIDADOS ------------- */
+/* Operaciones sobre las particiones (ver DATOS: particiones por sucursal).
+   Los informes consolidados hacen una pasada por sucursal (branch_scan) y
+   suman los resultados; con suficientes filas cada pasada corre en su
+   propio hilo. Las pasadas solo leen y el hilo que llama espera a que
+   terminen todas, asi no hace falta bloquear nada. */
+#ifndef BRANCH_PARALLEL_MIN_ROWS
+#define BRANCH_PARALLEL_MIN_ROWS 100000
+#endif
+#ifdef BRANCH_THREADS
+static long long branch_parallel_min_rows = BRANCH_PARALLEL_MIN_ROWS;   /* por debajo, una pasada tras otra */
+#endif
+
+/* Resultado de la ultima pasada de cada sucursal: ventas e importe por dia
+   y filas del catalogo en o por debajo del critico. Cada hilo escribe solo
+   la fila de su sucursal. */
+static _Alignas(64) int bagg_count[MAX_BRANCHES][DAYS_IN_MONTH + 1];
+static _Alignas(64) double bagg_amount[MAX_BRANCHES][DAYS_IN_MONTH + 1];
+static int bagg_crit_count[MAX_BRANCHES];
+static int bagg_crit_cap[MAX_BRANCHES];
+static int *bagg_crit_idx[MAX_BRANCHES];   /* lugar para el catalogo: bagg_crit_reserve */
+static int bagg_want_crit = 0;
+
+/* Lugar en bagg_crit_idx[b] para todo el catalogo. 0 si no hubo memoria. */
+static int bagg_crit_reserve(int b) {
+    if (med_count <= bagg_crit_cap[b]) return 1;
+    int *buf = realloc(bagg_crit_idx[b], sizeof(int) * (size_t)med_count);
+    if (!buf) return 0;
+    bagg_crit_idx[b] = buf;
+    bagg_crit_cap[b] = med_count;
+    return 1;
+}
+
+static int branch_stock_of(int b, int idx) {
+    return b == 0 ? MED_STOCK(idx) : branch_stock[b - 1][idx];
+}
+
+/* Vacia todas las particiones (estado inicial) */
+static void branch_clear(void) {
+    branch_count = 1;
+    for (int p = 0; p < BRANCH_PARTS; ++p) {
+        BRANCH_SALES(p) = 0;
+        if (med_count > 0) memset(branch_stock[p], 0, sizeof(branch_stock[p][0]) * (size_t)med_count);
+    }
+}
+
+static void branch_stock_set(int b, int idx, int stock) {
+    branch_stock[b - 1][idx] = stock;
+    if (b >= branch_count) branch_count = b + 1;
+}
+
+/* Mercaderia recibida: suma qty al stock de idx en la sucursal b (0 = el
+   maestro, que lleva los indices ordenados por stock y cobertura) */
+static void branch_receive(int b, int idx, int qty) {
+    if (b > 0) { branch_stock_set(b, idx, branch_stock[b - 1][idx] + qty); return; }
+    snap_row_cow(idx);
+    MED_STOCK(idx) += qty;
+    ord_stock_changed(idx);
+}
+
+/* Como sale_append, en la particion de la sucursal b >= 1 (el que llama
+   ya dio lugar con branch_sales_reserve) */
+static int branch_sale_append(int b, int idx, long long ts, int day, int code, int qty, double amount, const char *dni) {
+    int p = b - 1, i = BRANCH_SALES(p);
+    branch_sale_ts[p][i] = ts;
+    branch_sale_day[p][i] = day;
+    branch_sale_code[p][i] = code;
+    branch_sale_qty[p][i] = qty;
+    branch_sale_amount[p][i] = amount;
+    strncpy(branch_sale_dni[p][i], dni, DNI_LEN - 1); branch_sale_dni[p][i][DNI_LEN - 1] = '\0';
+    BRANCH_SALES(p) = i + 1;
+    if (idx != -1) branch_stock[p][idx] -= qty;
+    if (b >= branch_count) branch_count = b + 1;
+    return i;
+}
+
+/* Una pasada sobre la sucursal b: ventas por dia y, si bagg_want_crit,
+   productos en o por debajo del critico */
+static void branch_scan(int b) {
+    int count[DAYS_IN_MONTH + 1] = { 0 };
+    double amount[DAYS_IN_MONTH + 1] = { 0 };
+    if (b == 0) {
+        for (int i = 0; i < sale_count; ++i) {
+            int d = SALE_DAY(i);
+            if ((unsigned)d > DAYS_IN_MONTH) d = 0;   /* casillero 0: dia invalido, solo suma al total */
+            count[d] += 1;
+            amount[d] += SALE_AMOUNT(i);
+        }
+    } else {
+        const int *day = branch_sale_day[b - 1];
+        const double *amt = branch_sale_amount[b - 1];
+        for (int i = 0, n = BRANCH_SALES(b - 1); i < n; ++i) {
+            int d = day[i];
+            if ((unsigned)d > DAYS_IN_MONTH) d = 0;
+            count[d] += 1;
+            amount[d] += amt[i];
+        }
+    }
+    memcpy(bagg_count[b], count, sizeof(count));
+    memcpy(bagg_amount[b], amount, sizeof(amount));
+    if (!bagg_want_crit) return;
+    int found = 0;
+    if (b == 0) {
+        for (int i = 0; i < med_count; ++i) if (MED_STOCK(i) <= MED_CRIT(i)) bagg_crit_idx[b][found++] = i;
+    } else {
+        const int *stock = branch_stock[b - 1];
+        for (int i = 0; i < med_count; ++i) if (stock[i] <= MED_CRIT(i)) bagg_crit_idx[b][found++] = i;
+    }
+    bagg_crit_count[b] = found;
+}
+
+#ifdef BRANCH_THREADS
+static void *branch_scan_thread(void *arg) {
+    branch_scan((int)(intptr_t)arg);
+    return NULL;
+}
+#endif
+
+/* Pasada sobre todas las sucursales en uso: un hilo por sucursal (la 0 en
+   el hilo que llama) si hay al menos branch_parallel_min_rows filas para
+   recorrer; con menos, crear los hilos cuesta mas que la pasada. */
+static void branch_aggregate(int with_critical) {
+    bagg_want_crit = with_critical;
+#ifdef BRANCH_THREADS
+    long long rows = sale_count + (with_critical ? (long long)med_count * branch_count : 0);
+    for (int p = 0; p < branch_count - 1; ++p) rows += BRANCH_SALES(p);
+    if (branch_count > 1 && rows >= branch_parallel_min_rows) {
+        pthread_t th[MAX_BRANCHES];
+        int started[MAX_BRANCHES];
+        for (int b = 1; b < branch_count; ++b)
+            started[b] = pthread_create(&th[b], NULL, branch_scan_thread, (void *)(intptr_t)b) == 0;
+        branch_scan(0);
+        for (int b = 1; b < branch_count; ++b) {
+            if (started[b]) pthread_join(th[b], NULL);
+            else branch_scan(b);   /* sin hilo disponible: aca mismo */
+        }
+        return;
+    }
+#endif
+    for (int b = 0; b < branch_count; ++b) branch_scan(b);
+}
+
+/* Todos los datos vacios, como al arrancar: catalogo, ventas, cubo y meses
+   cerrados, demanda, indices, historial de precios, sucursales e
+   instantaneas. Los arrays reservados quedan (se reusan). */
+static void state_clear(void) {
+    for (int i = 0; i < med_count; ++i) { cube_clear_row(i); demand_clear_row(i); }
+    branch_clear();
+    med_count = sale_count = 0;
+    sale_seq_base = sale_last_ts = 0;
+    cube_year = cube_month = 0;
+    sealed_month_count = sealed_row_count = 0;
+    dem_clock = 0;
+    med_index_rebuild();
+    med_by_code_ok = 0;
+    ord_rebuild();
+    snap_clear();
+    price_hist_clear();
+}
+
+/* ------------- BITACORA DE CAMBIOS (RECUPERACION Y REPLICA) ------------- */
+/* Con --registro <archivo> cada cambio de catalogo y de ventas se agrega
+   como una linea de texto separada por tabs:
+     LSN  TS_us  TIPO  datos...
+   A/E codigo nombre precio stock otc critico  (alta / edicion, imagen completa)
+   D   codigo                                  (baja)
+   V   ts dia codigo cant importe dni          (venta)
+   C   dia dni n {ts codigo cant importe}xn    (carrito: un registro por venta multiple)
+   S   sucursal codigo stock                   (stock en una sucursal >= 1)
+   U   sucursal ts dia codigo cant importe dni (venta en una sucursal >= 1)
+   I   sucursal total desde n {codigo cant}xn  (recepcion: suma cant al stock; un
+                                               remito de total renglones puede ocupar
+                                               varios I seguidos y entra entero con el ultimo)
+   R                                           (reinicio de mes, todas las sucursales)
+   Al arrancar se vuelve a aplicar el archivo para recuperar el estado, y
+   un proceso replica (--replica) lo sigue leyendo mientras crece. */
+static FILE *journal_fp = NULL;
+static long long journal_lsn = 0;
+static long long journal_since_ckpt = 0;   /* registros desde la ultima imagen */
+
+static long long wall_clock_us(void) {
+#ifdef _WIN32
+    return (long long)time(NULL) * 1000000LL;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+}
+
+/* Escritura de la bitacora. Los registros se arman en jio_arena (buffer
+   circular) y journal_commit los baja al archivo segun journal_io_mode:
+     JIO_BUFFERED  write() sin sincronizar (sobrevive a que se corte el
+                   programa, no a un corte de luz)
+     JIO_FDATASYNC write() + fdatasync(): durable, pero la venta espera al disco
+     JIO_URING     io_uring (Linux): la arena esta registrada en el kernel y
+                   cada commit es una cadena write -> fsync enlazada
+                   (IOSQE_IO_LINK) que se envia con una sola llamada; la
+                   venta vuelve apenas la cadena queda encolada. La primera
+                   escritura de cada cadena lleva IOSQE_IO_DRAIN: no empieza
+                   hasta que termino lo anterior, asi el archivo crece en
+                   orden y un corte nunca deja datos nuevos tras un hueco.
+   Con JIO_MAX_CHAINS cadenas en vuelo lo nuevo espera en la arena y sale
+   todo junto en la cadena siguiente (un fsync para varias ventas).
+   journal_durable_lsn = ultimo LSN que ya esta en disco. */
+#define JIO_BUFFERED 0
+#define JIO_FDATASYNC 1
+#define JIO_URING 2
+#define JIO_ARENA_SIZE (1 << 20)
+#define JIO_RING_ENTRIES 64
+#define JIO_MAX_CHAINS 2
+
+static const char *jio_mode_names[] = { "sin_sync", "fdatasync", "uring" };
+static int journal_io_mode = -1;           /* -1 = uring si se puede, si no sin_sync */
+static char *jio_arena = NULL;
+/* Posiciones absolutas en la arena (crecen siempre; byte % JIO_ARENA_SIZE) */
+static long long jio_head = 0;             /* hasta aca ya esta escrito en el archivo */
+static long long jio_sub = 0;              /* hasta aca ya se entrego (escrito o encolado) */
+static long long jio_tail = 0;             /* hasta aca se agrego */
+static long long jio_file_base = 0;        /* offset en el archivo de la posicion 0 */
+static long long journal_durable_lsn = 0;
+
+/* Escribe [from, to) de la arena en el archivo, en el lugar que le toca */
+static int jio_write_range(long long from, long long to) {
+    while (from < to) {
+        size_t pos = (size_t)(from % JIO_ARENA_SIZE);
+        size_t len = (size_t)(to - from);
+        if (len > JIO_ARENA_SIZE - pos) len = JIO_ARENA_SIZE - pos;
+#ifdef _WIN32
+        if (fwrite(jio_arena + pos, 1, len, journal_fp) != len) return 0;
+        from += (long long)len;
+#else
+        ssize_t w = pwrite(fileno(journal_fp), jio_arena + pos, len, (off_t)(jio_file_base + from));
+        if (w <= 0) { if (w < 0 && errno == EINTR) continue; return 0; }
+        from += w;
+#endif
+    }
+#ifdef _WIN32
+    fflush(journal_fp);
+#endif
+    return 1;
+}
+
+static void jio_sync_file(void) {
+#ifndef _WIN32
+    fdatasync(fileno(journal_fp));
+#endif
+}
+
+#ifdef JOURNAL_URING
+static int jio_ring_fd = -1;
+static unsigned *jio_sq_tail, *jio_sq_mask, *jio_sq_array;
+static unsigned *jio_cq_head, *jio_cq_tail, *jio_cq_mask;
+static struct io_uring_sqe *jio_sqes;
+static struct io_uring_cqe *jio_cqes;
+static void *jio_ring_map = NULL, *jio_sqe_map = NULL;
+static size_t jio_ring_map_len = 0, jio_sqe_map_len = 0;
+static int jio_fixed = 0;                  /* arena registrada (IORING_OP_WRITE_FIXED) */
+static int jio_chains = 0;                 /* cadenas enviadas sin terminar */
+/* Operaciones en vuelo, en orden de envio: op n usa el lugar n % JIO_RING_ENTRIES */
+static long long jio_ops_first = 0, jio_ops_next = 0;
+static long long jio_op_from[JIO_RING_ENTRIES], jio_op_to[JIO_RING_ENTRIES];  /* escritura; from -1 = fsync */
+static long long jio_op_lsn[JIO_RING_ENTRIES];
+static int jio_op_res[JIO_RING_ENTRIES], jio_op_done[JIO_RING_ENTRIES], jio_op_chain_end[JIO_RING_ENTRIES];
+
+static int jio_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    int r;
+    do r = (int)syscall(__NR_io_uring_enter, jio_ring_fd, to_submit, min_complete, flags, NULL, 0);
+    while (r < 0 && errno == EINTR);
+    return r;
+}
+
+static void jio_uring_close(void) {
+    if (jio_ring_fd < 0) return;
+    close(jio_ring_fd);
+    jio_ring_fd = -1;
+    if (jio_sqe_map) munmap(jio_sqe_map, jio_sqe_map_len);
+    if (jio_ring_map) munmap(jio_ring_map, jio_ring_map_len);
+    jio_sqe_map = jio_ring_map = NULL;
+}
+
+/* Crea el anillo y registra la arena. 0 si el kernel no lo permite. */
+static int jio_uring_setup(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    jio_ring_fd = (int)syscall(__NR_io_uring_setup, JIO_RING_ENTRIES, &p);
+    if (jio_ring_fd < 0) return 0;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) { jio_uring_close(); return 0; }
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    jio_ring_map_len = sq_len > cq_len ? sq_len : cq_len;
+    jio_ring_map = mmap(NULL, jio_ring_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        jio_ring_fd, IORING_OFF_SQ_RING);
+    if (jio_ring_map == MAP_FAILED) { jio_ring_map = NULL; jio_uring_close(); return 0; }
+    jio_sqe_map_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    jio_sqe_map = mmap(NULL, jio_sqe_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       jio_ring_fd, IORING_OFF_SQES);
+    if (jio_sqe_map == MAP_FAILED) { jio_sqe_map = NULL; jio_uring_close(); return 0; }
+    char *ring = jio_ring_map;
+    jio_sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    jio_sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    jio_sq_array = (unsigned *)(ring + p.sq_off.array);
+    jio_cq_head = (unsigned *)(ring + p.cq_off.head);
+    jio_cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    jio_cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    jio_cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    jio_sqes = jio_sqe_map;
+    /* Buffer registrado: el kernel lo fija una vez y no lo vuelve a mapear
+       en cada escritura. Si no alcanza el limite de memoria bloqueada se
+       usa IORING_OP_WRITE comun. */
+    struct iovec iov = { jio_arena, JIO_ARENA_SIZE };
+    jio_fixed = syscall(__NR_io_uring_register, jio_ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    return 1;
+}
+
+static void jio_retire(long long n) {
+    int k = (int)(n % JIO_RING_ENTRIES);
+    int res = jio_op_res[k];
+    if (jio_op_from[k] >= 0) {
+        long long from = jio_op_from[k], to = jio_op_to[k];
+        if (res != (int)(to - from)) {
+            /* fallo o escritura corta (o cancelada por un fallo anterior de
+               la cadena): se completa a mano en su lugar y se deja io_uring */
+            long long done = res > 0 ? res : 0;
+            if (!jio_write_range(from + done, to)) printf("Advertencia: no se pudo escribir la bitacora.\n");
+            jio_sync_file();
+            if (journal_io_mode == JIO_URING)
+                printf("Advertencia: io_uring fallo (%s); la bitacora sigue con fdatasync.\n", strerror(res < 0 ? -res : EIO));
+            journal_io_mode = JIO_FDATASYNC;
+        }
+        if (to > jio_head) jio_head = to;
+    } else {
+        if (res < 0) jio_sync_file();   /* fsync cancelado o con error: se repite aca */
+        if (jio_op_lsn[k] > journal_durable_lsn) journal_durable_lsn = jio_op_lsn[k];
+    }
+    if (jio_op_chain_end[k]) jio_chains--;
+}
+
+/* Recoge completados (wait = esperar al menos uno si hay en vuelo) y
+   libera en orden lo que ya termino */
+static void jio_reap(int wait) {
+    if (wait && jio_ops_first < jio_ops_next) jio_enter(0, 1, IORING_ENTER_GETEVENTS);
+    unsigned head = *jio_cq_head;
+    while (head != __atomic_load_n(jio_cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &jio_cqes[head & *jio_cq_mask];
+        int k = (int)(cqe->user_data % JIO_RING_ENTRIES);
+        jio_op_res[k] = cqe->res;
+        jio_op_done[k] = 1;
+        head++;
+    }
+    __atomic_store_n(jio_cq_head, head, __ATOMIC_RELEASE);
+    while (jio_ops_first < jio_ops_next && jio_op_done[jio_ops_first % JIO_RING_ENTRIES])
+        jio_retire(jio_ops_first++);
+}
+
+static struct io_uring_sqe *jio_sqe(unsigned nth, long long from, long long to, long long lsn) {
+    long long n = jio_ops_next + nth;
+    int k = (int)(n % JIO_RING_ENTRIES);
+    unsigned tail = *jio_sq_tail + nth;
+    struct io_uring_sqe *sqe = &jio_sqes[tail & *jio_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (unsigned long long)n;
+    jio_sq_array[tail & *jio_sq_mask] = tail & *jio_sq_mask;
+    jio_op_from[k] = from;
+    jio_op_to[k] = to;
+    jio_op_lsn[k] = lsn;
+    jio_op_done[k] = 0;
+    jio_op_chain_end[k] = 0;
+    return sqe;
+}
+
+static void jio_uring_finish(void) {
+    while (jio_ring_fd >= 0 && jio_ops_first < jio_ops_next) jio_reap(1);
+}
+
+/* Encola lo pendiente como una cadena: write [write] [-> fsync] */
+static void jio_uring_submit(int sync) {
+    if (jio_sub >= jio_tail) return;
+    while (jio_ops_next - jio_ops_first > JIO_RING_ENTRIES - 3) jio_reap(1);
+    unsigned n = 0;
+    int fd = fileno(journal_fp);
+    for (long long from = jio_sub; from < jio_tail; ++n) {
+        size_t pos = (size_t)(from % JIO_ARENA_SIZE);
+        long long len = jio_tail - from;
+        if (len > (long long)(JIO_ARENA_SIZE - pos)) len = (long long)(JIO_ARENA_SIZE - pos);
+        struct io_uring_sqe *sqe = jio_sqe(n, from, from + len, 0);
+        sqe->opcode = jio_fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = (unsigned long long)(uintptr_t)(jio_arena + pos);
+        sqe->len = (unsigned)len;
+        sqe->off = (unsigned long long)(jio_file_base + from);
+        sqe->flags = IOSQE_IO_LINK | (n == 0 ? IOSQE_IO_DRAIN : 0);
+        from += len;
+    }
+    if (sync) {
+        struct io_uring_sqe *sqe = jio_sqe(n++, -1, -1, journal_lsn);
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    }
+    jio_sqes[(*jio_sq_tail + n - 1) & *jio_sq_mask].flags &= (unsigned char)~IOSQE_IO_LINK;
+    jio_op_chain_end[(jio_ops_next + n - 1) % JIO_RING_ENTRIES] = 1;
+    __atomic_store_n(jio_sq_tail, *jio_sq_tail + n, __ATOMIC_RELEASE);
+    jio_ops_next += n;
+    jio_chains++;
+    jio_sub = jio_tail;
+    unsigned left = n;
+    while (left > 0) {
+        int r = jio_enter(left, 0, 0);
+        if (r > 0) { left -= (unsigned)r; continue; }
+        if (r < 0 && (errno == EAGAIN || errno == EBUSY) && jio_ops_first < jio_ops_next - left) { jio_reap(1); continue; }
+        /* el kernel no toma la cadena: lo que falta se da por fallado y
+           jio_retire lo escribe sincronico */
+        for (long long op = jio_ops_next - left; op < jio_ops_next; ++op) {
+            jio_op_res[op % JIO_RING_ENTRIES] = -ECANCELED;
+            jio_op_done[op % JIO_RING_ENTRIES] = 1;
+        }
+        jio_reap(0);
+        break;
+    }
+}
+#endif
+
+/* Modos sincronicos: lo pendiente va al archivo ahora */
+static void jio_flush_sync(int sync) {
+#ifdef JOURNAL_URING
+    jio_uring_finish();   /* si se dejo io_uring por un error, primero lo que quedo en vuelo */
+#endif
+    if (jio_sub < jio_tail && !jio_write_range(jio_sub, jio_tail))
+        printf("Advertencia: no se pudo escribir la bitacora.\n");
+    jio_sub = jio_head = jio_tail;
+    if (sync) { jio_sync_file(); journal_durable_lsn = journal_lsn; }
+}
+
+/* Hace lugar en la arena: entrega lo pendiente (sin fsync) y, con io_uring,
+   espera a que termine lo mas viejo */
+static void jio_make_room(void) {
+#ifdef JOURNAL_URING
+    if (journal_io_mode == JIO_URING) {
+        if (jio_sub < jio_tail) jio_uring_submit(0);
+        jio_reap(1);
+        return;
+    }
+#endif
+    jio_flush_sync(0);
+}
+
+static void jio_append(const char *p, size_t n) {
+    while ((long long)n > JIO_ARENA_SIZE - (jio_tail - jio_head)) jio_make_room();
+    size_t pos = (size_t)(jio_tail % JIO_ARENA_SIZE);
+    size_t first = n < JIO_ARENA_SIZE - pos ? n : JIO_ARENA_SIZE - pos;
+    memcpy(jio_arena + pos, p, first);
+    memcpy(jio_arena, p + first, n - first);
+    jio_tail += (long long)n;
+}
+
+static void journal_printf(const char *fmt, ...) {
+    char buf[JOURNAL_MAX_LINE];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) jio_append(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+/* Texto sin tabs ni saltos (son separadores de la bitacora) */
+static void journal_put_text(const char *t) {
+    char buf[MAX_NAME_LEN];
+    size_t n = 0;
+    for (; *t; ++t) {
+        buf[n++] = (*t == '\t' || *t == '\n' || *t == '\r') ? ' ' : *t;
+        if (n == sizeof(buf)) { jio_append(buf, n); n = 0; }
+    }
+    jio_append(buf, n);
+}
+
+static void journal_begin(char type) {
+    journal_since_ckpt++;
+    journal_printf("%lld\t%lld\t%c", ++journal_lsn, wall_clock_us(), type);
+}
+
+static void journal_med(char type, int idx) {
+    if (!journal_fp) return;
+    journal_begin(type);
+    journal_printf("\t%d\t", MED_CODE(idx));
+    journal_put_text(MED_NAME(idx));
+    journal_printf("\t%.17g\t%d\t%d\t%d\n", MED_PRICE(idx), MED_STOCK(idx), MED_OTC(idx), MED_CRIT(idx));
+}
+
+static void journal_delete(int code) {
+    if (!journal_fp) return;
+    journal_begin('D');
+    journal_printf("\t%d\n", code);
+}
+
+static void journal_sale(int i) {
+    if (!journal_fp) return;
+    journal_begin('V');
+    journal_printf("\t%lld\t%d\t%d\t%d\t%.17g\t", SALE_TS(i), SALE_DAY(i), SALE_CODE(i), SALE_QTY(i), SALE_AMOUNT(i));
+    journal_put_text(SALE_DNI(i));
+    jio_append("\n", 1);
+}
+
+static void journal_cart(int first, int n, int day, const char *dni) {
+    if (!journal_fp) return;
+    journal_begin('C');
+    journal_printf("\t%d\t", day);
+    journal_put_text(dni);
+    journal_printf("\t%d", n);
+    for (int i = first; i < first + n; ++i)
+        journal_printf("\t%lld\t%d\t%d\t%.17g", SALE_TS(i), SALE_CODE(i), SALE_QTY(i), SALE_AMOUNT(i));
+    jio_append("\n", 1);
+}
+
+#ifdef FARMACIA_SIN_MENU   /* solo lo usa farm_branch_set_stock */
+static void journal_branch_stock(int b, int idx) {
+    if (!journal_fp) return;
+    journal_begin('S');
+    journal_printf("\t%d\t%d\t%d\n", b, MED_CODE(idx), branch_stock[b - 1][idx]);
+}
+#endif
+
+static void journal_branch_sale(int b, int i) {
+    if (!journal_fp) return;
+    int p = b - 1;
+    journal_begin('U');
+    journal_printf("\t%d\t%lld\t%d\t%d\t%d\t%.17g\t", b, branch_sale_ts[p][i], branch_sale_day[p][i],
+                   branch_sale_code[p][i], branch_sale_qty[p][i], branch_sale_amount[p][i]);
+    journal_put_text(branch_sale_dni[p][i]);
+    jio_append("\n", 1);
+}
+
+/* Recepcion: un remito de n renglones (fila, cantidad) en registros I de
+   hasta RECEIVE_PER_RECORD renglones. Cada uno lleva el total del remito y
+   desde que renglon sigue: al leer la bitacora el remito se aplica entero
+   con su ultimo registro, nunca a medias (ver journal_apply_receive). El
+   que llama hace un solo journal_commit para todos. */
+#define RECEIVE_PER_RECORD (2 * MAX_SALES_PER_RECORD)
+
+static void journal_receive(int b, const int *idx, const int *qty, int n) {
+    if (!journal_fp) return;
+    for (int first = 0; first < n; first += RECEIVE_PER_RECORD) {
+        int lines = n - first < RECEIVE_PER_RECORD ? n - first : RECEIVE_PER_RECORD;
+        journal_begin('I');
+        journal_printf("\t%d\t%d\t%d\t%d", b, n, first, lines);
+        for (int k = first; k < first + lines; ++k) journal_printf("\t%d\t%d", MED_CODE(idx[k]), qty[k]);
+        jio_append("\n", 1);
+    }
+}
+
+static void journal_reset(void) {
+    if (!journal_fp) return;
+    journal_begin('R');
+    jio_append("\n", 1);
+}
+
+/* Fin de una operacion: lo que agrego va al archivo (ver journal_io_mode).
+   La replica ve cada cambio cuando llega al archivo. */
+static void journal_commit(void) {
+    if (!journal_fp) return;
+#ifdef JOURNAL_URING
+    if (journal_io_mode == JIO_URING) {
+        jio_reap(0);
+        if (jio_chains < JIO_MAX_CHAINS) jio_uring_submit(1);
+        return;
+    }
+#endif
+    jio_flush_sync(journal_io_mode == JIO_FDATASYNC);
+}
+
+/* Con io_uring, lo que quedo esperando en la arena (habia JIO_MAX_CHAINS
+   cadenas en vuelo) sale apenas termina una. wait = se puede esperar (el
+   usuario esta por escribir, o al salir). */
+static void journal_poll(int wait) {
+#ifdef JOURNAL_URING
+    if (!journal_fp || journal_io_mode != JIO_URING) return;
+    jio_reap(0);
+    while (wait && jio_sub < jio_tail && jio_chains >= JIO_MAX_CHAINS) jio_reap(1);
+    if (jio_sub < jio_tail && jio_chains < JIO_MAX_CHAINS) jio_uring_submit(1);
+#else
+    (void)wait;
+#endif
+}
+
+/* Todo lo agregado queda en el archivo y en disco (antes de recortarlo o
+   al cerrar) */
+static void journal_drain(void) {
+    if (!journal_fp) return;
+#ifdef JOURNAL_URING
+    if (journal_io_mode == JIO_URING) {
+        jio_reap(0);
+        jio_uring_submit(1);
+        jio_uring_finish();
+        return;
+    }
+#endif
+    jio_flush_sync(1);
+}
+
+/* Offset del archivo donde termina lo agregado hasta ahora */
+static long long journal_offset(void) {
+    return jio_file_base + jio_tail;
+}
+
+/* Abre la bitacora para agregar al final (sin O_APPEND: cada escritura va
+   a su offset, asi un reintento rellena su lugar aunque lo siguiente ya
+   se haya escrito) */
+static int journal_reopen(const char *path) {
+#ifdef _WIN32
+    journal_fp = fopen(path, "ab");
+    if (!journal_fp) return 0;
+    fseek(journal_fp, 0, SEEK_END);
+    jio_file_base = (long long)ftell(journal_fp) - jio_tail;
+#else
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) return 0;
+    jio_file_base = (long long)lseek(fd, 0, SEEK_END) - jio_tail;
+    journal_fp = fdopen(fd, "w");
+    if (!journal_fp) { close(fd); return 0; }
+#endif
+    return 1;
+}
+
+/* Arena y modo de escritura; se llama al abrir la bitacora */
+static int journal_io_init(void) {
+    int wanted = journal_io_mode;
+#ifndef _WIN32
+    jio_arena = mmap(NULL, JIO_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jio_arena == MAP_FAILED) jio_arena = NULL;
+#ifdef MADV_DONTFORK
+    /* el hijo del checkpoint no la usa; asi el fork no toca paginas fijadas */
+    else madvise(jio_arena, JIO_ARENA_SIZE, MADV_DONTFORK);
+#endif
+#else
+    jio_arena = malloc(JIO_ARENA_SIZE);
+#endif
+    if (!jio_arena) return 0;
+    if (wanted == -1 || wanted == JIO_URING) {
+#ifdef JOURNAL_URING
+        if (jio_uring_setup()) { journal_io_mode = JIO_URING; return 1; }
+#endif
+        journal_io_mode = wanted == -1 ? JIO_BUFFERED : JIO_FDATASYNC;
+        if (wanted == JIO_URING) printf("io_uring no disponible; la bitacora usa fdatasync.\n");
+    }
+    return 1;
+}
+
+static void journal_close(void) {
+    if (!journal_fp) return;
+    journal_drain();
+#ifdef JOURNAL_URING
+    jio_uring_close();
+#endif
+    fclose(journal_fp);
+    journal_fp = NULL;
+#ifndef _WIN32
+    munmap(jio_arena, JIO_ARENA_SIZE);
+#else
+    free(jio_arena);
+#endif
+    jio_arena = NULL;
+    jio_head = jio_sub = jio_tail = 0;
+}
+
+/* Separa la linea en campos, uno por tab: dos tabs seguidos son un campo
+   vacio (strtok los juntaria y correria los campos siguientes). Devuelve
+   cuantos campos hay, o max + 1 si hay mas de max. */
+static int journal_split(char *line, char **f, int max) {
+    line[strcspn(line, "\n")] = '\0';
+    for (int n = 0; n < max; ++n) {
+        f[n] = line;
+        char *t = strchr(line, '\t');
+        if (!t) return n + 1;
+        *t = '\0';
+        line = t + 1;
+    }
+    return max + 1;
+}
+
+/* Remito que se esta leyendo de la bitacora: los renglones de sus
+   registros I se juntan aca y se aplican todos cuando llega el ultimo. Si
+   la bitacora se corto a mitad del remito (o le sigue otro registro), el
+   remito se descarta: la recuperacion y la replica nunca lo ven a medias. */
+static int *jrecv_code, *jrecv_qty;
+static int jrecv_cap = 0, jrecv_n = 0, jrecv_total = 0, jrecv_branch = 0;
+static int jrecv_records = 0;      /* registros I juntados del remito en curso */
+
+/* Descarta el remito en curso; devuelve cuantos registros I tenia */
+static int journal_receive_drop(void) {
+    int dropped = jrecv_records;
+    jrecv_n = jrecv_total = jrecv_records = 0;
+    return dropped;
+}
+
+/* a = sucursal total desde n {codigo cant}xn. 0 si el registro es invalido. */
+static int journal_apply_receive(char **a, int n) {
+    int b = atoi(a[0]), total = atoi(a[1]), from = atoi(a[2]), lines = atoi(a[3]);
+    if (b < 0 || b >= MAX_BRANCHES || lines < 1 || lines > RECEIVE_PER_RECORD || n != 4 + 2 * lines ||
+        from < 0 || total - lines < from) { journal_receive_drop(); return 0; }
+    if (from == 0) journal_receive_drop();   /* empieza otro remito */
+    else if (from != jrecv_n || total != jrecv_total || b != jrecv_branch) { journal_receive_drop(); return 0; }
+    if (from + lines > jrecv_cap) {
+        int ncap = jrecv_cap ? jrecv_cap : 1024;
+        while (ncap < from + lines) ncap *= 2;
+        int *nc = realloc(jrecv_code, sizeof(int) * (size_t)ncap);
+        if (nc) jrecv_code = nc;
+        int *nq = realloc(jrecv_qty, sizeof(int) * (size_t)ncap);
+        if (nq) jrecv_qty = nq;
+        if (!nc || !nq) { journal_receive_drop(); return 0; }
+        jrecv_cap = ncap;
+    }
+    for (int k = 0; k < lines; ++k) {
+        jrecv_code[from + k] = atoi(a[4 + 2 * k]);
+        jrecv_qty[from + k] = atoi(a[5 + 2 * k]);
+    }
+    jrecv_n = from + lines;
+    jrecv_total = total;
+    jrecv_branch = b;
+    jrecv_records++;
+    if (jrecv_n < total) return 1;
+    for (int k = 0; k < total; ++k) {
+        int idx = find_med_index_by_code(jrecv_code[k]);
+        if (idx != -1) branch_receive(b, idx, jrecv_qty[k]);
+    }
+    journal_receive_drop();
+    return 1;
+}
+
+/* Aplica una linea de la bitacora. Devuelve el LSN o 0 si es invalida.
+   *out_ts recibe el momento en que el primario la escribio. */
+static long long journal_apply_line(char *line, long long *out_ts) {
+    char *f[3 + 6 + 4 * MAX_SALES_PER_RECORD];
+    int nf = journal_split(line, f, (int)(sizeof(f) / sizeof(f[0])));
+    if (nf < 3) return 0;
+    long long lsn = atoll(f[0]);
+    long long rec_ts = atoll(f[1]);
+    if (out_ts) *out_ts = rec_ts;
+    char *type = f[2];
+    if (lsn <= 0 || type[0] == '\0' || type[1] != '\0') return 0;
+    if (type[0] != 'I') journal_receive_drop();   /* remito cortado */
+
+    char **a = f + 3;
+    int n = nf - 3;
+
+    if ((type[0] == 'A' || type[0] == 'E') && n == 6) {
+        int code = atoi(a[0]);
+        int idx = find_med_index_by_code(code);
+        if (type[0] == 'A' && idx == -1 && med_count < MAX_MEDICINES)
+            med_insert(code, a[1], strlen(a[1]), atof(a[2]), atoi(a[3]), atoi(a[4]), atoi(a[5]), rec_ts);
+        else if (type[0] == 'E' && idx != -1)
+            med_update(idx, a[1], atof(a[2]), atoi(a[3]), atoi(a[4]), atoi(a[5]), rec_ts);
+        else return 0;
+    } else if (type[0] == 'D' && n == 1) {
+        int idx = find_med_index_by_code(atoi(a[0]));
+        if (idx == -1) return 0;
+        med_delete_at(idx);
+    } else if (type[0] == 'V' && n == 6) {
+        if (sale_count >= MAX_SALES) return 0;
+        int code = atoi(a[2]);
+        sale_append(find_med_index_by_code(code), atoll(a[0]), atoi(a[1]), code, atoi(a[3]), atof(a[4]), a[5]);
+    } else if (type[0] == 'C' && n >= 3) {
+        int day = atoi(a[0]), lines = atoi(a[2]);
+        if (lines < 1 || lines > MAX_SALES_PER_RECORD || n != 3 + 4 * lines || sale_count + lines > MAX_SALES) return 0;
+        for (int k = 0; k < lines; ++k) {
+            char **l = a + 3 + 4 * k;
+            int code = atoi(l[1]);
+            int idx = find_med_index_by_code(code);
+            sale_append(idx, atoll(l[0]), day, code, atoi(l[2]), atof(l[3]),
+                        (idx != -1 && MED_OTC(idx)) ? "-" : a[1]);
+        }
+    } else if (type[0] == 'S' && n == 3) {
+        int b = atoi(a[0]), idx = find_med_index_by_code(atoi(a[1]));
+        if (b < 1 || b >= MAX_BRANCHES || idx == -1) return 0;
+        branch_stock_set(b, idx, atoi(a[2]));
+    } else if (type[0] == 'U' && n == 7) {
+        int b = atoi(a[0]);
+        if (b < 1 || b >= MAX_BRANCHES || BRANCH_SALES(b - 1) >= BRANCH_MAX_SALES) return 0;
+        if (!branch_sales_reserve(b - 1, BRANCH_SALES(b - 1) + 1)) return 0;
+        int code = atoi(a[3]);
+        branch_sale_append(b, find_med_index_by_code(code), atoll(a[1]), atoi(a[2]), code, atoi(a[4]), atof(a[5]), a[6]);
+    } else if (type[0] == 'I' && n >= 4) {
+        if (!journal_apply_receive(a, n)) return 0;
+    } else if (type[0] == 'R' && n == 0) {
+        sales_reset();
+    } else return 0;
+    return lsn;
+}
+
+/* ------------- PUNTOS DE CONTROL (CHECKPOINT) ------------- */
+/* Para que arrancar no dependa del largo de la bitacora, cada tanto se
+   escribe una imagen compacta del estado en <bitacora>.ckpt y se recorta
+   de la bitacora todo lo que la imagen ya incluye. La imagen la escribe un
+   proceso hijo (fork): el hijo ve una copia congelada de la memoria
+   (copia al escribir del sistema operativo) y el padre sigue vendiendo.
+   Se dispara cuando volver a aplicar lo pendiente superaria la mitad del
+   limite de recuperacion (--recuperacion-ms, 200 ms por defecto). */
+/* El ultimo caracter es la version. Se siguen leyendo las anteriores:
+   2 (sin sucursales) y 3 (sin demanda estimada). */
+#define CKPT_MAGIC "FARMCKP4"
+
+static char journal_path[MAX_INPUT] = "";
+static long long journal_replay_ns = 2000;     /* costo estimado por registro (se mide al arrancar) */
+static long long recovery_bound_ms = 200;
+static long long ckpt_image_ns = 0;            /* lo que tarda cargar la ultima imagen */
+#ifndef _WIN32
+static pid_t ckpt_pid = -1;
+#endif
+static long long ckpt_lsn_pending = 0;         /* LSN de la imagen en curso */
+static long long ckpt_offset_pending = 0;      /* byte de la bitacora donde termina esa imagen */
+
+/* Modos de ckpt_transfer. Leer es en dos pasadas: CKPT_CHECK recorre la
+   imagen entera y valida cantidades y largos sin tocar el estado (solo
+   reserva lugar, que no cambia nada visible); recien si todo esta bien
+   CKPT_LOAD la vuelve a leer sobre los arrays. Una imagen corta o danada
+   nunca deja el estado a medio cargar. */
+#define CKPT_LOAD 0
+#define CKPT_WRITE 1
+#define CKPT_CHECK 2
+
+/* Datos de las filas: en CKPT_CHECK solo se comprueba que esten */
+static int ckpt_io(FILE *fp, void *p, size_t size, int mode) {
+    if (size == 0) return 1;
+    if (mode == CKPT_WRITE) return fwrite(p, size, 1, fp) == 1;
+    if (mode == CKPT_LOAD) return fread(p, size, 1, fp) == 1;
+    char skip[4096];
+    while (size > 0) {
+        size_t k = size < sizeof(skip) ? size : sizeof(skip);
+        if (fread(skip, k, 1, fp) != 1) return 0;
+        size -= k;
+    }
+    return 1;
+}
+
+/* Cantidades y encabezados (siempre a una variable local): se leen
+   tambien en CKPT_CHECK, para validarlos */
+static int ckpt_field(FILE *fp, void *p, size_t size, int mode) {
+    return ckpt_io(fp, p, size, mode == CKPT_CHECK ? CKPT_LOAD : mode);
+}
+
+/* Una columna de n filas: de una vez si es contigua (SoA), si no fila por
+   fila; el archivo queda igual con cualquier FARM_LAYOUT */
+#if FARM_LAYOUT == FARM_LAYOUT_SOA
+#define CKPT_COLUMN(ACC, n) (ok = ok && ckpt_io(fp, &ACC(0), sizeof(ACC(0)) * (size_t)(n), mode))
+#else
+#define CKPT_COLUMN(ACC, n) \
+    if (mode == CKPT_CHECK) ok = ok && ckpt_io(fp, NULL, sizeof(ACC(0)) * (size_t)(n), mode); \
+    else for (int ckpt_i = 0; ok && ckpt_i < (n); ++ckpt_i) ok = ckpt_io(fp, &ACC(ckpt_i), sizeof(ACC(ckpt_i)), mode)
+#endif
+
+/* Escribe o lee (ver CKPT_LOAD / CKPT_CHECK) la imagen completa. Solo se
+   guardan las filas usadas de cada array. */
+static int ckpt_transfer(FILE *fp, long long *lsn, int mode) {
+    char magic[8];
+    int ok = 1, writing = mode == CKPT_WRITE, loading = mode == CKPT_LOAD;
+    int mc = med_count, sc = sale_count, smc = sealed_month_count, src = sealed_row_count;
+    long long seq_base = sale_seq_base, last_ts = sale_last_ts;
+    int year = cube_year, month = cube_month, clock = dem_clock;
+    memcpy(magic, CKPT_MAGIC, 8);
+    ok = ok && ckpt_field(fp, magic, 8, mode);
+    int version = (ok && memcmp(magic, CKPT_MAGIC, 7) == 0) ? magic[7] - '0' : 0;
+    ok = ok && version >= 2 && version <= CKPT_MAGIC[7] - '0';
+    ok = ok && ckpt_field(fp, lsn, sizeof(*lsn), mode);
+    ok = ok && ckpt_field(fp, &mc, sizeof(mc), mode) && ckpt_field(fp, &sc, sizeof(sc), mode);
+    ok = ok && ckpt_field(fp, &smc, sizeof(smc), mode) && ckpt_field(fp, &src, sizeof(src), mode);
+    if (!ok || mc < 0 || mc > MAX_MEDICINES || sc < 0 || sc > MAX_SALES ||
+        smc < 0 || smc > MAX_SEALED_MONTHS || src < 0 || src > MAX_SEALED_ROWS) return 0;
+    ok = ok && ckpt_field(fp, &seq_base, sizeof(seq_base), mode);
+    ok = ok && ckpt_field(fp, &last_ts, sizeof(last_ts), mode);
+    ok = ok && ckpt_field(fp, &year, sizeof(year), mode);
+    ok = ok && ckpt_field(fp, &month, sizeof(month), mode);
+    if (mode == CKPT_CHECK) ok = ok && cube_reserve(mc) && branch_stock_reserve(mc) && ord_reserve(mc) && snap_reserve(mc);
+    CKPT_COLUMN(MED_CODE, mc);
+    CKPT_COLUMN(MED_NAME, mc);
+    CKPT_COLUMN(MED_PRICE, mc);
+    CKPT_COLUMN(MED_STOCK, mc);
+    CKPT_COLUMN(MED_OTC, mc);
+    CKPT_COLUMN(MED_CRIT, mc);
+    ok = ok && ckpt_io(fp, med_cube_units, sizeof(med_cube_units[0]) * mc, mode);
+    ok = ok && ckpt_io(fp, med_cube_amount, sizeof(med_cube_amount[0]) * mc, mode);
+    CKPT_COLUMN(SALE_TS, sc);
+    CKPT_COLUMN(SALE_DAY, sc);
+    CKPT_COLUMN(SALE_CODE, sc);
+    CKPT_COLUMN(SALE_QTY, sc);
+    CKPT_COLUMN(SALE_AMOUNT, sc);
+    CKPT_COLUMN(SALE_DNI, sc);
+    ok = ok && ckpt_io(fp, sealed_year, sizeof(sealed_year[0]) * smc, mode);
+    ok = ok && ckpt_io(fp, sealed_month, sizeof(sealed_month[0]) * smc, mode);
+    ok = ok && ckpt_io(fp, sealed_first, sizeof(sealed_first[0]) * smc, mode);
+    ok = ok && ckpt_io(fp, sealed_rows_in, sizeof(sealed_rows_in[0]) * smc, mode);
+    ok = ok && ckpt_io(fp, sealed_code, sizeof(sealed_code[0]) * src, mode);
+    ok = ok && ckpt_io(fp, sealed_units, sizeof(sealed_units[0]) * src, mode);
+    ok = ok && ckpt_io(fp, sealed_amount, sizeof(sealed_amount[0]) * src, mode);
+    /* historial de precios: cantidad de productos y luego codigo, largo y versiones */
+    int nph = ph_count;
+    ok = ok && ckpt_field(fp, &nph, sizeof(nph), mode) && nph >= 0 && nph <= MAX_PRICE_PRODUCTS;
+    if (mode == CKPT_CHECK) ok = ok && price_hist_reserve(nph);
+    if (ok && loading) price_hist_clear();
+    for (int p = 0; ok && p < nph; ++p) {
+        int code = writing ? ph_code[p] : 0, len = writing ? ph_len[p] : 0;
+        ok = ckpt_field(fp, &code, sizeof(code), mode) && ckpt_field(fp, &len, sizeof(len), mode) && len >= 0;
+        for (int v = 0; ok && v < len; ++v) {
+            long long ts = writing ? price_hist_ts(p, v) : 0;
+            double price = writing ? price_hist_price(p, v) : 0.0;
+            ok = ckpt_field(fp, &ts, sizeof(ts), mode) && ckpt_field(fp, &price, sizeof(price), mode);
+            if (ok && loading) ok = price_hist_add(code, ts, price);
+        }
+    }
+    /* sucursales: cantidad en uso y, por cada particion, stock y ventas */
+    int bc = version < 3 ? 1 : branch_count;
+    if (version >= 3) ok = ok && ckpt_field(fp, &bc, sizeof(bc), mode) && bc >= 1 && bc <= MAX_BRANCHES;
+    for (int p = 0; ok && p < BRANCH_PARTS; ++p) {
+        int bs = BRANCH_SALES(p);
+        if (p >= bc - 1) {
+            if (loading) { BRANCH_SALES(p) = 0; if (mc > 0) memset(branch_stock[p], 0, sizeof(branch_stock[p][0]) * (size_t)mc); }
+            continue;
+        }
+        ok = ckpt_field(fp, &bs, sizeof(bs), mode) && bs >= 0 && bs <= BRANCH_MAX_SALES;
+        if (mode == CKPT_CHECK) ok = ok && branch_sales_reserve(p, bs);
+        ok = ok && ckpt_io(fp, branch_stock[p], sizeof(branch_stock[p][0]) * (size_t)mc, mode);
+        ok = ok && ckpt_io(fp, branch_sale_ts[p], sizeof(branch_sale_ts[p][0]) * (size_t)bs, mode);
+        ok = ok && ckpt_io(fp, branch_sale_day[p], sizeof(branch_sale_day[p][0]) * (size_t)bs, mode);
+        ok = ok && ckpt_io(fp, branch_sale_code[p], sizeof(branch_sale_code[p][0]) * (size_t)bs, mode);
+        ok = ok && ckpt_io(fp, branch_sale_qty[p], sizeof(branch_sale_qty[p][0]) * (size_t)bs, mode);
+        ok = ok && ckpt_io(fp, branch_sale_amount[p], sizeof(branch_sale_amount[p][0]) * (size_t)bs, mode);
+        ok = ok && ckpt_io(fp, branch_sale_dni[p], sizeof(branch_sale_dni[p][0]) * (size_t)bs, mode);
+        if (ok && loading) BRANCH_SALES(p) = bs;
+    }
+    /* demanda estimada por producto */
+    if (version >= 4) {
+        ok = ok && ckpt_field(fp, &clock, sizeof(clock), mode);
+        ok = ok && ckpt_io(fp, dem_rate, sizeof(dem_rate[0]) * (size_t)mc, mode);
+        ok = ok && ckpt_io(fp, dem_var, sizeof(dem_var[0]) * (size_t)mc, mode);
+        ok = ok && ckpt_io(fp, dem_last_day, sizeof(dem_last_day[0]) * (size_t)mc, mode);
+        ok = ok && ckpt_io(fp, dem_pending, sizeof(dem_pending[0]) * (size_t)mc, mode);
+        ok = ok && ckpt_io(fp, dem_days, sizeof(dem_days[0]) * (size_t)mc, mode);
+    } else if (ok && loading) {
+        clock = 0;
+        for (int i = 0; i < mc; ++i) demand_clear_row(i);
+    }
+    if (ok && loading) {
+        branch_count = bc;
+        med_count = mc;
+        sale_count = sc;
+        sealed_month_count = smc;
+        sealed_row_count = src;
+        sale_seq_base = seq_base;
+        sale_last_ts = last_ts;
+        cube_year = year;
+        cube_month = month;
+        dem_clock = clock;
+        med_index_rebuild();
+        med_by_code_ok = 0;
+        ord_rebuild();
+        snap_clear();
+    }
+    return ok;
+}
+
+static void ckpt_path_of(char *out, size_t n, const char *jpath) {
+    snprintf(out, n, "%s.ckpt", jpath);
+}
+
+/* Carga la imagen de la bitacora jpath si existe. Devuelve su LSN (0 = no hay). */
+static long long checkpoint_load(const char *jpath) {
+    journal_receive_drop();   /* la imagen nunca corta un remito */
+    char path[MAX_INPUT + 8];
+    ckpt_path_of(path, sizeof(path), jpath);
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+    long long t0 = now_ns();
+    long long lsn = 0;
+    int ok = ckpt_transfer(fp, &lsn, CKPT_CHECK);
+    if (ok) {
+        rewind(fp);
+        ok = ckpt_transfer(fp, &lsn, CKPT_LOAD);
+        /* la imagen ya se valido: solo falla si falta memoria para el
+           historial de precios, y entonces no queda nada a medias */
+        if (!ok) state_clear();
+    }
+    fclose(fp);
+    if (!ok) {
+        printf("Imagen %s danada; se ignora.\n", path);
+        return 0;
+    }
+    ckpt_image_ns = now_ns() - t0;
+    return lsn;
+}
+
+/* Escribe la imagen en un temporal, la baja a disco y la renombra */
+static int checkpoint_write(long long lsn) {
+    char path[MAX_INPUT + 8], tmp[MAX_INPUT + 16];
+    ckpt_path_of(path, sizeof(path), journal_path);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    int ok = ckpt_transfer(fp, &lsn, CKPT_WRITE);
+    ok = (fflush(fp) == 0) && ok;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(fp)) == 0;
+#endif
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) { remove(tmp); return 0; }
+    return 1;
+}
+
+/* Deja en la bitacora solo lo escrito despues del byte offset */
+static void journal_truncate_prefix(long long offset) {
+    char tmp[MAX_INPUT + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", journal_path);
+    journal_drain();
+    FILE *in = fopen(journal_path, "rb");
+    FILE *out = fopen(tmp, "wb");
+#ifdef _WIN32
+    int seek_failed = in && _fseeki64(in, offset, SEEK_SET) != 0;
+#else
+    int seek_failed = in && fseeko(in, (off_t)offset, SEEK_SET) != 0;
+#endif
+    if (!in || !out || seek_failed) {
+        if (in) fclose(in);
+        if (out) { fclose(out); remove(tmp); }
+        return;
+    }
+    char buf[65536];
+    size_t n;
+    int ok = 1;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) ok = ok && fwrite(buf, 1, n, out) == n;
+    fclose(in);
+    if (fclose(out) != 0 || !ok || rename(tmp, journal_path) != 0) { remove(tmp); return; }
+    fclose(journal_fp);
+    if (!journal_reopen(journal_path)) {
+        journal_fp = NULL;
+        printf("Advertencia: no se pudo reabrir la bitacora; los cambios siguientes no se guardan.\n");
+    }
+}
+
+/* Lanza una imagen en segundo plano si lo pendiente ya no entra en el limite */
+static void checkpoint_maybe_start(void) {
+    if (!journal_fp) return;
+#ifndef _WIN32
+    if (ckpt_pid != -1) return;
+#endif
+    long long replay_ns = journal_since_ckpt * journal_replay_ns + ckpt_image_ns;
+    if (replay_ns * 2 < recovery_bound_ms * 1000000LL) return;
+
+    ckpt_lsn_pending = journal_lsn;
+    ckpt_offset_pending = journal_offset();
+#ifdef _WIN32
+    /* sin fork: se escribe en el momento */
+    if (checkpoint_write(ckpt_lsn_pending)) {
+        journal_truncate_prefix(ckpt_offset_pending);
+        journal_since_ckpt = 0;
+    }
+#else
+    pid_t pid = fork();
+    if (pid == 0) _exit(checkpoint_write(ckpt_lsn_pending) ? 0 : 1);
+    if (pid > 0) { ckpt_pid = pid; journal_since_ckpt = 0; }
+#endif
+}
+
+/* Si termino la imagen en curso, recortar la bitacora */
+static void checkpoint_reap(void) {
+#ifndef _WIN32
+    if (ckpt_pid == -1) return;
+    int status;
+    if (waitpid(ckpt_pid, &status, WNOHANG) != ckpt_pid) return;
+    ckpt_pid = -1;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) journal_truncate_prefix(ckpt_offset_pending);
+    else printf("Advertencia: no se pudo escribir la imagen de recuperacion.\n");
+#endif
+}
+
+/* Abre la bitacora del primario: carga la ultima imagen, aplica lo que la
+   bitacora tiene despues de ella (recuperacion) y queda abierta para agregar. */
+static int journal_open(const char *path) {
+    char line[JOURNAL_MAX_LINE];
+    long applied = 0, bad = 0;
+    long long t0 = now_ns();
+    strncpy(journal_path, path, sizeof(journal_path) - 1); journal_path[sizeof(journal_path) - 1] = '\0';
+    journal_lsn = checkpoint_load(path);
+    long long t1 = now_ns();
+    FILE *in = fopen(path, "r");
+    if (in) {
+        ord_defer();
+        while (fgets(line, sizeof(line), in)) {
+            size_t len = strlen(line);
+            if (len == 0 || line[len-1] != '\n') { bad++; break; }   /* ultima linea cortada */
+            if (atoll(line) <= journal_lsn) continue;                 /* ya esta en la imagen */
+            long long lsn = journal_apply_line(line, NULL);
+            if (lsn) { journal_lsn = lsn; applied++; } else bad++;
+        }
+        fclose(in);
+        int torn = journal_receive_drop();   /* remito cortado al final: no se aplica */
+        applied -= torn;
+        bad += torn;
+        ord_resume();
+    }
+    if (applied > 0) journal_replay_ns = (now_ns() - t1) / applied + 1;
+    journal_since_ckpt = applied;
+    journal_durable_lsn = journal_lsn;
+    if (!journal_io_init() || !journal_reopen(path)) return 0;
+    if (journal_lsn > 0)
+        printf("Bitacora %s: estado recuperado hasta LSN %lld en %.1f ms (%ld cambios de bitacora, %ld lineas ignoradas).\n",
+               path, journal_lsn, (now_ns() - t0) / 1e6, applied, bad);
+    return 1;
+}
+
+/* ------------- STREAM DE VENTAS (FIFO / ARCHIVO) ------------- */
+/* Cada venta confirmada se publica como una linea NDJSON o CSV con su
+   numero de secuencia. No se guarda una cola aparte: los registros
+   pendientes se regeneran desde los arrays sale_* a partir de
+   feed_next_seq, asi el buffer queda acotado a FEED_CHUNK bytes y un
+   consumidor lento nunca frena la venta (el descriptor es no bloqueante).
+   Se escribe cuando hay FEED_BATCH ventas pendientes o en el menu (ocioso). */
+#define FEED_BATCH 64
+#define FEED_CHUNK 65536
+
+static char feed_path[MAX_INPUT] = "";
+static int feed_fd = -1;
+static int feed_csv = 0;                /* 0 = NDJSON, 1 = CSV */
+static long long feed_next_seq = 1;     /* proxima secuencia a enviar */
+static char feed_chunk[FEED_CHUNK];     /* lote formateado en curso */
+static size_t feed_chunk_len = 0;
+static size_t feed_chunk_off = 0;       /* bytes del lote ya escritos */
+static long long feed_chunk_first_seq = 1;
+static long long feed_lost = 0;         /* ventas borradas por reinicio antes de enviarse */
+
+/* El DNI es texto libre: en NDJSON se escapan comillas, barras y
+   caracteres de control; en CSV va entre comillas (duplicandolas) si trae
+   coma, comillas o saltos de linea. out tiene lugar para 6 bytes por
+   caracter mas las comillas. */
+static void feed_format_dni(char *out, const char *dni) {
+    size_t n = 0;
+    if (!feed_csv) {
+        for (const unsigned char *c = (const unsigned char *)dni; *c; ++c) {
+            if (*c == '"' || *c == '\\') { out[n++] = '\\'; out[n++] = (char)*c; }
+            else if (*c < 0x20) n += (size_t)sprintf(out + n, "\\u%04x", *c);
+            else out[n++] = (char)*c;
+        }
+    } else if (strpbrk(dni, ",\"\r\n")) {
+        out[n++] = '"';
+        for (const char *c = dni; *c; ++c) {
+            if (*c == '"') out[n++] = '"';
+            out[n++] = *c;
+        }
+        out[n++] = '"';
+    } else {
+        strcpy(out, dni);
+        return;
+    }
+    out[n] = '\0';
+}
+
+/* Formatea la venta i en out (n bytes). Devuelve lo que ocupa la linea
+   completa: si es >= n, no entro y out quedo cortado. */
+static int feed_format_sale(char *out, size_t n, int i) {
+    long long seq = sale_seq_base + i + 1;
+    char dni[DNI_LEN * 6 + 3];
+    feed_format_dni(dni, SALE_DNI(i));
+    if (feed_csv)
+        return snprintf(out, n, "%lld,%lld,%d,%d,%d,%.2f,%s\n",
+                        seq, SALE_TS(i), SALE_DAY(i), SALE_CODE(i), SALE_QTY(i), SALE_AMOUNT(i), dni);
+    return snprintf(out, n, "{\"seq\":%lld,\"ts\":%lld,\"dia\":%d,\"codigo\":%d,\"cant\":%d,\"importe\":%.2f,\"dni\":\"%s\"}\n",
+                    seq, SALE_TS(i), SALE_DAY(i), SALE_CODE(i), SALE_QTY(i), SALE_AMOUNT(i), dni);
+}
+
+/* Cierra el destino. Las lineas del lote que no se escribieron completas
+   se regeneran al reconectar, enteras. Si una quedo escrita a medias: en
+   un archivo comun (que es solo del stream) se corta el archivo hasta el
+   ultimo salto de linea, asi la linea aparece una sola vez; en un FIFO el
+   lector que la recibio cortada (sin '\n') ya no esta, y el proximo la
+   recibe entera. Si no se puede cortar, la linea queda repetida y el
+   consumidor la reconoce por la secuencia. */
+static void feed_close(void) {
+    long long sent = 0;
+    size_t whole = 0;   /* bytes del lote hasta el ultimo '\n' escrito */
+    for (size_t k = 0; k < feed_chunk_off; ++k) if (feed_chunk[k] == '\n') { sent++; whole = k + 1; }
+#ifndef _WIN32
+    if (feed_fd >= 0) {
+        off_t torn = (off_t)(feed_chunk_off - whole);
+        struct stat st;
+        if (torn > 0 && fstat(feed_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= torn &&
+            ftruncate(feed_fd, st.st_size - torn) != 0)
+            printf("Advertencia: una linea del stream puede quedar repetida en '%s'.\n", feed_path);
+        close(feed_fd);
+    }
+#endif
+    feed_fd = -1;
+    if (feed_chunk_len > 0) feed_next_seq = feed_chunk_first_seq + sent;
+    feed_chunk_len = feed_chunk_off = 0;
+}
+
+/* Abre (o reabre) el destino. Un FIFO sin lector devuelve ENXIO: en ese
+   caso se reintenta en el proximo envio. */
+static int feed_open(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    if (feed_fd >= 0) return 1;
+    if (feed_path[0] == '\0') return 0;
+    feed_fd = open(feed_path, O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK, 0644);
+    return feed_fd >= 0;
+#endif
+}
+
+/* Envia ventas pendientes. force = 0 solo escribe si hay un lote completo. */
+static void feed_flush(int force) {
+#ifndef _WIN32
+    if (feed_path[0] == '\0') return;
+    long long last_seq = sale_seq_base + sale_count;
+    if (feed_next_seq <= sale_seq_base) {            /* ventas ya borradas */
+        feed_lost += sale_seq_base + 1 - feed_next_seq;
+        feed_next_seq = sale_seq_base + 1;
+    }
+    if (!force && feed_chunk_len == 0 && last_seq - feed_next_seq + 1 < FEED_BATCH) return;
+    if (!feed_open()) return;
+
+    while (1) {
+        if (feed_chunk_off == feed_chunk_len) {
+            /* armar el proximo lote desde los arrays */
+            feed_chunk_len = feed_chunk_off = 0;
+            feed_chunk_first_seq = feed_next_seq;
+            while (feed_next_seq <= last_seq) {
+                int i = (int)(feed_next_seq - sale_seq_base - 1);
+                size_t room = FEED_CHUNK - feed_chunk_len;
+                int len = feed_format_sale(feed_chunk + feed_chunk_len, room, i);
+                if (len < 0) { feed_next_seq++; continue; }   /* no se pudo formatear: se saltea */
+                if ((size_t)len >= room) break;               /* no entra entera: va en el proximo lote */
+                feed_chunk_len += (size_t)len;
+                feed_next_seq++;
+            }
+            if (feed_chunk_len == 0) return;
+        }
+        ssize_t w = write(feed_fd, feed_chunk + feed_chunk_off, feed_chunk_len - feed_chunk_off);
+        if (w > 0) { feed_chunk_off += (size_t)w; continue; }
+        if (w < 0 && errno == EAGAIN) return;        /* consumidor lento: seguir luego */
+        feed_close();   /* lector desconectado (EPIPE) u otro error: reconectar luego */
+        return;
+    }
+#else
+    (void)force;
+#endif
+}
+
+/* Configurar el stream: destino, formato y secuencia desde la cual reanudar */
+static void configure_sales_feed(void) {
+#ifdef _WIN32
+    printf("Stream de ventas no disponible en Windows.\n");
+#else
+    printf("Stream actual: %s | formato %s | proxima secuencia %lld | ultima venta %lld\n",
+           feed_path[0] ? feed_path : "(desactivado)", feed_csv ? "CSV" : "NDJSON",
+           feed_next_seq, sale_seq_base + sale_count);
+    if (feed_lost > 0) printf("Advertencia: %lld ventas se borraron antes de enviarse.\n", feed_lost);
+
+    char buf[MAX_INPUT];
+    printf("Ruta del FIFO o archivo ('-' desactiva, vaciar mantiene): ");
+    read_line(buf, sizeof(buf)); trim(buf);
+    if (strcmp(buf, "-") == 0) {
+        feed_flush(1);
+        feed_close();
+        feed_path[0] = '\0';
+        printf("Stream desactivado.\n");
+        return;
+    }
+    if (buf[0] != '\0') {
+        feed_close();
+        strncpy(feed_path, buf, sizeof(feed_path) - 1); feed_path[sizeof(feed_path) - 1] = '\0';
+    }
+    if (feed_path[0] == '\0') { printf("Stream desactivado.\n"); return; }
+
+    printf("Formato (n = NDJSON, c = CSV) [ENTER mantener]: ");
+    read_line(buf, sizeof(buf)); trim(buf);
+    if (tolower((unsigned char)buf[0]) == 'c' || tolower((unsigned char)buf[0]) == 'n') {
+        feed_close();
+        feed_csv = tolower((unsigned char)buf[0]) == 'c';
+    }
+
+    int last;
+    if (prompt_int("Reanudar despues de la secuencia (ultima recibida por el consumidor) [ENTER mantener]: ", &last)) {
+        long long from = (long long)last + 1;
+        if (from <= sale_seq_base) {
+            printf("Las ventas anteriores a %lld ya fueron borradas; se reanuda desde %lld.\n",
+                   sale_seq_base + 1, sale_seq_base + 1);
+            from = sale_seq_base + 1;
+        }
+        if (from > sale_seq_base + sale_count + 1) from = sale_seq_base + sale_count + 1;
+        feed_close();
+        feed_next_seq = from;
+    }
+
+    if (!feed_open()) printf("Destino no disponible aun (FIFO sin lector?). Se reintentara.\n");
+    feed_flush(1);
+    printf("Stream activo en %s desde secuencia %lld.\n", feed_path, feed_next_seq);
+#endif
+}
+
+/* ------------- MOTOR: API SIN PANTALLA NI TECLADO ------------- */
+/* Las operaciones del negocio reciben argumentos y devuelven FARM_OK (o un
+   valor >= 0) o un FARM_ERR_*; no leen del teclado ni imprimen. El menu,
+   el modo lote y la replica son clientes de estas funciones.
+   Para usar el motor desde otro programa (benchmark, servidor, pruebas):
+     #define FARMACIA_SIN_MENU
+     #include "Final_TpIA_Yuri_Arancibia.c"
+   Asi las farm_* y cart_* quedan con enlace externo y main pasa a llamarse
+   farmacia_menu_main. El estado son los arrays de este archivo (sin structs),
+   por eso hay un solo motor por proceso y no hace falta pasar un contexto. */
+#ifdef FARMACIA_SIN_MENU
+#define FARM_API
+#else
+#define FARM_API static
+#endif
+
+#define FARM_OK 0
+#define FARM_ERR_FULL -1          /* carrito lleno */
+#define FARM_ERR_CODE -2          /* codigo inexistente */
+#define FARM_ERR_QTY -3           /* cantidad <= 0 */
+#define FARM_ERR_STOCK -4         /* stock insuficiente */
+#define FARM_ERR_DAY -5           /* dia fuera de 1..31 */
+#define FARM_ERR_SALES_FULL -6    /* no entran todas las ventas del mes */
+#define FARM_ERR_EMPTY -7         /* carrito vacio */
+#define FARM_ERR_CATALOG_FULL -8
+#define FARM_ERR_DUPLICATE -9     /* codigo ya existente */
+#define FARM_ERR_NAME -10         /* nombre vacio */
+#define FARM_ERR_PRICE -11        /* precio negativo */
+#define FARM_ERR_STOCK_VALUE -12  /* stock negativo */
+#define FARM_ERR_CRITICAL -13     /* stock critico negativo */
+#define FARM_ERR_SNAPSHOT -14     /* la instantanea del cursor ya se solto */
+#define FARM_ERR_AUTH -15         /* contrasena incorrecta */
+#define FARM_ERR_PASSWORD -16     /* contrasena nueva vacia */
+#define FARM_ERR_NO_SUMMARY -17   /* ventas borradas, pero sin lugar para el resumen */
+#define FARM_ERR_IO -18
+#define FARM_ERR_FREEZE -19       /* no se pudo construir el hash perfecto */
+#define FARM_ERR_ORDER -20        /* orden desconocido */
+#define FARM_ERR_CURSOR -21       /* cursor mal formado */
+#define FARM_ERR_SALE -22         /* venta inexistente (o ya borrada) */
+#define FARM_ERR_SESSION -23      /* sesion del dueno vencida o invalida */
+#define FARM_ERR_JOURNAL_MODE -24 /* modo de escritura de bitacora desconocido */
+#define FARM_ERR_BRANCH -25       /* sucursal fuera de 0..MAX_BRANCHES-1 */
+#define FARM_ERR_MEMORY -26       /* sin memoria (ordenar, indices) */
+
+FARM_API const char *farm_error_text(int err) {
+    switch (err) {
+        case FARM_ERR_FULL: return "Carrito lleno.";
+        case FARM_ERR_CODE: return "Codigo no existe.";
+        case FARM_ERR_QTY: return "Cantidad invalida.";
+        case FARM_ERR_STOCK: return "Stock insuficiente.";
+        case FARM_ERR_DAY: return "Dia invalido.";
+        case FARM_ERR_SALES_FULL: return "Limite de ventas alcanzado este mes.";
+        case FARM_ERR_EMPTY: return "Carrito vacio.";
+        case FARM_ERR_CATALOG_FULL: return "Limite de catalogo alcanzado.";
+        case FARM_ERR_DUPLICATE: return "Codigo ya existente.";
+        case FARM_ERR_NAME: return "Nombre vacio.";
+        case FARM_ERR_PRICE: return "Precio invalido.";
+        case FARM_ERR_STOCK_VALUE: return "Stock invalido.";
+        case FARM_ERR_CRITICAL: return "Stock critico invalido.";
+        case FARM_ERR_SNAPSHOT: return "El listado ya no esta disponible; vuelva a empezarlo.";
+        case FARM_ERR_AUTH: return "Contrasena incorrecta.";
+        case FARM_ERR_PASSWORD: return "Contrasena vacia.";
+        case FARM_ERR_NO_SUMMARY: return "Sin lugar para guardar el resumen del mes.";
+        case FARM_ERR_IO: return "Error de archivo.";
+        case FARM_ERR_FREEZE: return "No se pudo congelar el catalogo.";
+        case FARM_ERR_ORDER: return "Orden invalido.";
+        case FARM_ERR_CURSOR: return "Cursor invalido.";
+        case FARM_ERR_SALE: return "Venta inexistente (mes reiniciado?).";
+        case FARM_ERR_SESSION: return "Sesion del dueno vencida.";
+        case FARM_ERR_JOURNAL_MODE: return "Modo de bitacora invalido (sin_sync, fdatasync, uring).";
+        case FARM_ERR_BRANCH: return "Sucursal invalida.";
+        case FARM_ERR_MEMORY: return "Sin memoria para la operacion.";
+        default: return "OK";
+    }
+}
+
+/* Abre (o recupera) la bitacora; NULL = solo memoria */
+FARM_API int farm_open(const char *journal_path) {
+    if (journal_path && !journal_open(journal_path)) return FARM_ERR_IO;
+    return FARM_OK;
+}
+
+/* Como se escribe la bitacora: "sin_sync", "fdatasync" o "uring" (ver
+   journal_io_mode). Se elige antes de farm_open. */
+FARM_API int farm_journal_mode(const char *mode) {
+    for (int m = 0; m < 3; ++m)
+        if (strcmp(mode, jio_mode_names[m]) == 0) { journal_io_mode = m; return FARM_OK; }
+    return FARM_ERR_JOURNAL_MODE;
+}
+
+/* Baja a disco lo pendiente de la bitacora y la cierra */
+FARM_API void farm_close(void) {
+    journal_close();
+}
+
+/* Alta. Devuelve el indice en el catalogo o un FARM_ERR_*. */
+FARM_API int farm_med_add(int code, const char *name, double price, int stock, int is_otc, int crit) {
+    long long m0 = metric_start();
+    int idx;
+    if (med_count >= MAX_MEDICINES) idx = FARM_ERR_CATALOG_FULL;
+    else if (find_med_index_by_code(code) != -1) idx = FARM_ERR_DUPLICATE;
+    else if (!name || name[0] == '\0') idx = FARM_ERR_NAME;
+    else if (price < 0) idx = FARM_ERR_PRICE;
+    else if (stock < 0) idx = FARM_ERR_STOCK_VALUE;
+    else if (crit < 0) idx = FARM_ERR_CRITICAL;
+    else if ((idx = med_insert(code, name, strlen(name), price, stock, is_otc ? 1 : 0, crit, sale_timestamp_now())) < 0)
+        idx = FARM_ERR_MEMORY;
+    else {
+        journal_med('A', idx);
+        journal_commit();
+    }
+    metric_end(OP_ADD, m0);
+    return idx;
+}
+
+/* Edicion: name NULL o "" y valores negativos mantienen el dato actual */
+FARM_API int farm_med_edit(int code, const char *name, double price, int stock, int is_otc, int crit) {
+    long long m0 = metric_start();
+    int err = FARM_OK, idx = find_med_index_by_code(code);
+    if (idx == -1) err = FARM_ERR_CODE;
+    else {
+        char keep_name[MAX_NAME_LEN];
+        strcpy(keep_name, MED_NAME(idx));
+        med_update(idx, (name && name[0]) ? name : keep_name,
+                   price >= 0 ? price : MED_PRICE(idx),
+                   stock >= 0 ? stock : MED_STOCK(idx),
+                   is_otc >= 0 ? (is_otc ? 1 : 0) : MED_OTC(idx),
+                   crit >= 0 ? crit : MED_CRIT(idx),
+                   sale_timestamp_now());
+        journal_med('E', idx);
+        journal_commit();
+    }
+    metric_end(OP_EDIT, m0);
+    return err;
+}
+
+FARM_API int farm_med_delete(int code) {
+    long long m0 = metric_start();
+    int err = FARM_OK, idx = find_med_index_by_code(code);
+    if (idx == -1) err = FARM_ERR_CODE;
+    else {
+        med_delete_at(idx);
+        journal_delete(code);
+        journal_commit();
+    }
+    metric_end(OP_DELETE, m0);
+    return err;
+}
+
+/* Datos actuales de un producto; cualquier salida puede ser NULL */
+FARM_API int farm_med_get(int code, char *name, size_t name_size, double *price, int *stock, int *is_otc, int *crit) {
+    int idx = find_med_index_by_code(code);
+    if (idx == -1) return FARM_ERR_CODE;
+    if (name && name_size) { strncpy(name, MED_NAME(idx), name_size - 1); name[name_size - 1] = '\0'; }
+    if (price) *price = MED_PRICE(idx);
+    if (stock) *stock = MED_STOCK(idx);
+    if (is_otc) *is_otc = MED_OTC(idx);
+    if (crit) *crit = MED_CRIT(idx);
+    return FARM_OK;
+}
+
+/* Venta de un producto. dni se registra solo si es RX (NULL o "" = '-'). */
+FARM_API int farm_sell(int code, int qty, int day, const char *dni, double *out_total) {
+    long long m0 = metric_start();
+    TRACE_BEGIN(t_sell);
+    int err = FARM_OK, idx = -1;
+    double total = 0.0;
+    TRACE_BEGIN(t_lookup);
+    if (sale_count >= MAX_SALES) err = FARM_ERR_SALES_FULL;
+    else if ((idx = find_med_index_by_code(code)) == -1) err = FARM_ERR_CODE;
+    TRACE_END(t_lookup, "buscar");
+    if (err == FARM_OK) {
+        TRACE_BEGIN(t_valid_qty);
+        if (qty <= 0) err = FARM_ERR_QTY;
+        else if (qty > MED_STOCK(idx)) err = FARM_ERR_STOCK;
+        TRACE_END(t_valid_qty, "validar_cantidad");
+    }
+    if (err == FARM_OK) {
+        TRACE_BEGIN(t_valid_day);
+        if (day < 1 || day > DAYS_IN_MONTH) err = FARM_ERR_DAY;
+        TRACE_END(t_valid_day, "validar_dia");
+    }
+    if (err == FARM_OK) {
+        total = qty * MED_PRICE(idx);
+        TRACE_BEGIN(t_dni);
+        if (MED_OTC(idx) || !dni || dni[0] == '\0') dni = "-";
+        TRACE_END(t_dni, "dni_rx");
+        TRACE_BEGIN(t_append);
+        int i = sale_record(sale_timestamp_now(), day, code, qty, total, dni);
+        TRACE_END(t_append, "agregar_venta");
+        TRACE_BEGIN(t_stock);
+        sale_take_stock(idx, day, qty, total);
+        TRACE_END(t_stock, "actualizar_stock");
+        TRACE_BEGIN(t_journal);
+        journal_sale(i);
+        journal_commit();
+        TRACE_END(t_journal, "bitacora");
+        TRACE_BEGIN(t_feed);
+        feed_flush(0);
+        TRACE_END(t_feed, "stream");
+    }
+    /* las rechazadas tambien cuentan en las metricas y cierran su tramo */
+    metric_end(OP_SELL, m0);
+    TRACE_END(t_sell, err == FARM_OK ? "vender" : "vender_rechazada");
+    if (err == FARM_OK && out_total) *out_total = total;
+    return err;
+}
+
+/* Total del mes, cantidad de ventas y ventas por dia (per_day puede ser NULL) */
+FARM_API int farm_month_summary(double *out_total, int *out_count, int per_day[DAYS_IN_MONTH + 1]) {
+    long long m0 = metric_start();
+    int n = sale_count;
+    double total = 0.0;
+    if (per_day) for (int d = 0; d <= DAYS_IN_MONTH; ++d) per_day[d] = 0;
+    for (int i = 0; i < n; ++i) {
+        int d = SALE_DAY(i);
+        if (per_day && d >= 1 && d <= DAYS_IN_MONTH) per_day[d] += 1;
+        total += SALE_AMOUNT(i);
+    }
+    if (out_total) *out_total = total;
+    if (out_count) *out_count = n;
+    metric_end(OP_REPORT_MONTHLY, m0);
+    return FARM_OK;
+}
+
+FARM_API int farm_day_summary(int day, double *out_total, int *out_count) {
+    long long m0 = metric_start();
+    int err = FARM_OK;
+    if (day < 1 || day > DAYS_IN_MONTH) err = FARM_ERR_DAY;
+    else {
+        double total = 0.0;
+        int count = 0;
+        for (int i = 0; i < sale_count; ++i) if (SALE_DAY(i) == day) { total += SALE_AMOUNT(i); count++; }
+        if (out_total) *out_total = total;
+        if (out_count) *out_count = count;
+    }
+    metric_end(OP_REPORT_DAY, m0);
+    return err;
+}
+
+/* Codigos en o por debajo del stock critico, del mas urgente (menor
+   cobertura) al menos: guarda hasta max en codes y devuelve cuantos hay en
+   total. Stock <= critico implica cobertura <= 1, asi que alcanza con ese
+   rango del indice (con critico 0 la cobertura es el stock: stock 1 entra
+   al rango pero no es critico, de ahi el filtro). */
+FARM_API int farm_stock_critical(int *codes, int max) {
+    long long m0 = metric_start();
+    int found = 0, i;
+    ord_scan_begin(ORD_COVER, 0, -HUGE_VAL, 1.0);
+    while ((i = ord_scan_next()) != -1) {
+        if (MED_STOCK(i) <= MED_CRIT(i)) {
+            if (found < max) codes[found] = MED_CODE(i);
+            found++;
+        }
+    }
+    metric_end(OP_REPORT_CRITICAL, m0);
+    return found;
+}
+
+/* Demanda estimada de la fila idx al ultimo dia con ventas y reposicion
+   sugerida para este local (revision cada DEMAND_REVIEW_DAYS dias, el
+   pedido tarda DEMAND_LEAD_DAYS):
+     punto de pedido = L * demanda + z * desvio * raiz(L)
+     pedir           = (L + R) * demanda + z * desvio * raiz(L + R) - stock
+   cover = dias que alcanza el stock (HUGE_VAL si no hay demanda). */
+static void demand_suggest(int idx, double *rate, double *sd, double *cover, int *reorder_point, int *order_qty) {
+    double var;
+    demand_estimate(idx, dem_clock, rate, &var);
+    *sd = demand_sqrt(var);
+    int stock = MED_STOCK(idx);
+    *cover = *rate > 0.0 ? stock / *rate : HUGE_VAL;
+    double rop = DEMAND_LEAD_DAYS * *rate + DEMAND_Z * *sd * demand_sqrt(DEMAND_LEAD_DAYS);
+    double upto = (DEMAND_LEAD_DAYS + DEMAND_REVIEW_DAYS) * *rate + DEMAND_Z * *sd * demand_sqrt(DEMAND_LEAD_DAYS + DEMAND_REVIEW_DAYS);
+    *reorder_point = demand_units_up(rop);
+    *order_qty = demand_units_up(upto - stock);
+}
+
+/* Demanda diaria estimada (media y desvio) y reposicion sugerida de un
+   producto; cualquier salida puede ser NULL */
+FARM_API int farm_demand(int code, double *rate, double *stddev, double *cover_days, int *reorder_point, int *order_qty) {
+    int idx = find_med_index_by_code(code);
+    if (idx == -1) return FARM_ERR_CODE;
+    double r, sd, cover;
+    int rop, qty;
+    demand_suggest(idx, &r, &sd, &cover, &rop, &qty);
+    if (rate) *rate = r;
+    if (stddev) *stddev = sd;
+    if (cover_days) *cover_days = cover;
+    if (reorder_point) *reorder_point = rop;
+    if (order_qty) *order_qty = qty;
+    return FARM_OK;
+}
+
+FARM_API int farm_reset_month(void) {
+    feed_flush(1);   /* ultimo intento de publicar antes de borrar */
+    int sealed = sales_reset();
+    journal_reset();
+    journal_commit();
+    return sealed ? FARM_OK : FARM_ERR_NO_SUMMARY;
+}
+
+/* Sucursales (ver DATOS: particiones por sucursal). branch 0 = este local,
+   igual que las farm_* de arriba; FARM_ALL_BRANCHES en los informes =
+   consolidado de todas las sucursales en uso. */
+#define FARM_ALL_BRANCHES -1
+
+FARM_API int farm_branch_count(void) {
+    return branch_count;
+}
+
+FARM_API int farm_branch_get_stock(int branch, int code, int *out_stock) {
+    if (branch < 0 || branch >= MAX_BRANCHES) return FARM_ERR_BRANCH;
+    int idx = find_med_index_by_code(code);
+    if (idx == -1) return FARM_ERR_CODE;
+    if (out_stock) *out_stock = branch_stock_of(branch, idx);
+    return FARM_OK;
+}
+
+#ifdef FARMACIA_SIN_MENU
+/* Stock de un producto del maestro en una sucursal (inventario, cargas de
+   prueba). El menu y el modo lote suman mercaderia con farm_receive. */
+FARM_API int farm_branch_set_stock(int branch, int code, int stock) {
+    if (branch < 0 || branch >= MAX_BRANCHES) return FARM_ERR_BRANCH;
+    if (stock < 0) return FARM_ERR_STOCK_VALUE;
+    if (branch == 0) return farm_med_edit(code, NULL, -1, stock, -1, -1);
+    int idx = find_med_index_by_code(code);
+    if (idx == -1) return FARM_ERR_CODE;
+    branch_stock_set(branch, idx, stock);
+    journal_branch_stock(branch, idx);
+    journal_commit();
+    return FARM_OK;
+}
+#endif
+
+/* Venta en una sucursal: descuenta de su stock y se agrega a sus ventas.
+   Precio y tipo (RX / venta libre) salen del maestro. */
+FARM_API int farm_branch_sell(int branch, int code, int qty, int day, const char *dni, double *out_total) {
+    if (branch == 0) return farm_sell(code, qty, day, dni, out_total);
+    long long m0 = metric_start();
+    int err = FARM_OK, p = branch - 1, idx = -1;
+    double total = 0.0;
+    if (branch < 0 || branch >= MAX_BRANCHES) err = FARM_ERR_BRANCH;
+    else if (BRANCH_SALES(p) >= BRANCH_MAX_SALES) err = FARM_ERR_SALES_FULL;
+    else if ((idx = find_med_index_by_code(code)) == -1) err = FARM_ERR_CODE;
+    else if (qty <= 0) err = FARM_ERR_QTY;
+    else if (qty > branch_stock[p][idx]) err = FARM_ERR_STOCK;
+    else if (day < 1 || day > DAYS_IN_MONTH) err = FARM_ERR_DAY;
+    /* el lugar se pide recien con la venta ya validada: una rechazada no
+       hace crecer la particion */
+    else if (!branch_sales_reserve(p, BRANCH_SALES(p) + 1)) err = FARM_ERR_MEMORY;
+    if (err == FARM_OK) {
+        total = qty * MED_PRICE(idx);
+        if (MED_OTC(idx) || !dni || dni[0] == '\0') dni = "-";
+        int i = branch_sale_append(branch, idx, sale_timestamp_now(), day, code, qty, total, dni);
+        journal_branch_sale(branch, i);
+        journal_commit();
+    }
+    metric_end(OP_SELL_BRANCH, m0);
+    if (err == FARM_OK && out_total) *out_total = total;
+    return err;
+}
+
+/* Copia de trabajo de los renglones de farm_receive: crece al doble y se
+   reusa entre remitos */
+static int *recv_work_code, *recv_work_qty;
+static int recv_work_cap = 0;
+
+static int recv_work_reserve(int rows) {
+    if (rows <= recv_work_cap) return 1;
+    int ncap = recv_work_cap ? recv_work_cap : 1024;
+    while (ncap < rows) ncap *= 2;
+    int *nc = realloc(recv_work_code, sizeof(int) * (size_t)ncap);
+    if (nc) recv_work_code = nc;
+    int *nq = realloc(recv_work_qty, sizeof(int) * (size_t)ncap);
+    if (nq) recv_work_qty = nq;
+    if (!nc || !nq) return 0;
+    recv_work_cap = ncap;
+    return 1;
+}
+
+/* Recepcion de mercaderia (remito): suma qtys[k] al stock de codes[k] en
+   la sucursal. Los renglones se copian, se ordenan por codigo (sumando los
+   repetidos) y se cruzan con el catalogo en orden de codigo (merge join
+   con galope, ver med_by_code_seek), sin buscar cada codigo en el hash.
+   codes y qtys no se modifican. Los codigos que no estan en el catalogo se
+   saltean; se guardan hasta max_unknown en unknown (puede ser NULL) y
+   *out_unknown recibe cuantos hubo. Devuelve los productos actualizados o
+   un FARM_ERR_*, y entonces no se aplico nada. */
+FARM_API int farm_receive(int branch, const int *codes, const int *qtys, int n, int *unknown, int max_unknown, int *out_unknown) {
+    long long m0 = metric_start();
+    int err = FARM_OK, found = 0, missing = 0;
+    int *wc = NULL, *wq = NULL;
+    if (branch < 0 || branch >= MAX_BRANCHES) err = FARM_ERR_BRANCH;
+    for (int k = 0; err == FARM_OK && k < n; ++k) if (qtys[k] <= 0) err = FARM_ERR_QTY;
+    if (err == FARM_OK && n > 0) {
+        if (!recv_work_reserve(n)) err = FARM_ERR_MEMORY;
+        else {
+            wc = recv_work_code;
+            wq = recv_work_qty;
+            memcpy(wc, codes, sizeof(int) * (size_t)n);
+            memcpy(wq, qtys, sizeof(int) * (size_t)n);
+        }
+    }
+    if (err == FARM_OK && n > 0 && (!code_radix_sort(wc, wq, n) || !med_by_code_build())) err = FARM_ERR_MEMORY;
+
+    /* Cruce: los productos encontrados se van dejando al principio de la
+       copia, wc (fila) y wq (total recibido); nunca pasan a los renglones
+       que falta leer porque cada uno consume al menos un renglon. */
+    for (int i = 0, j = 0; err == FARM_OK && i < n; ) {
+        int code = wc[i];
+        long long total = 0;
+        for (; i < n && wc[i] == code; ++i) total += wq[i];
+        j = med_by_code_seek(j, med_count, code);
+        if (j == med_count || med_by_code_key[j] != code) {
+            if (unknown && missing < max_unknown) unknown[missing] = code;
+            missing++;
+            continue;
+        }
+        int idx = med_by_code_idx[j];
+        if (total + branch_stock_of(branch, idx) > 2147483647LL) { err = FARM_ERR_STOCK_VALUE; break; }
+        wc[found] = idx;
+        wq[found++] = (int)total;
+    }
+    if (err == FARM_OK) {
+        for (int k = 0; k < found; ++k) branch_receive(branch, wc[k], wq[k]);
+        journal_receive(branch, wc, wq, found);
+        journal_commit();
+        if (out_unknown) *out_unknown = missing;
+    }
+    metric_end(OP_RECEIVE, m0);
+    return err == FARM_OK ? found : err;
+}
+
+/* Pasada para los informes: una sucursal o todas (en paralelo) */
+static int branch_report_scan(int branch, int with_critical) {
+    int from = branch == FARM_ALL_BRANCHES ? 0 : branch, to = branch == FARM_ALL_BRANCHES ? branch_count : branch + 1;
+    for (int b = from; with_critical && b >= 0 && b < to && b < MAX_BRANCHES; ++b)
+        if (!bagg_crit_reserve(b)) return FARM_ERR_MEMORY;
+    if (branch == FARM_ALL_BRANCHES) branch_aggregate(with_critical);
+    else if (branch >= 0 && branch < MAX_BRANCHES) { bagg_want_crit = with_critical; branch_scan(branch); }
+    else return FARM_ERR_BRANCH;
+    return FARM_OK;
+}
+
+/* Como farm_month_summary, de una sucursal o consolidado */
+FARM_API int farm_branch_month_summary(int branch, double *out_total, int *out_count, int per_day[DAYS_IN_MONTH + 1]) {
+    long long m0 = metric_start();
+    int err = branch_report_scan(branch, 0);
+    if (err == FARM_OK) {
+        int from = branch == FARM_ALL_BRANCHES ? 0 : branch, to = branch == FARM_ALL_BRANCHES ? branch_count : branch + 1;
+        double total = 0.0;
+        int count = 0;
+        if (per_day) for (int d = 0; d <= DAYS_IN_MONTH; ++d) per_day[d] = 0;
+        for (int b = from; b < to; ++b) {
+            for (int d = 0; d <= DAYS_IN_MONTH; ++d) {
+                total += bagg_amount[b][d];
+                count += bagg_count[b][d];
+                if (per_day && d > 0) per_day[d] += bagg_count[b][d];
+            }
+        }
+        if (out_total) *out_total = total;
+        if (out_count) *out_count = count;
+    }
+    metric_end(OP_REPORT_CONSOLIDATED, m0);
+    return err;
+}
+
+FARM_API int farm_branch_day_summary(int branch, int day, double *out_total, int *out_count) {
+    long long m0 = metric_start();
+    int err = day < 1 || day > DAYS_IN_MONTH ? FARM_ERR_DAY : branch_report_scan(branch, 0);
+    if (err == FARM_OK) {
+        int from = branch == FARM_ALL_BRANCHES ? 0 : branch, to = branch == FARM_ALL_BRANCHES ? branch_count : branch + 1;
+        double total = 0.0;
+        int count = 0;
+        for (int b = from; b < to; ++b) { total += bagg_amount[b][day]; count += bagg_count[b][day]; }
+        if (out_total) *out_total = total;
+        if (out_count) *out_count = count;
+    }
+    metric_end(OP_REPORT_CONSOLIDATED, m0);
+    return err;
+}
+
+/* Productos en o por debajo del critico en cada sucursal: guarda hasta max
+   pares (branches[k], codes[k]) ordenados por sucursal y devuelve cuantos
+   hay en total. branches puede ser NULL. */
+FARM_API int farm_branch_stock_critical(int branch, int *branches, int *codes, int max) {
+    long long m0 = metric_start();
+    int err = branch_report_scan(branch, 1), found = 0;
+    if (err == FARM_OK) {
+        int from = branch == FARM_ALL_BRANCHES ? 0 : branch, to = branch == FARM_ALL_BRANCHES ? branch_count : branch + 1;
+        for (int b = from; b < to; ++b) {
+            for (int k = 0; k < bagg_crit_count[b]; ++k, ++found) {
+                if (found >= max) continue;
+                if (branches) branches[found] = b;
+                codes[found] = MED_CODE(bagg_crit_idx[b][k]);
+            }
+        }
+    }
+    metric_end(OP_REPORT_CONSOLIDATED, m0);
+    return err == FARM_OK ? found : err;
+}
+
+/* Congela el catalogo: las busquedas por codigo usan el hash perfecto hasta
+   la proxima alta o baja. build_ns (puede ser NULL) = tiempo de armado. */
+FARM_API int farm_catalog_freeze(long long *build_ns) {
+    long long t0 = now_ns();
+    int err = !mph_reserve(med_count) ? FARM_ERR_MEMORY : mph_build() ? FARM_OK : FARM_ERR_FREEZE;
+    if (build_ns) *build_ns = now_ns() - t0;
+    return err;
+}
+
+/* Cursores de paginacion. El cursor es texto opaco para el cliente: guarda
+   la consulta, su instantanea y la ultima fila entregada, y cada pagina
+   retoma desde ahi con una busqueda (binaria en el indice ordenado o por
+   numero de alta). La pagina N cuesta O(log n + tamano de pagina), mas las
+   filas que cambiaron desde que se creo el cursor, y no se reserva memoria
+   segun el tamano del resultado. Cursor "" = no hay mas.
+   Todas las paginas de un cursor ven una sola version: la de cuando se
+   creo (ver INSTANTANEAS DE LOS CURSORES). Las filas de la pagina salen de
+   esa version, no de farm_med_get. Un cursor que no se recorre hasta el
+   final se suelta con farm_cursor_close; si no, lo suelta el desalojo. */
+#define FARM_CURSOR_LEN (128 + 2 * MAX_NAME_LEN)
+#define LIST_PAGE_ROWS 20       /* filas por pagina en el menu */
+#define BATCH_PAGE_MAX 1000     /* tope de filas por pagina en modo lote */
+
+/* Medicamentos por key (ORD_CATALOG u ORD_*; desc = de mayor a menor, no
+   vale para ORD_CATALOG) con la clave entre lo y hi inclusive (solo claves
+   numericas) */
+FARM_API int farm_med_cursor(char cursor[FARM_CURSOR_LEN], int key, int desc, double lo, double hi) {
+    if (key < ORD_CATALOG || key >= ORD_KEYS) return FARM_ERR_ORDER;
+    int s = snap_pin();
+    snprintf(cursor, FARM_CURSOR_LEN, "M%d:%d:%a:%a:%d:%lld:0:0:-",
+             key + 1, desc && key != ORD_CATALOG ? 1 : 0, lo, hi, s, snap_epoch[s]);
+    return FARM_OK;
+}
+
+/* Hasta page_size filas desde el cursor, que queda apuntando a la pagina
+   siguiente. codes es obligatorio; names, prices, stocks, is_otc y crit
+   pueden ser NULL. Devuelve cuantas guardo o un FARM_ERR_*. */
+FARM_API int farm_med_page(char cursor[FARM_CURSOR_LEN], int *codes, char (*names)[MAX_NAME_LEN],
+                           double *prices, int *stocks, int *is_otc, int *crit, int page_size) {
+    int key, desc, slot;
+    long long epoch, last_seq;
+    char lo_s[40], hi_s[40], key_s[40], name_hex[2 * MAX_NAME_LEN + 1];
+    if (cursor[0] == '\0') return 0;
+    if (page_size <= 0 ||
+        sscanf(cursor, "M%d:%d:%39[^:]:%39[^:]:%d:%lld:%lld:%39[^:]:%128s",
+               &key, &desc, lo_s, hi_s, &slot, &epoch, &last_seq, key_s, name_hex) != 9 ||
+        key < 0 || key > ORD_KEYS) return FARM_ERR_CURSOR;
+    if (!snap_valid(slot, epoch)) return FARM_ERR_SNAPSHOT;
+    key--;
+    long long m0 = metric_start();
+    double lo = strtod(lo_s, NULL), hi = strtod(hi_s, NULL), last_key = strtod(key_s, NULL);
+    char last_name[MAX_NAME_LEN] = "";
+    if (key == ORD_NAME && strcmp(name_hex, "-") != 0) {
+        size_t len = strlen(name_hex) / 2;
+        if (len >= MAX_NAME_LEN) len = MAX_NAME_LEN - 1;
+        for (size_t b = 0; b < len; ++b) {
+            unsigned v = 0;
+            sscanf(name_hex + 2 * b, "%2x", &v);
+            last_name[b] = (char)v;
+        }
+        last_name[len] = '\0';
+    }
+    int n = 0, last = -1, more = 0;
+    if (!snap_walk_begin(epoch, key, key != ORD_CATALOG && desc, lo, hi, last_seq > 0, last_key, last_name, last_seq))
+        n = FARM_ERR_MEMORY;
+    else {
+        int r;
+        while (n < page_size && (r = snap_walk_next()) != -1) {
+            last = r;
+            codes[n] = snap_ref_code(r);
+            snap_ref_get(r, names ? names[n] : NULL, prices ? &prices[n] : NULL, stocks ? &stocks[n] : NULL,
+                         is_otc ? &is_otc[n] : NULL, crit ? &crit[n] : NULL);
+            n++;
+        }
+        more = n == page_size && snap_walk_next() != -1;
+    }
+    if (n >= 0 && (!more || n == 0)) {
+        cursor[0] = '\0';
+        snap_release(slot);
+    } else if (n > 0) {
+        char hex[2 * MAX_NAME_LEN + 1] = "-";
+        if (key == ORD_NAME)
+            for (int b = 0; snap_ref_name(last)[b]; ++b) snprintf(hex + 2 * b, 3, "%02x", (unsigned char)snap_ref_name(last)[b]);
+        snprintf(cursor, FARM_CURSOR_LEN, "M%d:%d:%a:%a:%d:%lld:%lld:%a:%s",
+                 key + 1, desc ? 1 : 0, lo, hi, slot, epoch, snap_ref_seq(last),
+                 key == ORD_CATALOG ? 0.0 : snap_ref_value(key, last), hex);
+    }
+    metric_end(OP_LIST, m0);
+    return n;
+}
+
+/* Ventas del mes, filtradas por dia y codigo (0 = sin filtro) y/o solo
+   las de productos bajo receta. Las ventas se identifican por su numero
+   de secuencia (el mismo del stream), que no cambia al reiniciar el mes.
+   El cursor ve las ventas que habia al crearlo (solo se agregan al final)
+   y, con rx_only, el tipo de cada producto en ese momento. */
+FARM_API void farm_sales_cursor(char cursor[FARM_CURSOR_LEN], int day, int code, int rx_only) {
+    int s = rx_only ? snap_pin() : -1;
+    snprintf(cursor, FARM_CURSOR_LEN, "V%d:%d:%d:%lld:%lld:%d:%lld", rx_only ? 1 : 0, day, code,
+             sale_seq_base + 1, sale_seq_base + sale_count, s, s >= 0 ? snap_epoch[s] : 0LL);
+}
+
+/* La venta i es de un producto bajo receta en la instantanea e */
+static int sale_is_rx(long long e, int i) {
+    int code = SALE_CODE(i), idx = find_med_index_by_code(code);
+    if (idx != -1 && med_row_epoch[idx] < e) return !MED_OTC(idx);
+    int v = snap_find_version(e, code);
+    return v == -1 || !ver_otc[v];   /* producto que no estaba: se asume RX */
+}
+
+/* Hasta page_size secuencias desde el cursor. Con filtro, lo que se saltea
+   hasta la proxima coincidencia ya queda recorrido para la pagina que
+   sigue (el cursor apunta a esa venta). Si el mes se reinicio a mitad del
+   recorrido, esas ventas ya no estan: FARM_ERR_SNAPSHOT. */
+FARM_API int farm_sales_page(char cursor[FARM_CURSOR_LEN], long long *seqs, int page_size) {
+    int rx_only, day, code, slot;
+    long long next_seq, end_seq, epoch;
+    if (cursor[0] == '\0') return 0;
+    if (page_size <= 0 || sscanf(cursor, "V%d:%d:%d:%lld:%lld:%d:%lld", &rx_only, &day, &code,
+                                 &next_seq, &end_seq, &slot, &epoch) != 7)
+        return FARM_ERR_CURSOR;
+    if (rx_only && !snap_valid(slot, epoch)) return FARM_ERR_SNAPSHOT;
+    if (next_seq <= sale_seq_base) {
+        if (rx_only) snap_release(slot);
+        return FARM_ERR_SNAPSHOT;
+    }
+    long long m0 = metric_start();
+    long long i = next_seq - sale_seq_base - 1, end = end_seq - sale_seq_base;
+    int n = 0;
+    for (; i < end; ++i) {
+        if (day && SALE_DAY(i) != day) continue;
+        if (code && SALE_CODE(i) != code) continue;
+        if (rx_only && !sale_is_rx(epoch, (int)i)) continue;
+        if (n == page_size) break;
+        seqs[n++] = sale_seq_base + i + 1;
+    }
+    if (i >= end) {
+        cursor[0] = '\0';
+        if (rx_only) snap_release(slot);
+    } else snprintf(cursor, FARM_CURSOR_LEN, "V%d:%d:%d:%lld:%lld:%d:%lld", rx_only, day, code,
+                    sale_seq_base + i + 1, end_seq, slot, epoch);
+    metric_end(rx_only ? OP_REPORT_RX : OP_EXPORT_SALES, m0);
+    return n;
+}
+
+/* Suelta la instantanea de un cursor que no se va a terminar de recorrer
+   (y lo deja en "") */
+FARM_API void farm_cursor_close(char cursor[FARM_CURSOR_LEN]) {
+    int slot = -1;
+    long long from, to, epoch = 0;
+    if (cursor[0] == 'M') sscanf(cursor, "M%*d:%*d:%*[^:]:%*[^:]:%d:%lld", &slot, &epoch);
+    else if (cursor[0] == 'V') sscanf(cursor, "V%*d:%*d:%*d:%lld:%lld:%d:%lld", &from, &to, &slot, &epoch);
+    if (snap_valid(slot, epoch)) snap_release(slot);
+    cursor[0] = '\0';
+}
+
+/* Datos de la venta seq; cualquier salida puede ser NULL */
+FARM_API int farm_sale_get(long long seq, int *day, int *code, int *qty, double *amount,
+                           char *dni, size_t dni_size, long long *ts) {
+    long long i = seq - sale_seq_base - 1;
+    if (i < 0 || i >= sale_count) return FARM_ERR_SALE;
+    if (day) *day = SALE_DAY(i);
+    if (code) *code = SALE_CODE(i);
+    if (qty) *qty = SALE_QTY(i);
+    if (amount) *amount = SALE_AMOUNT(i);
+    if (dni && dni_size) { strncpy(dni, SALE_DNI(i), dni_size - 1); dni[dni_size - 1] = '\0'; }
+    if (ts) *ts = SALE_TS(i);
+    return FARM_OK;
+}
+
+/* Verifica la contrasena del dueno (cuesta un PBKDF2 completo) */
+FARM_API int farm_owner_check(const char *password) {
+    return password && password[0] != '\0' && owner_password_matches(password);
+}
+
+/* Sesion del dueno: farm_owner_login verifica la contrasena una vez y
+   entrega un token; mientras el token se use al menos cada
+   OWNER_SESSION_IDLE_MIN minutos, farm_owner_session lo acepta sin volver
+   a pedir la contrasena (comparar el token es barato). Hay una sola sesion:
+   otro login la reemplaza y cambiar la contrasena la cierra. */
+#define OWNER_TOKEN_BYTES 16
+#define FARM_TOKEN_LEN (2 * OWNER_TOKEN_BYTES + 1)   /* hex + '\0' */
+
+static char owner_session_token[FARM_TOKEN_LEN] = "";
+static long long owner_session_last_ns = 0;
+
+/* Reloj de la sesion. Al reproducir una grabacion se usa el tiempo
+   original, asi las sesiones vencen en los mismos puntos que al grabar. */
+static long long owner_session_clock(void) {
+    return replay_fp ? replay_orig_us * 1000 : now_ns();
+}
+
+FARM_API int farm_owner_login(const char *password, char token[FARM_TOKEN_LEN]) {
+    if (!farm_owner_check(password)) return FARM_ERR_AUTH;
+    unsigned char raw[OWNER_TOKEN_BYTES];
+    random_bytes(raw, sizeof(raw));
+    for (int b = 0; b < OWNER_TOKEN_BYTES; ++b) snprintf(owner_session_token + 2 * b, 3, "%02x", raw[b]);
+    owner_session_last_ns = owner_session_clock();
+    memcpy(token, owner_session_token, FARM_TOKEN_LEN);
+    return FARM_OK;
+}
+
+/* FARM_OK si el token es el de la sesion abierta y no vencio; renueva el
+   plazo. Si vencio, la sesion se cierra. */
+FARM_API int farm_owner_session(const char *token) {
+    long long now = owner_session_clock();
+    if (owner_session_token[0] == '\0' || !token || strlen(token) != FARM_TOKEN_LEN - 1 ||
+        !const_time_equal((const unsigned char *)token, (const unsigned char *)owner_session_token, FARM_TOKEN_LEN - 1))
+        return FARM_ERR_SESSION;
+    if (now - owner_session_last_ns > OWNER_SESSION_IDLE_MIN * 60LL * 1000000000LL) {
+        owner_session_token[0] = '\0';
+        return FARM_ERR_SESSION;
+    }
+    owner_session_last_ns = now;
+    return FARM_OK;
+}
+
+FARM_API void farm_owner_logout(void) {
+    memset(owner_session_token, 0, sizeof(owner_session_token));
+}
+
+FARM_API int farm_owner_set_password(const char *current, const char *new_password) {
+    if (!farm_owner_check(current)) return FARM_ERR_AUTH;
+    if (!new_password || new_password[0] == '\0') return FARM_ERR_PASSWORD;
+    owner_password_store(new_password);
+    farm_owner_logout();
+    return FARM_OK;
+}
+
+/* ------------- VENTA MULTIPLE (CARRITO) ------------- */
+/* Un carrito junta varias lineas (codigo, cantidad) de un mismo comprador y
+   se confirma como una sola transaccion: primero se valida todo (codigos,
+   cantidades, stock sumando lineas repetidas del mismo producto, lugar en
+   el registro de ventas) y solo si todo es valido se agregan todas las
+   ventas y se descuenta el stock. Si algo falla no se toca nada.
+   El stream se publica una vez por carrito, despues de agregar todas las
+   lineas, asi un carrito nunca queda partido entre dos escrituras. */
+#define MAX_CART_LINES MAX_SALES_PER_RECORD
+
+static int cart_count = 0;
+static int cart_code[MAX_CART_LINES];
+static int cart_qty[MAX_CART_LINES];
+static int cart_med_idx[MAX_CART_LINES];  /* resuelto al agregar la linea */
+
+FARM_API void cart_clear(void) {
+    cart_count = 0;
+}
+
+/* Agrega una linea; valida codigo, cantidad y stock acumulado del producto */
+FARM_API int cart_add_line(int code, int qty) {
+    if (cart_count >= MAX_CART_LINES) return FARM_ERR_FULL;
+    int idx = find_med_index_by_code(code);
+    if (idx == -1) return FARM_ERR_CODE;
+    if (qty <= 0) return FARM_ERR_QTY;
+    long long wanted = qty;
+    for (int k = 0; k < cart_count; ++k) if (cart_med_idx[k] == idx) wanted += cart_qty[k];
+    if (wanted > MED_STOCK(idx)) return FARM_ERR_STOCK;
+    cart_code[cart_count] = code;
+    cart_qty[cart_count] = qty;
+    cart_med_idx[cart_count] = idx;
+    cart_count++;
+    return FARM_OK;
+}
+
+static int cart_has_rx(void) {
+    for (int k = 0; k < cart_count; ++k) if (!MED_OTC(cart_med_idx[k])) return 1;
+    return 0;
+}
+
+/* Confirma el carrito (todo o nada). dni se registra en las lineas RX;
+   NULL o "" registra '-'. Devuelve FARM_OK o un FARM_ERR_*. */
+FARM_API int cart_commit(int day, const char *dni, double *out_total) {
+    long long m0 = metric_start();
+    int err = FARM_OK;
+    if (cart_count == 0) err = FARM_ERR_EMPTY;
+    else if (day < 1 || day > DAYS_IN_MONTH) err = FARM_ERR_DAY;
+    else if (sale_count + cart_count > MAX_SALES) err = FARM_ERR_SALES_FULL;
+    /* revalidar contra el stock actual (pudo cambiar desde que se armo) */
+    for (int k = 0; err == FARM_OK && k < cart_count; ++k) {
+        int idx = cart_med_idx[k];
+        if (idx >= med_count || MED_CODE(idx) != cart_code[k]) {
+            idx = find_med_index_by_code(cart_code[k]);
+            if (idx == -1) err = FARM_ERR_CODE;
+            else cart_med_idx[k] = idx;
+        }
+    }
+    for (int k = 0; err == FARM_OK && k < cart_count; ++k) {
+        long long wanted = 0;
+        for (int j = 0; j < cart_count; ++j) if (cart_med_idx[j] == cart_med_idx[k]) wanted += cart_qty[j];
+        if (wanted > MED_STOCK(cart_med_idx[k])) err = FARM_ERR_STOCK;
+    }
+
+    if (err == FARM_OK) {
+        if (!dni || dni[0] == '\0') dni = "-";
+        double total = 0.0;
+        int base = sale_count;
+        for (int k = 0; k < cart_count; ++k) {
+            int idx = cart_med_idx[k];
+            int i = sale_append(idx, sale_timestamp_now(), day, MED_CODE(idx), cart_qty[k],
+                                cart_qty[k] * MED_PRICE(idx), MED_OTC(idx) ? "-" : dni);
+            total += SALE_AMOUNT(i);
+        }
+        journal_cart(base, cart_count, day, dni);
+        journal_commit();
+        feed_flush(0);
+        if (out_total) *out_total = total;
+        cart_clear();
+    }
+    metric_end(OP_SELL_CART, m0);
+    return err;
+}
+
+#ifdef FARMACIA_SIN_MENU
+/* Todo el motor como al arrancar el programa, sin salir del proceso (para
+   benchmarks y pruebas que arman varios estados seguidos; el menu no la
+   usa): espera la
+   imagen en curso, cierra la bitacora y el stream (lo pendiente se escribe
+   antes), vacia los datos (state_clear), el carrito y las metricas, y
+   vuelve a la contrasena inicial del dueno sin sesion abierta. */
+FARM_API void farm_reset(void) {
+#ifndef _WIN32
+    if (ckpt_pid != -1) { waitpid(ckpt_pid, NULL, 0); ckpt_pid = -1; }
+#endif
+    journal_close();
+    journal_path[0] = '\0';
+    journal_lsn = journal_durable_lsn = journal_since_ckpt = 0;
+    journal_receive_drop();
+    feed_flush(1);
+    feed_close();
+    feed_path[0] = '\0';
+    feed_next_seq = feed_chunk_first_seq = 1;
+    feed_lost = 0;
+    state_clear();
+    cart_clear();
+    memset(metric_count, 0, sizeof(metric_count));
+    memset(metric_sum_ns, 0, sizeof(metric_sum_ns));
+    memset(metric_max_ns, 0, sizeof(metric_max_ns));
+    memset(metric_hist, 0, sizeof(metric_hist));
+    owner_hash_ready = 0;
+    farm_owner_logout();
+}
+#endif
+
+/* Venta de varios productos con una sola pausa: dia una vez, una linea
+   "codigo cantidad" por producto, DNI una sola vez si hay algun RX. */
+static void sell_cart(void) {
+    int day;
+    if (!prompt_int("Dia de la venta (1-31): ", &day)) return;
+    if (day < 1 || day > DAYS_IN_MONTH) { printf("Dia invalido.\n"); return; }
+
+    cart_clear();
+    char buf[MAX_INPUT];
+    while (1) {
+        printf("Linea %d - codigo cantidad (vaciar para terminar): ", cart_count + 1);
+        read_line(buf, sizeof(buf)); trim(buf);
+        if (buf[0] == '\0') break;
+        int code, qty;
+        char extra;
+        if (sscanf(buf, "%d %d %c", &code, &qty, &extra) != 2) { printf("Formato: codigo cantidad\n"); continue; }
+        int err = cart_add_line(code, qty);
+        if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); if (err == FARM_ERR_FULL) break; continue; }
+        int idx = cart_med_idx[cart_count - 1];
+        printf("  %s x%d = $%.2f\n", MED_NAME(idx), qty, qty * MED_PRICE(idx));
+    }
+    if (cart_count == 0) { printf("Carrito vacio. Cancelado.\n"); return; }
+
+    char dnibuf[32] = "";
+    if (cart_has_rx()) {
+        printf("Ingrese DNI del comprador (vaciar = NO registrar - advertencia legal): ");
+        read_line(dnibuf, sizeof(dnibuf)); trim(dnibuf);
+        if (dnibuf[0] == '\0') printf("Advertencia: venta RX sin registro de DNI.\n");
+    }
+
+    int lines = cart_count;
+    double total;
+    int err = cart_commit(day, dnibuf, &total);
+    if (err != FARM_OK) { printf("Venta cancelada: %s\n", farm_error_text(err)); cart_clear(); return; }
+    printf("Venta registrada: %d productos | $%.2f | Dia %d\n", lines, total, day);
+}
+
+/* Informe mensual: total en pesos y ventas por dia */
+static void report_monthly(void) {
+    if (sale_count == 0) { printf("No hay ventas registradas este mes.\n"); return; }
+    double total_month;
+    int n, sales_per_day[DAYS_IN_MONTH + 1];
+    int err = farm_month_summary(&total_month, &n, sales_per_day);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    printf("===== Informe mensual =====\n");
+    printf("Total importe: $%.2f\n", total_month);
+    printf("Ventas por dia (dia: cantidad):\n");
+    for (int d = 1; d <= DAYS_IN_MONTH; ++d) if (sales_per_day[d] > 0) printf("Dia %2d: %d\n", d, sales_per_day[d]);
+    printf("Operaciones totales en el mes: %d\n", n);
+}
+
+/* Informe de un dia especifico */
+static void report_day(void) {
+    int day;
+    if (!prompt_int("Ingrese dia a consultar (1-31): ", &day)) return;
+    double total_day;
+    int count_day;
+    int err = farm_day_summary(day, &total_day, &count_day);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    printf("Informe dia %d: %d operaciones | Total importe: $%.2f\n", day, count_day, total_day);
+}
+
+/* Mostrar ventas (CSV) por pantalla (no archivo) */
+static void print_sales_csv(void) {
+    long long m0 = metric_start();
+    printf("Dia,CodigoMedicamento,Cantidad,Importe,DNI\n");
+    for (int i = 0; i < sale_count; ++i) {
+        printf("%d,%d,%d,%.2f,%s\n", SALE_DAY(i), SALE_CODE(i), SALE_QTY(i), SALE_AMOUNT(i), SALE_DNI(i));
+    }
+    metric_end(OP_EXPORT_SALES, m0);
+}
+
+/* Ventas por paginas: como CSV o, con rx_only, como la tabla de registros
+   RX. day / code 0 = sin filtro. */
+static void list_sales_paged(int day, int code, int rx_only, int interactive) {
+    char cursor[FARM_CURSOR_LEN];
+    long long seqs[LIST_PAGE_ROWS];
+    int shown = 0, n;
+    farm_sales_cursor(cursor, day, code, rx_only);
+    if (rx_only) {
+        printf("DIA | Codigo | Cant | DNI\n");
+        printf("-------------------------\n");
+    } else printf("Dia,CodigoMedicamento,Cantidad,Importe,DNI\n");
+    while ((n = farm_sales_page(cursor, seqs, LIST_PAGE_ROWS)) > 0) {
+        for (int r = 0; r < n; ++r) {
+            int d, c, qty;
+            double amount;
+            char dni[DNI_LEN];
+            if (farm_sale_get(seqs[r], &d, &c, &qty, &amount, dni, sizeof(dni), NULL) != FARM_OK) continue;
+            if (rx_only) printf("%3d | %6d | %4d | %s\n", d, c, qty, dni);
+            else printf("%d,%d,%d,%.2f,%s\n", d, c, qty, amount, dni);
+        }
+        shown += n;
+        if (cursor[0] == '\0' || (interactive && !prompt_next_page())) break;
+    }
+    if (n < 0) printf("%s\n", farm_error_text(n));
+    farm_cursor_close(cursor);
+    if (rx_only && !shown) printf("No hay registros RX.\n");
+}
+
+/* ------------- FUNCIONES DE MEDICAMENTOS ------------- */
+static void add_medicine(void) {
+    if (med_count >= MAX_MEDICINES) { printf("%s\n", farm_error_text(FARM_ERR_CATALOG_FULL)); return; }
+
+    int code;
+    if (!prompt_int("Ingrese codigo (vaciar para cancelar): ", &code)) return;
+    if (farm_med_get(code, NULL, 0, NULL, NULL, NULL, NULL) == FARM_OK) { printf("Codigo ya existente.\n"); return; }
+
+    char name[MAX_NAME_LEN];
+    printf("Nombre: ");
+    read_line(name, sizeof(name));
+    trim(name);
+    if (name[0] == '\0') { printf("Nombre vacio. Cancelado.\n"); return; }
+
+    double price;
+    if (!prompt_double("Precio (ej: 123.45): ", &price)) return;
+    if (price < 0) { printf("Precio invalido.\n"); return; }
+
+    int stock;
+    if (!prompt_int("Stock inicial: ", &stock)) return;
+    if (stock < 0) { printf("Stock invalido.\n"); return; }
+
+    char otcbuf[MAX_INPUT];
+    int is_otc = -1;
+    while (is_otc == -1) {
+        printf("Venta libre? (s/n): ");
+        read_line(otcbuf, sizeof(otcbuf));
+        trim(otcbuf);
+        if (otcbuf[0] == '\0') { printf("Cancelado.\n"); return; }
+        if (tolower((unsigned char)otcbuf[0]) == 's') is_otc = 1;
+        else if (tolower((unsigned char)otcbuf[0]) == 'n') is_otc = 0;
+        else printf("Respuesta invalida, ingrese s o n.\n");
+    }
+
+    int crit;
+    if (!prompt_int("Stock critico: ", &crit)) return;
+    if (crit < 0) { printf("Stock critico invalido.\n"); return; }
+
+    int idx = farm_med_add(code, name, price, stock, is_otc, crit);
+    if (idx < 0) { printf("%s\n", farm_error_text(idx)); return; }
+    printf("Medicamento agregado (indice %d).\n", idx);
+}
+
+static void list_medicines(void) {
+    if (med_count == 0) { printf("No hay medicamentos registrados.\n"); return; }
+    long long m0 = metric_start();
+    printf("Codigo | Nombre                           | Precio   | Stock | Tipo | Critico\n");
+    printf("-----------------------------------------------------------------------------\n");
+    for (int i = 0; i < med_count; ++i) {
+        printf("%6d | %-32s | %8.2f | %5d | %4s | %7d\n",
+               MED_CODE(i), MED_NAME(i), MED_PRICE(i), MED_STOCK(i), MED_OTC(i) ? "OTC" : "RX", MED_CRIT(i));
+    }
+    metric_end(OP_LIST, m0);
+}
+
+/* Una fila de medicamento como tabla o como CSV */
+static void print_medicine_row(int code, char *name, double price, int stock, int is_otc, int crit, int csv) {
+    if (csv) {
+        for (char *p = name; *p; ++p) if (*p == ',') *p = ' ';
+        printf("%d,%s,%.2f,%d,%d,%d\n", code, name, price, stock, crit, is_otc);
+    } else {
+        printf("%6d | %-32s | %8.2f | %5d | %4s | %7d\n", code, name, price, stock, is_otc ? "OTC" : "RX", crit);
+    }
+}
+
+/* Catalogo por paginas de LIST_PAGE_ROWS (key ORD_CATALOG u ORD_*; para
+   claves numericas solo [lo, hi]). interactive = preguntar entre paginas.
+   Memoria fija: una pagina a la vez. */
+static void list_medicines_paged(int key, int desc, double lo, double hi, int csv, int interactive) {
+    char cursor[FARM_CURSOR_LEN], names[LIST_PAGE_ROWS][MAX_NAME_LEN];
+    int codes[LIST_PAGE_ROWS], stocks[LIST_PAGE_ROWS], otc[LIST_PAGE_ROWS], crit[LIST_PAGE_ROWS], shown = 0, n;
+    double prices[LIST_PAGE_ROWS];
+    if (farm_med_cursor(cursor, key, desc, lo, hi) != FARM_OK) { printf("%s\n", farm_error_text(FARM_ERR_ORDER)); return; }
+    if (csv) printf("Codigo,Nombre,Precio,Stock,StockCritico,VentaLibre\n");
+    else {
+        printf("Codigo | Nombre                           | Precio   | Stock | Tipo | Critico\n");
+        printf("-----------------------------------------------------------------------------\n");
+    }
+    while ((n = farm_med_page(cursor, codes, names, prices, stocks, otc, crit, LIST_PAGE_ROWS)) > 0) {
+        for (int r = 0; r < n; ++r) print_medicine_row(codes[r], names[r], prices[r], stocks[r], otc[r], crit[r], csv);
+        shown += n;
+        if (cursor[0] == '\0' || (interactive && !prompt_next_page())) break;
+    }
+    if (n < 0) printf("%s\n", farm_error_text(n));
+    farm_cursor_close(cursor);
+    if (!csv) printf("(%d medicamentos%s%s%s)\n", shown, key == ORD_CATALOG ? "" : " por ",
+                     key == ORD_CATALOG ? "" : ord_key_names[key], desc ? " descendente" : "");
+}
+
+static void browse_medicines(int csv) {
+    if (med_count == 0 && !csv) { printf("No hay medicamentos registrados.\n"); return; }
+    list_medicines_paged(ORD_CATALOG, 0, -HUGE_VAL, HUGE_VAL, csv, 1);
+}
+
+static void list_medicines_ordered_prompt(void) {
+    int k;
+    if (!prompt_int("Ordenar por 1) nombre 2) precio 3) stock 4) cobertura (stock/critico): ", &k)) return;
+    if (k < 1 || k > ORD_KEYS) { printf("Opcion invalida.\n"); return; }
+    k--;
+    char buf[MAX_INPUT];
+    printf("De mayor a menor? s/n: ");
+    read_line(buf, sizeof(buf)); trim(buf);
+    int desc = buf[0] == 's' || buf[0] == 'S';
+    double lo = -HUGE_VAL, hi = HUGE_VAL;
+    if (k != ORD_NAME) {
+        prompt_double("Desde (vaciar = sin minimo): ", &lo);
+        prompt_double("Hasta (vaciar = sin maximo): ", &hi);
+        if (lo > hi) { printf("Rango invalido.\n"); return; }
+    }
+    list_medicines_paged(k, desc, lo, hi, 0, 1);
+}
+
+static void show_medicine_by_code(void) {
+    int code;
+    if (!prompt_int("Ingrese codigo (vaciar para cancelar): ", &code)) return;
+    char name[MAX_NAME_LEN];
+    double price;
+    int stock, is_otc, crit;
+    if (farm_med_get(code, name, sizeof(name), &price, &stock, &is_otc, &crit) != FARM_OK) { printf("No encontrado.\n"); return; }
+    printf("Codigo: %d\nNombre: %s\nPrecio: %.2f\nStock: %d\nTipo: %s\nCritico: %d\n",
+           code, name, price, stock, is_otc ? "Venta libre (OTC)" : "Bajo receta (RX)", crit);
+    double rate, sd, cover;
+    int rop, qty;
+    if (farm_demand(code, &rate, &sd, &cover, &rop, &qty) == FARM_OK && rate > 0.0)
+        printf("Demanda estimada: %.2f por dia (desvio %.2f) | Cobertura: %.1f dias | Punto de pedido: %d | Pedir: %d\n",
+               rate, sd, cover, rop, qty);
+}
+
+static void edit_medicine(void) {
+    int code;
+    if (!prompt_int("Codigo a editar (vaciar cancelar): ", &code)) return;
+    char name[MAX_NAME_LEN];
+    double cur_price;
+    int cur_stock, cur_otc, cur_crit;
+    if (farm_med_get(code, name, sizeof(name), &cur_price, &cur_stock, &cur_otc, &cur_crit) != FARM_OK) {
+        printf("Medicamento no encontrado.\n");
+        return;
+    }
+
+    /* lo que quede en -1 / vacio se mantiene */
+    char buf[MAX_INPUT];
+    printf("Nombre (actual: %s) [ENTER para mantener]: ", name);
+    read_line(buf, sizeof(buf)); trim(buf);
+
+    double price = -1.0;
+    printf("Precio (actual: %.2f) [ENTER para mantener]: ", cur_price);
+    prompt_double("", &price);
+
+    int stock = -1;
+    printf("Stock (actual: %d) [ENTER para mantener]: ", cur_stock);
+    prompt_int("", &stock);
+
+    char otcbuf[MAX_INPUT];
+    int is_otc = -1;
+    printf("Venta libre? (actual: %s) s/n [ENTER para mantener]: ", cur_otc ? "s" : "n");
+    read_line(otcbuf, sizeof(otcbuf)); trim(otcbuf);
+    if (otcbuf[0] == 's' || otcbuf[0] == 'S') is_otc = 1;
+    else if (otcbuf[0] == 'n' || otcbuf[0] == 'N') is_otc = 0;
+
+    int crit = -1;
+    printf("Stock critico (actual: %d) [ENTER para mantener]: ", cur_crit);
+    prompt_int("", &crit);
+
+    int err = farm_med_edit(code, buf, price, stock, is_otc, crit);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    printf("Medicamento actualizado.\n");
+}
+
+static void delete_medicine(void) {
+    int code;
+    if (!prompt_int("Codigo a eliminar (vaciar cancelar): ", &code)) return;
+    char name[MAX_NAME_LEN];
+    if (farm_med_get(code, name, sizeof(name), NULL, NULL, NULL, NULL) != FARM_OK) { printf("No encontrado.\n"); return; }
+
+    char confirm[MAX_INPUT];
+    printf("Confirma eliminacion de '%s' (s/n): ", name);
+    read_line(confirm, sizeof(confirm));
+    if (tolower((unsigned char)confirm[0]) != 's') { printf("Eliminacion cancelada.\n"); return; }
+
+    int err = farm_med_delete(code);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    printf("Medicamento eliminado.\n");
+}
+
+/* Congela el catalogo y compara la busqueda por codigo del hash perfecto
+   con la del indice mutable (mismos codigos, en orden salteado) */
+static void freeze_catalog(void) {
+    if (med_count == 0) { printf("No hay medicamentos registrados.\n"); return; }
+    long long build_ns;
+    int err = farm_catalog_freeze(&build_ns);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+
+    int n = med_count, rounds = 2000000 / n + 1;
+    int *probe = malloc(sizeof(int) * (size_t)n);
+    if (!probe) { printf("%s\n", farm_error_text(FARM_ERR_MEMORY)); return; }
+    for (int k = 0; k < n; ++k) probe[k] = MED_CODE((int)(((long long)k * 7919) % n));
+    long long found = 0, t0 = now_ns();
+    for (int r = 0; r < rounds; ++r) for (int k = 0; k < n; ++k) found += med_index_find(probe[k]);
+    long long mutable_ns = now_ns() - t0;
+    t0 = now_ns();
+    for (int r = 0; r < rounds; ++r) for (int k = 0; k < n; ++k) found -= mph_find(probe[k]);
+    long long frozen_ns = now_ns() - t0;
+    double lookups = (double)rounds * n;
+    free(probe);
+
+    printf("Catalogo congelado: %d codigos en %d cubetas | armado %.3f ms (%.0f ns/codigo) | %.1f KB\n",
+           n, mph_buckets, build_ns / 1e6, (double)build_ns / n,
+           (sizeof(mph_pilot[0]) * (double)mph_buckets + 2 * sizeof(mph_slot[0]) * (double)n) / 1024.0);
+    printf("Busqueda por codigo: indice mutable %.1f ns | hash perfecto %.1f ns%s\n",
+           mutable_ns / lookups, frozen_ns / lookups, found ? " (diferencia en resultados!)" : "");
+    printf("Se descongela con la proxima alta o baja de medicamento.\n");
+}
+
+/* Imprime CSV de medicamentos por pantalla (no escribe archivo) */
+static void print_medicines_csv(void) {
+    long long m0 = metric_start();
+    printf("Codigo,Nombre,Precio,Stock,StockCritico,VentaLibre\n");
+    for (int i = 0; i < med_count; ++i) {
+        /* Reemplazar comas en los nombres para no romper CSV básico */
+        char safe_name[MAX_NAME_LEN];
+        strncpy(safe_name, MED_NAME(i), MAX_NAME_LEN-1); safe_name[MAX_NAME_LEN-1] = '\0';
+        for (char *p = safe_name; *p; ++p) if (*p == ',') *p = ' ';
+        printf("%d,%s,%.2f,%d,%d,%d\n",
+               MED_CODE(i), safe_name, MED_PRICE(i), MED_STOCK(i), MED_CRIT(i), MED_OTC(i));
+    }
+    metric_end(OP_EXPORT_MEDS, m0);
+}
+
+/* ------------- IMPORTACION MASIVA DE CATALOGO ------------- */
+/* Parseo de campos sobre el buffer del archivo (sin '\0' al final, por eso
+   todas las funciones reciben [p, end) y no usan strtol/strtod). */
+static int csv_parse_int(const char *p, const char *end, int *out) {
+    int neg = 0;
+    long long v = 0;
+    if (p < end && (*p == '-' || *p == '+')) { neg = (*p == '-'); p++; }
+    if (p == end) return 0;
+    for (; p < end; ++p) {
+        if (*p < '0' || *p > '9') return 0;
+        v = v * 10 + (*p - '0');
+        if (v > 2147483647LL + neg) return 0;   /* -2147483648 tambien entra */
+    }
+    *out = (int)(neg ? -v : v);
+    return 1;
+}
+
+static int csv_parse_price(const char *p, const char *end, double *out) {
+    long long ent = 0, frac = 0, div = 1;
+    int digits = 0;
+    if (p < end && *p == '-') return 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) ent = ent * 10 + (*p - '0');
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+            if (div < 1000000000LL) { frac = frac * 10 + (*p - '0'); div *= 10; }
+        }
+    }
+    if (p != end || digits == 0) return 0;
+    *out = (double)ent + (double)frac / (double)div;
+    return 1;
+}
+
+/* Importa lineas "Codigo,Nombre,Precio,Stock,StockCritico,VentaLibre"
+   desde buf. Cada campo se separa con memchr, sin copias intermedias:
+   el nombre se copia directo a MED_NAME(idx). Los codigos repetidos (contra el
+   catalogo o dentro del mismo archivo) se rechazan usando el indice hash. */
+static void import_medicines_buffer(const char *buf, size_t len,
+                                    long *ok, long *dup, long *bad, long *full) {
+    const char *p = buf, *end = buf + len;
+    int first = 1;
+    long long import_ts = sale_timestamp_now();   /* todos los precios rigen desde la importacion */
+    ord_defer();
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        const char *next = nl ? nl + 1 : end;
+        if (eol > p && eol[-1] == '\r') eol--;
+        if (eol == p) { p = next; first = 0; continue; }  /* linea vacia */
+
+        /* saltear encabezado */
+        if (first && (size_t)(eol - p) >= 6 && memcmp(p, "Codigo", 6) == 0) { p = next; first = 0; continue; }
+        first = 0;
+
+        /* f[k] = inicio del campo k; el campo k termina en f[k+1]-1 (la coma) */
+        const char *f[6];
+        int nf = 0;
+        f[nf++] = p;
+        const char *q = p;
+        while (nf < 6) {
+            const char *c = memchr(q, ',', (size_t)(eol - q));
+            if (!c) break;
+            f[nf++] = c + 1;
+            q = c + 1;
+        }
+        if (nf != 6 || memchr(f[5], ',', (size_t)(eol - f[5]))) { (*bad)++; p = next; continue; }
+
+        int code, stock, crit, otc;
+        double price;
+        if (!csv_parse_int(f[0], f[1] - 1, &code) ||
+            !csv_parse_price(f[2], f[3] - 1, &price) ||
+            !csv_parse_int(f[3], f[4] - 1, &stock) ||
+            !csv_parse_int(f[4], f[5] - 1, &crit) ||
+            !csv_parse_int(f[5], eol, &otc) ||
+            stock < 0 || crit < 0 || (otc != 0 && otc != 1) ||
+            f[2] - 1 == f[1]) {   /* nombre vacio */
+            (*bad)++; p = next; continue;
+        }
+        if (find_med_index_by_code(code) != -1) { (*dup)++; p = next; continue; }
+        if (med_count >= MAX_MEDICINES) { (*full)++; p = next; continue; }
+
+        int idx = med_insert(code, f[1], (size_t)(f[2] - 1 - f[1]), price, stock, otc, crit, import_ts);
+        if (idx < 0) { (*full)++; p = next; continue; }
+        journal_med('A', idx);
+        (*ok)++;
+        p = next;
+    }
+    ord_resume();
+}
+
+/* Importar catalogo desde archivo CSV (mismo formato que la opcion 13).
+   En POSIX el archivo se mapea con mmap; en Windows se lee entero con fread. */
+static void import_medicines_file(const char *path) {
+    long ok = 0, dup = 0, bad = 0, full = 0;
+    long long m0 = metric_start();
+    long long t0 = now_ns();
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if (!fp) { printf("No se pudo abrir '%s'.\n", path); return; }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = size > 0 ? malloc((size_t)size) : NULL;
+    if (size > 0 && (!buf || fread(buf, 1, (size_t)size, fp) != (size_t)size)) {
+        printf("Error leyendo '%s'.\n", path); free(buf); fclose(fp); return;
+    }
+    fclose(fp);
+    if (size > 0) import_medicines_buffer(buf, (size_t)size, &ok, &dup, &bad, &full);
+    free(buf);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { printf("No se pudo abrir '%s'.\n", path); return; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { printf("Error leyendo '%s'.\n", path); close(fd); return; }
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) { printf("Error mapeando '%s'.\n", path); close(fd); return; }
+        posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+        import_medicines_buffer(map, (size_t)st.st_size, &ok, &dup, &bad, &full);
+        munmap(map, (size_t)st.st_size);
+    }
+    close(fd);
+#endif
+    journal_commit();
+    double secs = (double)(now_ns() - t0) / 1e9;
+    metric_end(OP_IMPORT_MEDS, m0);
+
+    printf("Importados: %ld | Codigos duplicados: %ld | Lineas invalidas: %ld\n", ok, dup, bad);
+    if (full > 0) printf("Limite de catalogo alcanzado: %ld filas no importadas.\n", full);
+    printf("Tiempo: %.3f s (%.0f filas/s)\n", secs, secs > 0 ? (double)(ok + dup + bad + full) / secs : 0.0);
+}
+
+static void import_medicines_csv(void) {
+    char path[MAX_INPUT];
+    printf("Ruta del CSV a importar (vaciar cancelar): ");
+    read_line(path, sizeof(path));
+    trim(path);
+    if (path[0] == '\0') return;
+    import_medicines_file(path);
+}
+
+/* ------------- FUNCIONES DE VENTAS E INFORMES ------------- */
+static void sell_medicine(void) {
+    if (sale_count >= MAX_SALES) { printf("%s\n", farm_error_text(FARM_ERR_SALES_FULL)); return; }
+
+    int code;
+    if (!prompt_int("Codigo a vender (vaciar cancelar): ", &code)) return;
+    int stock, is_otc;
+    if (farm_med_get(code, NULL, 0, NULL, &stock, &is_otc, NULL) != FARM_OK) { printf("Codigo no existe.\n"); return; }
+
+    int qty;
+    if (!prompt_int("Cantidad a vender: ", &qty)) return;
+    if (qty <= 0) { printf("Cantidad invalida.\n"); return; }
+    if (qty > stock) { printf("Stock insuficiente.\n"); return; }
+
+    int day;
+    if (!prompt_int("Dia de la venta (1-31): ", &day)) return;
+    if (day < 1 || day > DAYS_IN_MONTH) { printf("Dia invalido.\n"); return; }
+
+    char dnibuf[32] = "";
+    if (!is_otc) {
+        printf("Ingrese DNI del comprador (vaciar = NO registrar - advertencia legal): ");
+        read_line(dnibuf, sizeof(dnibuf));
+        trim(dnibuf);
+        /* se registra '-' pero avisamos */
+        if (dnibuf[0] == '\0') printf("Advertencia: venta RX sin registro de DNI.\n");
+    }
+
+    double total;
+    int err = farm_sell(code, qty, day, dnibuf, &total);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    farm_med_get(code, NULL, 0, NULL, &stock, NULL, NULL);
+    printf("Venta registrada: $%.2f | Dia %d | Quedan %d unidades.\n", total, day, stock);
+}
+
+/* ------------- CONSULTAS POR RANGO DE TIEMPO ------------- */
+/* Primera venta con SALE_TS >= ts (busqueda binaria) */
+static int sales_lower_bound(long long ts) {
+    int lo = 0, hi = sale_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (SALE_TS(mid) < ts) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Dias del mes calendario en curso (28 a 31, segun el reloj) */
+static int month_length_now(void) {
+    time_t now = time(NULL);
+    struct tm tm = *localtime(&now);
+    tm.tm_mon += 1;
+    tm.tm_mday = 0;   /* dia 0 del mes siguiente = ultimo dia de este */
+    tm.tm_hour = 12;
+    tm.tm_isdst = -1;
+    mktime(&tm);
+    return tm.tm_mday;
+}
+
+/* Microsegundos del dia/hora indicados del mes en curso (hora local).
+   day tiene que existir en el mes (1..month_length_now()); hour puede ser
+   24 = 00:00 del dia siguiente. */
+static long long month_time_us(int day, int hour) {
+    time_t now = time(NULL);
+    struct tm tm = *localtime(&now);
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    return (long long)mktime(&tm) * 1000000LL;
+}
+
+/* Ventas entre las horas [h_from, h_to) de los dias d_from..d_to del mes
+   en curso, mas el histograma por hora. Trabaja sobre el momento en que se
+   registro cada venta (SALE_TS, el indice por tiempo), no sobre el dia
+   cargado a mano (SALE_DAY) que usan el informe del dia y el mensual: una
+   venta cargada hoy con otro dia cuenta aca como de hoy. Los dias son los
+   del mes calendario actual. Cada franja horaria de cada dia
+   se resuelve con dos busquedas binarias: O(dias * horas * log n); solo el
+   importe recorre las k ventas que caen dentro del rango. */
+static void report_time_range(int d_from, int d_to, int h_from, int h_to) {
+    long long per_hour[24] = {0};
+    long long count = 0;
+    double amount = 0.0;
+    for (int d = d_from; d <= d_to; ++d) {
+        for (int h = h_from; h < h_to; ++h) {
+            int a = sales_lower_bound(month_time_us(d, h));
+            int b = sales_lower_bound(month_time_us(d, h + 1));
+            per_hour[h] += b - a;
+            count += b - a;
+            for (int i = a; i < b; ++i) amount += SALE_AMOUNT(i);
+        }
+    }
+    printf("Ventas registradas los dias %d-%d entre %02d:00 y %02d:00: %lld operaciones | Total importe: $%.2f\n",
+           d_from, d_to, h_from, h_to, count, amount);
+    printf("Ventas por hora (para turnos):\n");
+    long long max = 1;
+    for (int h = h_from; h < h_to; ++h) if (per_hour[h] > max) max = per_hour[h];
+    for (int h = h_from; h < h_to; ++h) {
+        int bar = (int)(per_hour[h] * 40 / max);
+        printf("%02d:00 %6lld ", h, per_hour[h]);
+        for (int k = 0; k < bar; ++k) putchar('#');
+        putchar('\n');
+    }
+}
+
+static void report_time_range_prompt(void) {
+    int d_from, d_to, h_from, h_to, days = month_length_now();
+    char prompt[64];
+    printf("Por fecha y hora de registro de la venta (no por el dia cargado).\n");
+    snprintf(prompt, sizeof(prompt), "Desde dia (1-%d): ", days);
+    if (!prompt_int(prompt, &d_from)) return;
+    snprintf(prompt, sizeof(prompt), "Hasta dia (1-%d): ", days);
+    if (!prompt_int(prompt, &d_to)) return;
+    if (d_from < 1 || d_to > days || d_from > d_to) { printf("Dias invalidos (este mes tiene %d).\n", days); return; }
+    if (!prompt_int("Desde hora (0-23): ", &h_from)) return;
+    if (!prompt_int("Hasta hora (1-24, exclusiva): ", &h_to)) return;
+    if (h_from < 0 || h_to > 24 || h_from >= h_to) { printf("Horas invalidas.\n"); return; }
+    report_time_range(d_from, d_to, h_from, h_to);
+}
+
+/* Reporte de stock critico (solo dueno) */
+static void report_stock_critical(void) {
+    int max = med_count > 0 ? med_count : 1;
+    int *codes = malloc(sizeof(int) * (size_t)max);
+    if (!codes) { printf("%s\n", farm_error_text(FARM_ERR_MEMORY)); return; }
+    int found = farm_stock_critical(codes, max);
+    printf("Medicamentos en o por debajo del stock critico:\n");
+    for (int k = 0; k < found; ++k) {
+        char name[MAX_NAME_LEN];
+        int stock = 0, crit = 0;
+        farm_med_get(codes[k], name, sizeof(name), NULL, &stock, NULL, &crit);
+        printf("Codigo %d | %s | Stock: %d | Critico: %d\n", codes[k], name, stock, crit);
+    }
+    if (!found) printf("Ningun medicamento esta por debajo del stock critico.\n");
+    free(codes);
+}
+
+/* Cobertura y reposicion sugerida de todo el catalogo en una pasada (con
+   la demanda estimada, ver DEMANDA ESTIMADA). all = 0: solo los que hay
+   que pedir. csv = formato para el modo lote. */
+static void report_reorder(int all, int csv) {
+    long long m0 = metric_start();
+    int shown = 0;
+    if (csv) printf("Codigo,Nombre,Stock,DemandaDia,Desvio,DiasCobertura,PuntoPedido,StockCritico,Pedir\n");
+    else {
+        printf("Demanda estimada (promedio de ~%d dias) | pedido cada %d dias, demora %d dias\n",
+               DEMAND_SPAN_DAYS, DEMAND_REVIEW_DAYS, DEMAND_LEAD_DAYS);
+        printf("Codigo | Nombre               | Stock | Dem/dia | Desvio | Cobertura | P.pedido | Critico | Pedir\n");
+    }
+    for (int i = 0; i < med_count; ++i) {
+        double rate, sd, cover;
+        int rop, qty;
+        demand_suggest(i, &rate, &sd, &cover, &rop, &qty);
+        if (!all && qty == 0) continue;
+        shown++;
+        if (csv) {
+            char name[MAX_NAME_LEN];
+            strcpy(name, MED_NAME(i));
+            for (char *p = name; *p; ++p) if (*p == ',') *p = ' ';
+            printf("%d,%s,%d,%.3f,%.3f,", MED_CODE(i), name, MED_STOCK(i), rate, sd);
+            if (cover == HUGE_VAL) printf(",");
+            else printf("%.1f,", cover);
+            printf("%d,%d,%d\n", rop, MED_CRIT(i), qty);
+        } else {
+            char cov[16] = "-";
+            if (cover != HUGE_VAL) snprintf(cov, sizeof(cov), "%.1f d", cover);
+            printf("%6d | %-20.20s | %5d | %7.2f | %6.2f | %9s | %8d | %7d | %5d\n",
+                   MED_CODE(i), MED_NAME(i), MED_STOCK(i), rate, sd, cov, rop, MED_CRIT(i), qty);
+        }
+    }
+    if (!csv && !shown) printf(all ? "Catalogo vacio.\n" : "No hace falta pedir nada.\n");
+    metric_end(OP_REPORT_REORDER, m0);
+}
+
+static void report_reorder_prompt(void) {
+    int which;
+    if (!prompt_int("1) Solo lo que hay que pedir  2) Todo el catalogo: ", &which)) return;
+    report_reorder(which == 2, 0);
+}
+
+/* Reset mensual: borrar ventas */
+static void reset_month(void) {
+    int err = farm_reset_month();
+    if (err == FARM_ERR_NO_SUMMARY) printf("Advertencia: sin lugar para guardar el resumen del mes.\n");
+    printf("Datos de ventas del mes borrados.\n");
+}
+
+/* Token de la sesion del dueno abierta desde el menu ("" = ninguna) */
+static char menu_owner_token[FARM_TOKEN_LEN] = "";
+
+/* Cambiar contrasena del dueño */
+static void change_owner_password(void) {
+    char current[OWNER_PASSWORD_LEN], newp[OWNER_PASSWORD_LEN], conf[OWNER_PASSWORD_LEN];
     printf("Ingrese contrasena actual (vaciar cancelar): ");
     read_password(current, sizeof(current));
     if (current[0] == '\0') { printf("Cancelado.\n"); return; }
-    if (strcmp(current, owner_password) != 0) { printf("Contrasena incorrecta.\n"); return; }
+    int ok = farm_owner_check(current);
+    rec_password_result(ok);
+    if (!ok) { printf("Contrasena incorrecta.\n"); return; }
     printf("Nueva contrasena: ");
     read_password(newp, sizeof(newp));
     if (newp[0] == '\0') { printf("Cancelado.\n"); return; }
     printf("Confirme nueva contrasena: ");
     read_password(conf, sizeof(conf));
     if (strcmp(newp, conf) != 0) { printf("No coinciden. Cancelado.\n"); return; }
-    strncpy(owner_password, newp, sizeof(owner_password)-1); owner_password[sizeof(owner_password)-1] = '\0';
-    printf("Contrasena actualizada.\n");
+    int err = farm_owner_set_password(current, newp);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    if (replay_fp) strcpy(replay_password, newp);
+    menu_owner_token[0] = '\0';
+    printf("Contrasena actualizada. La sesion del dueno se cerro.\n");
 }
 
-/* Autenticacion del dueño */
+/* Autenticacion del dueño: con la sesion abierta no se vuelve a pedir la
+   contrasena (ver farm_owner_login) */
 static int authenticate_owner(void) {
-    char buf[64];
+    if (menu_owner_token[0]) {
+        if (farm_owner_session(menu_owner_token) == FARM_OK) return 1;
+        menu_owner_token[0] = '\0';
+        printf("La sesion del dueno vencio (%d min sin uso).\n", OWNER_SESSION_IDLE_MIN);
+    }
+    char buf[OWNER_PASSWORD_LEN];
     printf("Ingrese contrasena del dueno (vaciar cancelar): ");
     read_password(buf, sizeof(buf));
     if (buf[0] == '\0') return 0;
-    if (strcmp(buf, owner_password) == 0) return 1;
+    int err = farm_owner_login(buf, menu_owner_token);
+    rec_password_result(err == FARM_OK);
+    memset(buf, 0, sizeof(buf));
+    if (err == FARM_OK) return 1;
     printf("Contrasena incorrecta.\n");
     return 0;
 }
 
+static void close_owner_session(void) {
+    if (!menu_owner_token[0]) { printf("No hay sesion del dueno abierta.\n"); return; }
+    farm_owner_logout();
+    menu_owner_token[0] = '\0';
+    printf("Sesion del dueno cerrada.\n");
+}
+
+/* ------------- SUCURSALES (MENU) ------------- */
+static int prompt_branch(int *out) {
+    char prompt[64];
+    snprintf(prompt, sizeof(prompt), "Sucursal (0 = este local, 1-%d): ", MAX_BRANCHES - 1);
+    if (!prompt_int(prompt, out)) return 0;
+    if (*out < 0 || *out >= MAX_BRANCHES) { printf("%s\n", farm_error_text(FARM_ERR_BRANCH)); return 0; }
+    return 1;
+}
+
+static void sell_in_branch(void) {
+    int b, code, qty, day, stock, is_otc;
+    if (!prompt_branch(&b)) return;
+    if (!prompt_int("Codigo a vender (vaciar cancelar): ", &code)) return;
+    if (farm_med_get(code, NULL, 0, NULL, NULL, &is_otc, NULL) != FARM_OK) { printf("Codigo no existe.\n"); return; }
+    farm_branch_get_stock(b, code, &stock);
+    printf("Stock en la sucursal %d: %d\n", b, stock);
+    if (!prompt_int("Cantidad a vender: ", &qty)) return;
+    if (!prompt_int("Dia de la venta (1-31): ", &day)) return;
+    char dnibuf[DNI_LEN] = "";
+    if (!is_otc) {
+        printf("Ingrese DNI del comprador (vaciar = NO registrar - advertencia legal): ");
+        read_line(dnibuf, sizeof(dnibuf));
+        trim(dnibuf);
+        if (dnibuf[0] == '\0') printf("Advertencia: venta RX sin registro de DNI.\n");
+    }
+    double total;
+    int err = farm_branch_sell(b, code, qty, day, dnibuf, &total);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    farm_branch_get_stock(b, code, &stock);
+    printf("Venta registrada en la sucursal %d: $%.2f | Dia %d | Quedan %d unidades.\n", b, total, day, stock);
+}
+
+/* Mercaderia recibida: un remito de un renglon (ver farm_receive) */
+static void receive_in_branch(void) {
+    int b, code, qty, stock;
+    if (!prompt_branch(&b)) return;
+    if (!prompt_int("Codigo recibido (vaciar cancelar): ", &code)) return;
+    if (farm_branch_get_stock(b, code, &stock) != FARM_OK) { printf("Codigo no existe.\n"); return; }
+    if (!prompt_int("Unidades recibidas: ", &qty)) return;
+    int done = farm_receive(b, &code, &qty, 1, NULL, 0, NULL);
+    if (done < 0) { printf("%s\n", farm_error_text(done)); return; }
+    farm_branch_get_stock(b, code, &stock);
+    printf("Stock en la sucursal %d: %d unidades.\n", b, stock);
+}
+
+static void show_branch_stock(void) {
+    int code;
+    char name[MAX_NAME_LEN];
+    if (!prompt_int("Codigo (vaciar cancelar): ", &code)) return;
+    if (farm_med_get(code, name, sizeof(name), NULL, NULL, NULL, NULL) != FARM_OK) { printf("Codigo no existe.\n"); return; }
+    long long total = 0;
+    printf("%d | %s\n", code, name);
+    for (int b = 0; b < farm_branch_count(); ++b) {
+        int stock = 0;
+        farm_branch_get_stock(b, code, &stock);
+        total += stock;
+        printf("  Sucursal %d: %d\n", b, stock);
+    }
+    printf("  Total: %lld\n", total);
+}
+
+/* Informe mensual consolidado: total, detalle por sucursal y ventas por dia */
+static void report_consolidated_monthly(void) {
+    double total;
+    int n, per_day[DAYS_IN_MONTH + 1];
+    int err = farm_branch_month_summary(FARM_ALL_BRANCHES, &total, &n, per_day);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    printf("===== Informe mensual consolidado (sucursales en uso: %d) =====\n", farm_branch_count());
+    /* detalle de la misma pasada: cada sucursal dejo sus totales en bagg_* */
+    for (int b = 0; b < farm_branch_count(); ++b) {
+        double bt = 0.0;
+        int bn = 0;
+        for (int d = 0; d <= DAYS_IN_MONTH; ++d) { bt += bagg_amount[b][d]; bn += bagg_count[b][d]; }
+        printf("Sucursal %d: %d operaciones | $%.2f\n", b, bn, bt);
+    }
+    printf("Total importe: $%.2f\n", total);
+    printf("Ventas por dia (dia: cantidad):\n");
+    for (int d = 1; d <= DAYS_IN_MONTH; ++d) if (per_day[d] > 0) printf("Dia %2d: %d\n", d, per_day[d]);
+    printf("Operaciones totales en el mes: %d\n", n);
+}
+
+static void report_consolidated_day(void) {
+    int day;
+    if (!prompt_int("Ingrese dia a consultar (1-31): ", &day)) return;
+    double total;
+    int count;
+    int err = farm_branch_day_summary(FARM_ALL_BRANCHES, day, &total, &count);
+    if (err != FARM_OK) { printf("%s\n", farm_error_text(err)); return; }
+    printf("Informe consolidado dia %d: %d operaciones | Total importe: $%.2f\n", day, count, total);
+}
+
+static void report_consolidated_critical(void) {
+    int max = farm_branch_count() * (med_count > 0 ? med_count : 1);
+    int *branches = malloc(sizeof(int) * (size_t)max * 2);
+    if (!branches) { printf("%s\n", farm_error_text(FARM_ERR_MEMORY)); return; }
+    int *codes = branches + max;
+    int found = farm_branch_stock_critical(FARM_ALL_BRANCHES, branches, codes, max);
+    if (found < 0) { printf("%s\n", farm_error_text(found)); free(branches); return; }
+    printf("Medicamentos en o por debajo del stock critico, por sucursal:\n");
+    for (int k = 0; k < found; ++k) {
+        char name[MAX_NAME_LEN];
+        int stock = 0, crit = 0;
+        farm_med_get(codes[k], name, sizeof(name), NULL, NULL, NULL, &crit);
+        farm_branch_get_stock(branches[k], codes[k], &stock);
+        printf("Sucursal %d | Codigo %d | %s | Stock: %d | Critico: %d\n", branches[k], codes[k], name, stock, crit);
+    }
+    if (!found) printf("Ningun medicamento esta por debajo del stock critico.\n");
+    free(branches);
+}
+
+/* Ventas del mes de una sucursal como CSV */
+static void print_branch_sales_csv(int b) {
+    if (b == 0) { print_sales_csv(); return; }
+    int p = b - 1;
+    printf("Dia,CodigoMedicamento,Cantidad,Importe,DNI\n");
+    for (int i = 0; i < BRANCH_SALES(p); ++i)
+        printf("%d,%d,%d,%.2f,%s\n", branch_sale_day[p][i], branch_sale_code[p][i], branch_sale_qty[p][i],
+               branch_sale_amount[p][i], branch_sale_dni[p][i]);
+}
+
+/* Opcion 28. En la replica solo consultas (replica = 1). */
+static void branch_menu(int replica) {
+    printf("Sucursales en uso: %d (0 = este local)\n", farm_branch_count());
+    if (!replica) {
+        printf(" 1) Vender en una sucursal\n");
+        printf(" 2) Recibir mercaderia en una sucursal\n");
+    }
+    printf(" 3) Stock de un producto por sucursal\n");
+    printf(" 4) Informe mensual consolidado\n");
+    printf(" 5) Informe dia consolidado (dueno)\n");
+    printf(" 6) Stock critico consolidado (dueno)\n");
+    printf(" 7) CSV ventas de una sucursal (pantalla)\n");
+    int option, b;
+    if (!prompt_int("Seleccione opcion: ", &option)) return;
+    switch (option) {
+        case 1: if (!replica) sell_in_branch(); else printf("Opcion no disponible en la replica.\n"); break;
+        case 2: if (!replica) receive_in_branch(); else printf("Opcion no disponible en la replica.\n"); break;
+        case 3: show_branch_stock(); break;
+        case 4: report_consolidated_monthly(); break;
+        case 5: if (authenticate_owner()) report_consolidated_day(); else printf("No autorizado.\n"); break;
+        case 6: if (authenticate_owner()) report_consolidated_critical(); else printf("No autorizado.\n"); break;
+        case 7: if (prompt_branch(&b)) print_branch_sales_csv(b); break;
+        default: printf("Opcion invalida.\n"); break;
+    }
+}
+
+/* ------------- RECEPCION DE MERCADERIA ------------- */
+/* Un remito es una lista de renglones (codigo, cantidad): un CSV
+   "Codigo,Cantidad" (encabezado opcional) o el comando de lote recibir.
+   farm_receive los ordena por codigo y los cruza con el catalogo de una
+   vez; aca se parsean y se informa el resultado. */
+#define RECEIVE_SHOW_UNKNOWN 20
+
+/* Aplica los n renglones validos y muestra el resumen; bad = renglones
+   invalidos (entran en las filas por segundo, medidas desde t0).
+   Devuelve 0 si la recepcion se cancelo. */
+static int receive_report(int branch, const int *codes, const int *qtys, int n, long bad, long long t0) {
+    int unknown[RECEIVE_SHOW_UNKNOWN], missing = 0;
+    int done = farm_receive(branch, codes, qtys, n, unknown, RECEIVE_SHOW_UNKNOWN, &missing);
+    double secs = (double)(now_ns() - t0) / 1e9;
+    if (done < 0) { printf("Recepcion cancelada: %s\n", farm_error_text(done)); return 0; }
+    printf("Sucursal %d | Renglones: %d | Productos actualizados: %d | Codigos desconocidos: %d | Lineas invalidas: %ld\n",
+           branch, n, done, missing, bad);
+    if (missing > 0) {
+        printf("Codigos desconocidos:");
+        for (int k = 0; k < missing && k < RECEIVE_SHOW_UNKNOWN; ++k) printf(" %d", unknown[k]);
+        if (missing > RECEIVE_SHOW_UNKNOWN) printf(" ... y %d mas", missing - RECEIVE_SHOW_UNKNOWN);
+        printf("\n");
+    }
+    printf("Tiempo: %.3f s (%.0f filas/s)\n", secs, secs > 0 ? (double)(n + bad) / secs : 0.0);
+    return 1;
+}
+
+/* Lineas "Codigo,Cantidad" de buf; la cantidad tiene que ser > 0.
+   codes/qtys tienen lugar para todas las lineas del buffer. */
+static int receive_parse_buffer(const char *buf, size_t len, int *codes, int *qtys, long *bad) {
+    const char *p = buf, *end = buf + len;
+    int n = 0, first = 1;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        const char *next = nl ? nl + 1 : end;
+        if (eol > p && eol[-1] == '\r') eol--;
+        if (eol == p) { p = next; first = 0; continue; }
+        if (first && (size_t)(eol - p) >= 6 && memcmp(p, "Codigo", 6) == 0) { p = next; first = 0; continue; }
+        first = 0;
+        const char *c = memchr(p, ',', (size_t)(eol - p));
+        if (!c || !csv_parse_int(p, c, &codes[n]) || !csv_parse_int(c + 1, eol, &qtys[n]) || qtys[n] <= 0) (*bad)++;
+        else n++;
+        p = next;
+    }
+    return n;
+}
+
+static int receive_buffer(int branch, const char *buf, size_t len, long long t0) {
+    size_t lines = 1;
+    for (const char *p = buf; (p = memchr(p, '\n', (size_t)(buf + len - p))) != NULL; ++p) lines++;
+    int *codes = malloc(sizeof(int) * lines * 2);
+    if (!codes) { printf("%s\n", farm_error_text(FARM_ERR_MEMORY)); return 0; }
+    long bad = 0;
+    int n = receive_parse_buffer(buf, len, codes, codes + lines, &bad);
+    int ok = receive_report(branch, codes, codes + lines, n, bad, t0);
+    free(codes);
+    return ok;
+}
+
+/* Recepcion desde archivo (mmap en POSIX, fread en Windows, como la
+   importacion de catalogo) */
+static int receive_file(int branch, const char *path) {
+    long long t0 = now_ns();
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if (!fp) { printf("No se pudo abrir '%s'.\n", path); return 0; }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = size > 0 ? malloc((size_t)size) : NULL;
+    if (size > 0 && (!buf || fread(buf, 1, (size_t)size, fp) != (size_t)size)) {
+        printf("Error leyendo '%s'.\n", path); free(buf); fclose(fp); return 0;
+    }
+    fclose(fp);
+    int ok = receive_buffer(branch, buf ? buf : "", buf ? (size_t)size : 0, t0);
+    free(buf);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { printf("No se pudo abrir '%s'.\n", path); return 0; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { printf("Error leyendo '%s'.\n", path); close(fd); return 0; }
+    int ok;
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) { printf("Error mapeando '%s'.\n", path); close(fd); return 0; }
+        posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+        ok = receive_buffer(branch, map, (size_t)st.st_size, t0);
+        munmap(map, (size_t)st.st_size);
+    } else ok = receive_buffer(branch, "", 0, t0);
+    close(fd);
+#endif
+    return ok;
+}
+
+static void receive_prompt(void) {
+    char path[MAX_INPUT];
+    int branch = 0;
+    if (branch_count > 1 && !prompt_branch(&branch)) return;
+    printf("Ruta del remito CSV (Codigo,Cantidad) (vaciar cancelar): ");
+    read_line(path, sizeof(path));
+    trim(path);
+    if (path[0] == '\0') return;
+    receive_file(branch, path);
+}
+
+/* ------------- CONSULTAS AD-HOC SOBRE VENTAS ------------- */
+/* Lenguaje chico para preguntas nuevas sin escribir otro informe:
+     [donde] cond... [por dia|codigo|tipo] [contar] [suma|prom importe|cant]...
+     [orden clave|contar|suma_importe|suma_cant|prom_importe|prom_cant [asc|desc]]
+     [limite N]
+   cond: campo op valor, sin espacios. Campos: dia, codigo, cant, importe,
+   tipo (rx/otc), dni. op: = != < <= > >= (tipo y dni solo = y !=).
+   Ej: donde dia>=3 dia<=9 tipo=rx por codigo suma importe orden suma_importe desc limite 10
+   Ejecucion por lotes de QUERY_BATCH ventas: cada condicion es un ciclo
+   corto sobre una sola columna sale_* que arma un vector de seleccion
+   (posiciones que pasan) sin saltos condicionales; la agregacion recorre
+   solo la seleccion final del lote. */
+#define QUERY_BATCH 1024
+#define QUERY_MAX_PREDS 16
+#define QUERY_MAX_AGGS 8
+
+#define QF_DAY 0
+#define QF_CODE 1
+#define QF_QTY 2
+#define QF_AMOUNT 3
+#define QF_TYPE 4
+#define QF_DNI 5
+#define QF_NONE 6
+
+#define QO_EQ 0
+#define QO_NE 1
+#define QO_LT 2
+#define QO_LE 3
+#define QO_GT 4
+#define QO_GE 5
+
+/* agregados y columnas de orden */
+#define QA_COUNT 0
+#define QA_SUM_AMOUNT 1
+#define QA_SUM_QTY 2
+#define QA_AVG_AMOUNT 3
+#define QA_AVG_QTY 4
+#define QA_KEY 5
+
+static const char *query_field_names[] = { "dia", "codigo", "cant", "importe", "tipo", "dni" };
+static const char *query_agg_names[] = { "contar", "suma_importe", "suma_cant", "prom_importe", "prom_cant", "clave" };
+
+static int q_pred_count, q_pred_field[QUERY_MAX_PREDS], q_pred_op[QUERY_MAX_PREDS];
+static long long q_pred_ival[QUERY_MAX_PREDS];
+static double q_pred_dval[QUERY_MAX_PREDS];
+static char q_pred_sval[QUERY_MAX_PREDS][32];
+static int q_group, q_agg_count, q_agg[QUERY_MAX_AGGS];
+static int q_order, q_order_desc;
+static long q_limit;
+
+/* grupos: tabla hash clave -> grupo, crece al duplicarse */
+static int q_groups = 0, q_hash_size = 0;
+static int *q_hash = NULL;            /* grupo + 1, 0 = vacio */
+static int *q_key = NULL;
+static long long *q_count = NULL, *q_sum_qty = NULL;
+static double *q_sum_amount = NULL;
+
+static int query_parse_field(const char *name, size_t len) {
+    for (int f = 0; f < QF_NONE; ++f)
+        if (strlen(query_field_names[f]) == len && strncmp(query_field_names[f], name, len) == 0) return f;
+    return -1;
+}
+
+static int query_parse(char *text) {
+    q_pred_count = q_agg_count = 0;
+    q_group = QF_NONE; q_order = -1; q_order_desc = 0; q_limit = -1;
+    char *save = NULL;
+    for (char *t = strtok_r(text, " \t", &save); t; t = strtok_r(NULL, " \t", &save)) {
+        if (strcmp(t, "donde") == 0 || strcmp(t, "y") == 0) continue;
+        if (strcmp(t, "por") == 0) {
+            char *k = strtok_r(NULL, " \t", &save);
+            int f = k ? query_parse_field(k, strlen(k)) : -1;
+            if (f != QF_DAY && f != QF_CODE && f != QF_TYPE) { printf("Agrupar solo por dia, codigo o tipo.\n"); return 0; }
+            q_group = f;
+        } else if (strcmp(t, "contar") == 0) {
+            if (q_agg_count < QUERY_MAX_AGGS) q_agg[q_agg_count++] = QA_COUNT;
+        } else if (strcmp(t, "suma") == 0 || strcmp(t, "prom") == 0) {
+            char *c = strtok_r(NULL, " \t", &save);
+            int f = c ? query_parse_field(c, strlen(c)) : -1;
+            if (f != QF_AMOUNT && f != QF_QTY) { printf("'%s' solo sobre importe o cant.\n", t); return 0; }
+            int a = (t[0] == 's') ? (f == QF_AMOUNT ? QA_SUM_AMOUNT : QA_SUM_QTY) : (f == QF_AMOUNT ? QA_AVG_AMOUNT : QA_AVG_QTY);
+            if (q_agg_count < QUERY_MAX_AGGS) q_agg[q_agg_count++] = a;
+        } else if (strcmp(t, "orden") == 0) {
+            char *c = strtok_r(NULL, " \t", &save);
+            q_order = -1;
+            for (int a = 0; c && a <= QA_KEY; ++a) if (strcmp(c, query_agg_names[a]) == 0) q_order = a;
+            if (c && q_order == -1 && query_parse_field(c, strlen(c)) == q_group) q_order = QA_KEY;
+            if (q_order == -1) { printf("Orden desconocido.\n"); return 0; }
+        } else if (strcmp(t, "desc") == 0) q_order_desc = 1;
+        else if (strcmp(t, "asc") == 0) q_order_desc = 0;
+        else if (strcmp(t, "limite") == 0) {
+            char *c = strtok_r(NULL, " \t", &save);
+            q_limit = c ? atol(c) : -1;
+            if (q_limit < 0) { printf("Limite invalido.\n"); return 0; }
+        } else {
+            /* condicion campo op valor */
+            size_t flen = strcspn(t, "=!<>");
+            int f = query_parse_field(t, flen);
+            const char *o = t + flen, *v;
+            int op;
+            if (strncmp(o, "!=", 2) == 0) { op = QO_NE; v = o + 2; }
+            else if (strncmp(o, "<=", 2) == 0) { op = QO_LE; v = o + 2; }
+            else if (strncmp(o, ">=", 2) == 0) { op = QO_GE; v = o + 2; }
+            else if (*o == '=') { op = QO_EQ; v = o + 1; }
+            else if (*o == '<') { op = QO_LT; v = o + 1; }
+            else if (*o == '>') { op = QO_GT; v = o + 1; }
+            else { printf("No entiendo '%s'.\n", t); return 0; }
+            if (f == -1 || *v == '\0' || q_pred_count >= QUERY_MAX_PREDS) { printf("Condicion invalida '%s'.\n", t); return 0; }
+            if ((f == QF_TYPE || f == QF_DNI) && op != QO_EQ && op != QO_NE) { printf("tipo y dni solo admiten = y !=.\n"); return 0; }
+            int k = q_pred_count++;
+            q_pred_field[k] = f;
+            q_pred_op[k] = op;
+            if (f == QF_TYPE) {
+                if (strcmp(v, "rx") != 0 && strcmp(v, "otc") != 0) { printf("tipo=rx o tipo=otc.\n"); return 0; }
+                q_pred_ival[k] = strcmp(v, "rx") == 0;
+            } else if (f == QF_DNI) {
+                strncpy(q_pred_sval[k], v, sizeof(q_pred_sval[k]) - 1); q_pred_sval[k][sizeof(q_pred_sval[k]) - 1] = '\0';
+            } else {
+                q_pred_dval[k] = atof(v);
+                q_pred_ival[k] = atoll(v);
+            }
+        }
+    }
+    if (q_agg_count == 0) { q_agg[q_agg_count++] = QA_COUNT; q_agg[q_agg_count++] = QA_SUM_AMOUNT; }
+    return 1;
+}
+
+/* Tipo de la venta (1 = RX) segun el catalogo actual, igual que show_rx_records */
+static int query_is_rx(int code) {
+    int idx = find_med_index_by_code(code);
+    return idx == -1 ? 1 : !MED_OTC(idx);
+}
+
+/* Arma la seleccion de [b, b+len) (o de sel[0..cnt) si sel != NULL)
+   con las filas donde COND es verdadera para la fila i. */
+#define VEC_SELECT(COND) do { \
+        if (sel) { for (int k = 0; k < cnt; ++k) { int i = sel[k]; out[m] = i; m += (COND); } } \
+        else { for (int i = b; i < b + len; ++i) { out[m] = i; m += (COND); } } \
+    } while (0)
+
+#define VEC_COMPARE(COL, V) do { \
+        switch (op) { \
+            case QO_EQ: VEC_SELECT((COL) == (V)); break; \
+            case QO_NE: VEC_SELECT((COL) != (V)); break; \
+            case QO_LT: VEC_SELECT((COL) < (V)); break; \
+            case QO_LE: VEC_SELECT((COL) <= (V)); break; \
+            case QO_GT: VEC_SELECT((COL) > (V)); break; \
+            default: VEC_SELECT((COL) >= (V)); break; \
+        } \
+    } while (0)
+
+static int query_filter(int p, int b, int len, const int *sel, int cnt, const int *type_col, int *out) {
+    int m = 0, op = q_pred_op[p];
+    switch (q_pred_field[p]) {
+        case QF_DAY: { int v = (int)q_pred_ival[p]; VEC_COMPARE(SALE_DAY(i), v); break; }
+        case QF_CODE: { int v = (int)q_pred_ival[p]; VEC_COMPARE(SALE_CODE(i), v); break; }
+        case QF_QTY: { int v = (int)q_pred_ival[p]; VEC_COMPARE(SALE_QTY(i), v); break; }
+        case QF_AMOUNT: { double v = q_pred_dval[p]; VEC_COMPARE(SALE_AMOUNT(i), v); break; }
+        case QF_TYPE: { int v = (int)q_pred_ival[p]; VEC_COMPARE(type_col[i - b], v); break; }
+        default: {
+            const char *v = q_pred_sval[p];
+            if (op == QO_EQ) VEC_SELECT(strcmp(SALE_DNI(i), v) == 0);
+            else VEC_SELECT(strcmp(SALE_DNI(i), v) != 0);
+        }
+    }
+    return m;
+}
+
+static int query_group_slot(int key) {
+    if (q_groups * 2 >= q_hash_size) {
+        int nsize = q_hash_size ? q_hash_size * 2 : 64;
+        int *nh = calloc((size_t)nsize, sizeof(int));
+        int *nk = realloc(q_key, sizeof(int) * (size_t)nsize / 2);
+        long long *nc = realloc(q_count, sizeof(long long) * (size_t)nsize / 2);
+        long long *nq = realloc(q_sum_qty, sizeof(long long) * (size_t)nsize / 2);
+        double *na = realloc(q_sum_amount, sizeof(double) * (size_t)nsize / 2);
+        if (nk) q_key = nk;
+        if (nc) q_count = nc;
+        if (nq) q_sum_qty = nq;
+        if (na) q_sum_amount = na;
+        if (!nh || !nk || !nc || !nq || !na) { free(nh); return -1; }
+        for (int g = 0; g < q_groups; ++g) {
+            unsigned h = ((unsigned)q_key[g] * 2654435761u) & (unsigned)(nsize - 1);
+            while (nh[h]) h = (h + 1) & (unsigned)(nsize - 1);
+            nh[h] = g + 1;
+        }
+        free(q_hash);
+        q_hash = nh;
+        q_hash_size = nsize;
+    }
+    unsigned h = ((unsigned)key * 2654435761u) & (unsigned)(q_hash_size - 1);
+    while (q_hash[h]) {
+        if (q_key[q_hash[h] - 1] == key) return q_hash[h] - 1;
+        h = (h + 1) & (unsigned)(q_hash_size - 1);
+    }
+    int g = q_groups++;
+    q_hash[h] = g + 1;
+    q_key[g] = key;
+    q_count[g] = q_sum_qty[g] = 0;
+    q_sum_amount[g] = 0.0;
+    return g;
+}
+
+static double query_value(int g, int a) {
+    switch (a) {
+        case QA_COUNT: return (double)q_count[g];
+        case QA_SUM_AMOUNT: return q_sum_amount[g];
+        case QA_SUM_QTY: return (double)q_sum_qty[g];
+        case QA_AVG_AMOUNT: return q_count[g] ? q_sum_amount[g] / q_count[g] : 0.0;
+        case QA_AVG_QTY: return q_count[g] ? (double)q_sum_qty[g] / q_count[g] : 0.0;
+        default: return (double)q_key[g];
+    }
+}
+
+static int query_cmp(const void *a, const void *b) {
+    double x = query_value(*(const int *)a, q_order), y = query_value(*(const int *)b, q_order);
+    int c = (x > y) - (x < y);
+    return q_order_desc ? -c : c;
+}
+
+/* Ejecuta la consulta sobre las ventas del mes e imprime el resultado */
+static void run_query(const char *text) {
+    char buf[MAX_INPUT * 2];
+    strncpy(buf, text, sizeof(buf) - 1); buf[sizeof(buf) - 1] = '\0';
+    if (!query_parse(buf)) return;
+    long long m0 = metric_start();
+    long long t0 = now_ns();
+
+    static int sel_a[QUERY_BATCH], sel_b[QUERY_BATCH], type_col[QUERY_BATCH];
+    int need_type = q_group == QF_TYPE;
+    for (int p = 0; p < q_pred_count; ++p) if (q_pred_field[p] == QF_TYPE) need_type = 1;
+    q_groups = 0;
+    if (q_hash) memset(q_hash, 0, sizeof(int) * (size_t)q_hash_size);
+
+    int n = sale_count;
+    for (int b = 0; b < n; b += QUERY_BATCH) {
+        int len = n - b < QUERY_BATCH ? n - b : QUERY_BATCH;
+        if (need_type) for (int k = 0; k < len; ++k) type_col[k] = query_is_rx(SALE_CODE(b + k));
+        int *sel = NULL, cnt = len;
+        for (int p = 0; p < q_pred_count && cnt > 0; ++p) {
+            int *out = (sel == sel_a) ? sel_b : sel_a;
+            cnt = query_filter(p, b, len, sel, cnt, type_col, out);
+            sel = out;
+        }
+        if (cnt == 0) continue;
+        if (q_group == QF_NONE) {
+            int g = query_group_slot(0);
+            if (g < 0) { printf("Sin memoria para la consulta.\n"); return; }
+            long long qsum = 0;
+            double asum = 0.0;
+            if (sel) for (int k = 0; k < cnt; ++k) { qsum += SALE_QTY(sel[k]); asum += SALE_AMOUNT(sel[k]); }
+            else for (int i = b; i < b + len; ++i) { qsum += SALE_QTY(i); asum += SALE_AMOUNT(i); }
+            q_count[g] += cnt; q_sum_qty[g] += qsum; q_sum_amount[g] += asum;
+            continue;
+        }
+        for (int k = 0; k < cnt; ++k) {
+            int i = sel ? sel[k] : b + k;
+            int key = q_group == QF_DAY ? SALE_DAY(i) : q_group == QF_CODE ? SALE_CODE(i) : type_col[i - b];
+            int g = query_group_slot(key);
+            if (g < 0) { printf("Sin memoria para la consulta.\n"); return; }
+            q_count[g]++;
+            q_sum_qty[g] += SALE_QTY(i);
+            q_sum_amount[g] += SALE_AMOUNT(i);
+        }
+    }
+
+    static int *order = NULL;
+    static int order_cap = 0;
+    if (q_groups > order_cap) {
+        int *no = realloc(order, sizeof(int) * (size_t)q_groups);
+        if (!no) { printf("Sin memoria para la consulta.\n"); return; }
+        order = no;
+        order_cap = q_groups;
+    }
+    for (int g = 0; g < q_groups; ++g) order[g] = g;
+    if (q_order == -1 && q_group != QF_NONE) q_order = QA_KEY;
+    if (q_order != -1) qsort(order, (size_t)q_groups, sizeof(int), query_cmp);
+    double secs = (now_ns() - t0) / 1e9;
+    metric_end(OP_QUERY, m0);
+
+    if (q_group != QF_NONE) printf("%10s", query_field_names[q_group]);
+    for (int a = 0; a < q_agg_count; ++a) printf(" | %14s", query_agg_names[q_agg[a]]);
+    printf("\n");
+    long shown = 0;
+    for (int k = 0; k < q_groups && (q_limit < 0 || shown < q_limit); ++k, ++shown) {
+        int g = order[k];
+        if (q_group == QF_TYPE) printf("%10s", q_key[g] ? "RX" : "OTC");
+        else if (q_group != QF_NONE) printf("%10d", q_key[g]);
+        for (int a = 0; a < q_agg_count; ++a) {
+            if (q_agg[a] == QA_COUNT || q_agg[a] == QA_SUM_QTY) printf(" | %14.0f", query_value(g, q_agg[a]));
+            else printf(" | %14.2f", query_value(g, q_agg[a]));
+        }
+        printf("\n");
+    }
+    if (q_group == QF_NONE && q_groups == 0) {
+        for (int a = 0; a < q_agg_count; ++a) printf(" | %14d", 0);
+        printf("\n");
+    }
+    printf("(%d ventas recorridas en %.3f ms, %.0f M filas/s)\n", n, secs * 1e3, secs > 0 ? n / secs / 1e6 : 0.0);
+}
+
+static void run_query_prompt(void) {
+    char buf[MAX_INPUT * 2];
+    printf("Consulta (ej: donde dia>=3 tipo=rx por codigo suma importe orden suma_importe desc limite 10):\n> ");
+    read_line(buf, sizeof(buf)); trim(buf);
+    if (buf[0] == '\0') return;
+    run_query(buf);
+}
+
+/* ------------- PRECIOS: HISTORIAL Y RECALCULO ------------- */
+static void show_price_history(int code) {
+    int slot = price_hist_slot(code, 0);
+    if (slot < 0) { printf("Sin historial para el codigo %d.\n", code); return; }
+    printf("Historial de precios del codigo %d:\n", code);
+    for (int k = 0; k < ph_len[slot]; ++k) {
+        time_t t = (time_t)(price_hist_ts(slot, k) / 1000000LL);
+        char when[32];
+        strftime(when, sizeof(when), "%d/%m/%Y %H:%M:%S", localtime(&t));
+        printf("  desde %s  $%.2f\n", when, price_hist_price(slot, k));
+    }
+}
+
+/* Importe del mes si todas las ventas se hubieran cobrado con la lista de
+   precios vigente en ts. Por lotes: (1) se resuelve el precio de cada
+   venta con una cache por codigo, (2) un ciclo sin saltos multiplica y
+   acumula cant * precio sobre el lote. */
+static void recompute_revenue_as_of(long long ts) {
+    static double price_col[QUERY_BATCH];
+    long long t0 = now_ns();
+    double billed = 0.0, recalculated = 0.0;
+    long missing = 0;
+    int last_code = 0, have_last = 0;
+    double last_price = 0.0;
+    for (int b = 0; b < sale_count; b += QUERY_BATCH) {
+        int len = sale_count - b < QUERY_BATCH ? sale_count - b : QUERY_BATCH;
+        for (int k = 0; k < len; ++k) {
+            int code = SALE_CODE(b + k);
+            if (!have_last || code != last_code) {
+                double pr;
+                if (price_as_of(code, ts, &pr)) last_price = pr;
+                else { last_price = -1.0; }
+                last_code = code;
+                have_last = 1;
+            }
+            if (last_price < 0) { missing++; price_col[k] = SALE_AMOUNT(b + k) / (SALE_QTY(b + k) ? SALE_QTY(b + k) : 1); }
+            else price_col[k] = last_price;
+        }
+        double acc = 0.0, acc_billed = 0.0;
+        for (int k = 0; k < len; ++k) {
+            acc += SALE_QTY(b + k) * price_col[k];
+            acc_billed += SALE_AMOUNT(b + k);
+        }
+        recalculated += acc;
+        billed += acc_billed;
+    }
+    double secs = (now_ns() - t0) / 1e9;
+    printf("Ventas del mes: %d | Cobrado: $%.2f | Con precios vigentes a esa fecha: $%.2f | Diferencia: $%.2f\n",
+           sale_count, billed, recalculated, recalculated - billed);
+    if (missing) printf("%ld ventas de productos sin precio a esa fecha se tomaron al precio cobrado.\n", missing);
+    printf("(%.3f ms)\n", secs * 1e3);
+}
+
+/* dd/mm/aaaa [hh:mm] -> microsegundos (hora local) */
+static int parse_date_time_us(const char *text, long long *out) {
+    int d, mo, y, h = 23, mi = 59;
+    int n = sscanf(text, "%d/%d/%d %d:%d", &d, &mo, &y, &h, &mi);
+    if (n != 3 && n != 5) return 0;
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_mday = d; tm.tm_mon = mo - 1; tm.tm_year = y - 1900;
+    tm.tm_hour = h; tm.tm_min = mi; tm.tm_sec = (n == 3) ? 59 : 0;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1) return 0;
+    *out = (long long)t * 1000000LL + (n == 3 ? 999999 : 0);
+    return 1;
+}
+
+static void price_history_menu(void) {
+    char buf[MAX_INPUT];
+    printf("h = historial de un producto, r = recalcular ingresos del mes con precios de otra fecha: ");
+    read_line(buf, sizeof(buf)); trim(buf);
+    if (buf[0] == 'h') {
+        int code;
+        if (prompt_int("Codigo: ", &code)) show_price_history(code);
+    } else if (buf[0] == 'r') {
+        long long ts;
+        printf("Lista de precios vigente al (dd/mm/aaaa [hh:mm]): ");
+        read_line(buf, sizeof(buf)); trim(buf);
+        if (!parse_date_time_us(buf, &ts)) { printf("Fecha invalida.\n"); return; }
+        recompute_revenue_as_of(ts);
+    }
+}
+
 /* ------------- MENU PRINCIPAL ------------- */
 static void show_header(void) {
     printf("=========================================\n");
-    printf("Sistema de Farmacia (memoria volatile)\n");
-    printf("ATENCION: NO usa archivos. Todo se pierde si se corta la luz.\n");
+    printf("Sistema de Farmacia (datos en memoria)\n");
+    if (journal_fp) printf("Bitacora: %s (los cambios se recuperan al volver a arrancar)\n", journal_path);
+    else printf("ATENCION: sin bitacora (--registro). Todo se pierde al salir o si se corta la luz.\n");
     printf("=========================================\n");
 }
 
-int main(void) {
-    setbuf(stdout, NULL);
+/* Tareas pendientes que se hacen cuando no hay una operacion en curso */
+static void idle_tasks(void) {
+    journal_poll(0);
+    checkpoint_reap();
+    checkpoint_maybe_start();
+    feed_flush(1);          /* publicar ventas pendientes del stream */
+    metrics_periodic();     /* archivo Prometheus periodico */
+}
+
+/* ------------- MODO LOTE ------------- */
+/* pagina <filas> medicamentos [nombre|precio|stock|cobertura] [desc] [entre <min> <max>]
+   pagina <filas> ventas [dia <d>] [codigo <c>]
+   pagina <filas> <cursor>
+   Imprime una pagina en CSV y despues "cursor: <texto>" para pedir la
+   siguiente, o "cursor: fin". Todas las paginas de un cursor ven el estado
+   de cuando se pidio la primera. Devuelve 1 si imprimio la pagina, 0 si
+   el comando es invalido o el FARM_ERR_* de la pagina. */
+static int batch_page(char *arg) {
+    static int codes[BATCH_PAGE_MAX], stocks[BATCH_PAGE_MAX], otc[BATCH_PAGE_MAX], crit[BATCH_PAGE_MAX];
+    static double prices[BATCH_PAGE_MAX];
+    static char names[BATCH_PAGE_MAX][MAX_NAME_LEN];
+    static long long seqs[BATCH_PAGE_MAX];
+    char cursor[FARM_CURSOR_LEN];
+    char *tok = arg ? strtok(arg, " \t") : NULL;
+    int rows = tok ? atoi(tok) : 0, n;
+    if (rows <= 0) return 0;
+    if (rows > BATCH_PAGE_MAX) rows = BATCH_PAGE_MAX;
+    char *what = strtok(NULL, " \t");
+    if (!what) return 0;
+    if (strcmp(what, "medicamentos") == 0) {
+        int k = ORD_CATALOG, desc = 0;
+        double lo = -HUGE_VAL, hi = HUGE_VAL;
+        tok = strtok(NULL, " \t");
+        if (tok && strcmp(tok, "desc") != 0 && strcmp(tok, "entre") != 0) {
+            for (k = 0; k < ORD_KEYS && strcmp(tok, ord_key_names[k]) != 0; ++k) {}
+            if (k == ORD_KEYS) return 0;
+            tok = strtok(NULL, " \t");
+        }
+        if (tok && strcmp(tok, "desc") == 0) { desc = 1; tok = strtok(NULL, " \t"); }
+        if (tok && strcmp(tok, "entre") == 0) {
+            char *a = strtok(NULL, " \t"), *b = strtok(NULL, " \t");
+            if (!a || !b) return 0;
+            lo = atof(a); hi = atof(b); tok = NULL;
+        }
+        if (tok || farm_med_cursor(cursor, k, desc, lo, hi) != FARM_OK) return 0;
+    } else if (strcmp(what, "ventas") == 0) {
+        int day = 0, code = 0;
+        while ((tok = strtok(NULL, " \t")) != NULL) {
+            char *v = strtok(NULL, " \t");
+            if (!v) return 0;
+            if (strcmp(tok, "dia") == 0) day = atoi(v);
+            else if (strcmp(tok, "codigo") == 0) code = atoi(v);
+            else return 0;
+        }
+        farm_sales_cursor(cursor, day, code, 0);
+    } else if ((what[0] == 'M' || what[0] == 'V') && strlen(what) < FARM_CURSOR_LEN && !strtok(NULL, " \t")) {
+        strcpy(cursor, what);
+    } else return 0;
+
+    if (cursor[0] == 'M') {
+        n = farm_med_page(cursor, codes, names, prices, stocks, otc, crit, rows);
+        if (n < 0) return n;
+        printf("Codigo,Nombre,Precio,Stock,StockCritico,VentaLibre\n");
+        for (int r = 0; r < n; ++r) print_medicine_row(codes[r], names[r], prices[r], stocks[r], otc[r], crit[r], 1);
+    } else {
+        n = farm_sales_page(cursor, seqs, rows);
+        if (n < 0) return n;
+        printf("Dia,CodigoMedicamento,Cantidad,Importe,DNI\n");
+        for (int r = 0; r < n; ++r) {
+            int d, c, qty;
+            double amount;
+            char dni[DNI_LEN];
+            if (farm_sale_get(seqs[r], &d, &c, &qty, &amount, dni, sizeof(dni), NULL) == FARM_OK)
+                printf("%d,%d,%d,%.2f,%s\n", d, c, qty, amount, dni);
+        }
+    }
+    printf("cursor: %s\n", cursor[0] ? cursor : "fin");
+    return 1;
+}
+
+/* recepcion [sucursal <n>] <ruta>
+   recibir [sucursal <n>] <codigo>:<cantidad> ...
+   Remito desde un CSV o en la misma linea (ver RECEPCION DE MERCADERIA).
+   Devuelve -1 si el comando es invalido, 0 si la recepcion fallo. */
+static int batch_receive(char *arg, int from_file) {
+    int branch = 0;
+    if (!arg) return -1;
+    if (strncmp(arg, "sucursal", 8) == 0 && isspace((unsigned char)arg[8])) {
+        char *rest;
+        branch = (int)strtol(arg + 9, &rest, 10);
+        if (rest == arg + 9) return -1;
+        while (isspace((unsigned char)*rest)) rest++;
+        arg = rest;
+    }
+    if (from_file) return arg[0] ? receive_file(branch, arg) : -1;
+    int codes[MAX_INPUT], qtys[MAX_INPUT], n = 0;
+    long bad = 0;
+    long long t0 = now_ns();
+    for (char *tok = strtok(arg, " \t"); tok; tok = strtok(NULL, " \t")) {
+        if (n < MAX_INPUT && sscanf(tok, "%d:%d", &codes[n], &qtys[n]) == 2 && qtys[n] > 0) n++;
+        else bad++;
+    }
+    if (n + bad == 0) return -1;
+    return receive_report(branch, codes, qtys, n, bad, t0);
+}
+
+/* farmacia --lote [archivo]: ejecuta un comando por linea (stdin si no se
+   indica archivo). Lineas vacias y las que empiezan con '#' se ignoran.
+   No expone operaciones del dueno ni listados con DNI (consulta solo
+   devuelve agregados). */
+static int run_batch(FILE *in) {
+    char line[MAX_INPUT * 2];
+    int lineno = 0, errors = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        trim(line);
+        if (line[0] == '\0' || line[0] == '#') continue;
+        char *cmd = strtok(line, " \t");
+        char *arg = strtok(NULL, "");
+        if (arg) trim(arg);
+
+        if (strcmp(cmd, "metricas") == 0) print_metrics(stdout);
+        else if (strcmp(cmd, "prometheus") == 0) {
+            if (!arg || !write_metrics_prometheus(arg)) { printf("Linea %d: no se pudo escribir metricas.\n", lineno); errors++; }
+        }
+#ifdef FARMACIA_TRACE
+        else if (strcmp(cmd, "trazas") == 0) {
+            if (arg && strcmp(arg, "on") == 0) trace_enabled = 1;
+            else if (arg && strcmp(arg, "off") == 0) trace_enabled = 0;
+            else if (!arg || !trace_export_json(arg)) { printf("Linea %d: trazas on|off|<ruta.json>.\n", lineno); errors++; }
+        }
+#endif
+        else if (strcmp(cmd, "importar") == 0) {
+            if (arg) import_medicines_file(arg);
+            else { printf("Linea %d: falta ruta.\n", lineno); errors++; }
+        }
+        else if (strcmp(cmd, "carrito") == 0) {
+            /* carrito <dia> <dni|-> <codigo>:<cantidad> ... */
+            char *tok = arg ? strtok(arg, " \t") : NULL;
+            int day = tok ? atoi(tok) : 0;
+            char *dni = strtok(NULL, " \t");
+            int err = FARM_OK;
+            double total = 0.0;
+            cart_clear();
+            while (err == FARM_OK && (tok = strtok(NULL, " \t")) != NULL) {
+                int code, qty;
+                if (sscanf(tok, "%d:%d", &code, &qty) != 2) err = FARM_ERR_QTY;
+                else err = cart_add_line(code, qty);
+            }
+            if (err == FARM_OK) err = cart_commit(day, (dni && strcmp(dni, "-") != 0) ? dni : NULL, &total);
+            if (err != FARM_OK) { printf("Linea %d: %s\n", lineno, farm_error_text(err)); cart_clear(); errors++; }
+        }
+        else if (strcmp(cmd, "consulta") == 0) run_query(arg ? arg : "");
+        else if (strcmp(cmd, "congelar") == 0) freeze_catalog();
+        else if (strcmp(cmd, "precios") == 0) {
+            /* precios <codigo> | precios al <dd/mm/aaaa [hh:mm]> */
+            long long ts;
+            if (arg && strncmp(arg, "al ", 3) == 0 && parse_date_time_us(arg + 3, &ts)) recompute_revenue_as_of(ts);
+            else if (arg && isdigit((unsigned char)arg[0])) show_price_history(atoi(arg));
+            else { printf("Linea %d: precios <codigo> | precios al <fecha>.\n", lineno); errors++; }
+        }
+        else if (strcmp(cmd, "listar") == 0) {
+            /* listar [nombre|precio|stock|cobertura] [desc] [entre <min> <max>] */
+            char *key = arg ? strtok(arg, " \t") : NULL;
+            int k = 0, desc = 0;
+            double lo = -HUGE_VAL, hi = HUGE_VAL;
+            while (key && k < ORD_KEYS && strcmp(key, ord_key_names[k]) != 0) k++;
+            char *tok = key ? strtok(NULL, " \t") : NULL;
+            if (tok && strcmp(tok, "desc") == 0) { desc = 1; tok = strtok(NULL, " \t"); }
+            if (tok && strcmp(tok, "entre") == 0) {
+                char *a = strtok(NULL, " \t"), *b = strtok(NULL, " \t");
+                if (a && b) { lo = atof(a); hi = atof(b); tok = NULL; }
+            }
+            if (!key) list_medicines();
+            else if (k == ORD_KEYS || tok) { printf("Linea %d: listar [nombre|precio|stock|cobertura] [desc] [entre <min> <max>].\n", lineno); errors++; }
+            else list_medicines_paged(k, desc, lo, hi, 0, 0);
+        }
+        else if (strcmp(cmd, "pagina") == 0) {
+            int ok = batch_page(arg);
+            if (ok == 0) printf("Linea %d: pagina <filas> medicamentos|ventas [...] | pagina <filas> <cursor>.\n", lineno);
+            else if (ok < 0) printf("Linea %d: %s\n", lineno, farm_error_text(ok));
+            if (ok != 1) errors++;
+        }
+        else if (strcmp(cmd, "sucursal") == 0) {
+            /* sucursal <n> recibir <codigo> <cant> | vender <codigo> <cant> <dia> [dni] | csv_ventas */
+            char *tok = arg ? strtok(arg, " \t") : NULL;
+            int b = tok ? atoi(tok) : -1;
+            char *what = tok ? strtok(NULL, " \t") : NULL;
+            char *v[4];
+            int nv = 0, err = FARM_OK;
+            while (nv < 4 && (v[nv] = strtok(NULL, " \t")) != NULL) nv++;
+            if (b < 0 || b >= MAX_BRANCHES) err = FARM_ERR_BRANCH;
+            else if (what && strcmp(what, "recibir") == 0 && nv == 2) {
+                int code = atoi(v[0]), qty = atoi(v[1]), missing = 0;
+                int done = farm_receive(b, &code, &qty, 1, NULL, 0, &missing);
+                err = done < 0 ? done : missing ? FARM_ERR_CODE : FARM_OK;
+            }
+            else if (what && strcmp(what, "vender") == 0 && (nv == 3 || nv == 4))
+                err = farm_branch_sell(b, atoi(v[0]), atoi(v[1]), atoi(v[2]), nv == 4 ? v[3] : NULL, NULL);
+            else if (what && strcmp(what, "csv_ventas") == 0 && nv == 0) print_branch_sales_csv(b);
+            else { printf("Linea %d: sucursal <n> recibir|vender|csv_ventas ...\n", lineno); errors++; }
+            if (err != FARM_OK) { printf("Linea %d: %s\n", lineno, farm_error_text(err)); errors++; }
+        }
+        else if (strcmp(cmd, "consolidado") == 0) report_consolidated_monthly();
+        else if (strcmp(cmd, "recepcion") == 0 || strcmp(cmd, "recibir") == 0) {
+            int ok = batch_receive(arg, cmd[4] == 'p');
+            if (ok == -1) printf("Linea %d: recepcion [sucursal <n>] <ruta> | recibir [sucursal <n>] <codigo>:<cant> ...\n", lineno);
+            if (ok != 1) errors++;
+        }
+        else if (strcmp(cmd, "reposicion") == 0) {
+            /* reposicion [todos] */
+            if (arg && strcmp(arg, "todos") != 0) { printf("Linea %d: reposicion [todos].\n", lineno); errors++; }
+            else report_reorder(arg != NULL, 1);
+        }
+        else if (strcmp(cmd, "informe_mensual") == 0) report_monthly();
+        else if (strcmp(cmd, "csv_medicamentos") == 0) print_medicines_csv();
+        else if (strcmp(cmd, "csv_ventas") == 0) print_sales_csv();
+        else if (strcmp(cmd, "salir") == 0) break;
+        else { printf("Linea %d: comando desconocido '%s'.\n", lineno, cmd); errors++; }
+        idle_tasks();
+    }
+    return errors ? 1 : 0;
+}
+
+/* ------------- REPLICA DE SOLO LECTURA ------------- */
+/* farmacia --replica <bitacora>: otro proceso sigue la bitacora que escribe
+   el primario (--registro) y atiende los informes y exportaciones pesadas
+   sin frenar a las cajas. Mientras el menu espera una tecla se siguen
+   aplicando cambios cada REPLICA_POLL_MS. */
+#define REPLICA_POLL_MS 100
+
+static FILE *replica_fp = NULL;
+static char replica_path[MAX_INPUT] = "";
+static long long replica_lsn = 0;
+static long replica_pending = 0;        /* registros encontrados en el ultimo sondeo */
+static long long replica_lag_us = 0;    /* demora del ultimo registro aplicado */
+static long long replica_lag_max_us = 0;
+
+/* Aplica las lineas completas nuevas del archivo abierto */
+static long replica_drain(void) {
+    static char line[JOURNAL_MAX_LINE];
+    long found = 0;
+    while (1) {
+        long pos = ftell(replica_fp);
+        if (!fgets(line, sizeof(line), replica_fp)) { clearerr(replica_fp); break; }
+        size_t len = strlen(line);
+        if (line[len-1] != '\n') { fseek(replica_fp, pos, SEEK_SET); break; }  /* a medio escribir */
+        long long lsn = atoll(line);
+        if (lsn <= replica_lsn) continue;
+        if (lsn > replica_lsn + 1) {
+            /* el primario recorto registros que no llegamos a leer: partir de su imagen */
+            long long img = checkpoint_load(replica_path);
+            if (img < lsn - 1) { fseek(replica_fp, pos, SEEK_SET); break; }   /* imagen aun no lista */
+            replica_lsn = img;
+            if (lsn <= replica_lsn) continue;
+        }
+        long long ts = 0;
+        lsn = journal_apply_line(line, &ts);
+        found++;
+        if (!lsn) continue;
+        replica_lsn = lsn;
+        replica_lag_us = wall_clock_us() - ts;
+        if (replica_lag_us > replica_lag_max_us) replica_lag_max_us = replica_lag_us;
+    }
+    return found;
+}
+
+/* Aplica todo lo nuevo. Si el primario recorto la bitacora (archivo
+   reemplazado), termina el archivo viejo y sigue con el nuevo. */
+static void replica_poll(void) {
+    long found = replica_drain();
+#ifndef _WIN32
+    struct stat now_st, open_st;
+    if (stat(replica_path, &now_st) == 0 && fstat(fileno(replica_fp), &open_st) == 0 &&
+        now_st.st_ino != open_st.st_ino) {
+        FILE *fp = fopen(replica_path, "r");
+        if (fp) {
+            fclose(replica_fp);
+            replica_fp = fp;
+            found += replica_drain();
+        }
+    }
+#endif
+    if (found) replica_pending = found;
+}
+
+static void replica_status(void) {
+    printf("Replica: LSN aplicado %lld | registros en el ultimo sondeo %ld | demora ultimo %lld us (max %lld us)\n",
+           replica_lsn, replica_pending, replica_lag_us, replica_lag_max_us);
+    printf("Catalogo: %d medicamentos | Ventas del mes: %d | Sucursales: %d\n", med_count, sale_count, branch_count);
+}
+
+/* Espera una entrada del usuario sin dejar de aplicar la bitacora */
+static void replica_wait_input(void) {
+    replica_poll();
+    screen_flush();
+#ifndef _WIN32
+    if (!isatty(STDIN_FILENO)) return;
+    while (1) {
+        fd_set rd;
+        FD_ZERO(&rd);
+        FD_SET(STDIN_FILENO, &rd);
+        struct timeval tv = { 0, REPLICA_POLL_MS * 1000 };
+        if (select(STDIN_FILENO + 1, &rd, NULL, NULL, &tv) != 0) return;
+        replica_poll();
+        screen_flush();
+    }
+#endif
+}
+
+static int run_replica(const char *path) {
+    replica_fp = fopen(path, "r");
+    if (!replica_fp) { fprintf(stderr, "No se pudo abrir la bitacora %s\n", path); return 1; }
+    strncpy(replica_path, path, sizeof(replica_path) - 1); replica_path[sizeof(replica_path) - 1] = '\0';
+    replica_lsn = checkpoint_load(path);
+    screen_init();
+    replica_poll();
     int running = 1;
     while (running) {
+        idle_tasks();
+        printf("=========================================\n");
+        printf("Sistema de Farmacia - REPLICA de solo lectura (%s)\n", path);
+        printf("=========================================\n");
+        printf(" 2) Listar medicamentos\n");
+        printf(" 3) Mostrar medicamento por codigo\n");
+        printf(" 7) Informe mensual (pantalla)\n");
+        printf(" 8) Informe dia (dueno)\n");
+        printf(" 9) Mostrar registros RX (dueno)\n");
+        printf("10) Reporte stock critico (dueno)\n");
+        printf("13) Mostrar CSV medicamentos (pantalla)\n");
+        printf("14) Mostrar CSV ventas (pantalla)\n");
+        printf("17) Metricas de operaciones / Prometheus\n");
+        printf("20) Ventas por rango de dias y horas (dueno)\n");
+        printf("21) Ventas de un producto por dia/semana/mes/anio (dueno)\n");
+        printf("22) Estado de la replica (demora)\n");
+        printf("23) Consulta ad-hoc sobre ventas (dueno)\n");
+        printf("24) Historial de precios / recalcular ingresos (dueno)\n");
+        printf("26) Listar ordenado / por rango (precio, stock...)\n");
+        printf("27) Cerrar sesion del dueno\n");
+        printf("28) Sucursales: stock e informes consolidados\n");
+        printf("29) Demanda estimada y reposicion sugerida (dueno)\n");
+        printf(" 0) Salir\n");
+        printf("---------------------------------\n");
+        printf("Seleccione opcion: ");
+        replica_wait_input();
+
+        int option;
+        if (!prompt_int("", &option)) { printf("Entrada vacia. Volviendo al menu.\n"); continue; }
+        replica_poll();   /* informar con lo ultimo recibido */
+        switch (option) {
+            case 2: browse_medicines(0); break;
+            case 3: show_medicine_by_code(); break;
+            case 7: report_monthly(); break;
+            case 8: if (authenticate_owner()) report_day(); else printf("No autorizado.\n"); break;
+            case 9: if (authenticate_owner()) list_sales_paged(0, 0, 1, 1); else printf("No autorizado.\n"); break;
+            case 10: if (authenticate_owner()) report_stock_critical(); else printf("No autorizado.\n"); break;
+            case 13: browse_medicines(1); break;
+            case 14: list_sales_paged(0, 0, 0, 1); break;
+            case 17: show_metrics(); break;
+            case 20: if (authenticate_owner()) report_time_range_prompt(); else printf("No autorizado.\n"); break;
+            case 21: if (authenticate_owner()) report_product_rollup_prompt(); else printf("No autorizado.\n"); break;
+            case 22: replica_status(); break;
+            case 23: if (authenticate_owner()) run_query_prompt(); else printf("No autorizado.\n"); break;
+            case 24: if (authenticate_owner()) price_history_menu(); else printf("No autorizado.\n"); break;
+            case 26: list_medicines_ordered_prompt(); break;
+            case 27: close_owner_session(); break;
+            case 28: branch_menu(1); break;
+            case 29: if (authenticate_owner()) report_reorder_prompt(); else printf("No autorizado.\n"); break;
+            case 0: running = 0; break;
+            default: printf("Opcion no disponible en la replica.\n"); break;
+        }
+        printf("\nPresione ENTER para continuar...");
+        replica_wait_input();
+        char tmp[MAX_INPUT];
+        read_line(tmp, sizeof(tmp));
+    }
+    fclose(replica_fp);
+    return 0;
+}
+
+/* Resumen de una reproduccion (a stderr, stdout esta silenciado) */
+static void replay_report(void) {
+    double secs = (now_ns() - replay_start_ns) / 1e9;
+    unsigned long long ops = 0;
+    for (int op = 0; op < OP_COUNT; ++op) ops += metric_count[op];
+    char pace[32] = "maxima";
+    if (replay_speed > 0) snprintf(pace, sizeof(pace), "x%.2g", replay_speed);
+    fprintf(stderr, "Reproduccion: %ld entradas en %.3f s (original %.3f s, velocidad %s)\n",
+            replay_records, secs, replay_orig_us / 1e6, pace);
+    fprintf(stderr, "Operaciones: %llu (%.0f op/s)\n", ops, secs > 0 ? ops / secs : 0.0);
+    for (int op = 0; op < OP_COUNT; ++op)
+        if (metric_count[op]) fprintf(stderr, "  %-21s %8llu  %10.0f op/s\n", op_names[op], metric_count[op], secs > 0 ? metric_count[op] / secs : 0.0);
+    print_metrics(stderr);
+    fclose(replay_fp);
+}
+
+#ifdef FARMACIA_SIN_MENU
+int farmacia_menu_main(int argc, char **argv) {
+#else
+int main(int argc, char **argv) {
+#endif
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);   /* un lector de FIFO que se va no debe cerrar el programa */
+#endif
+    /* opciones: [--recuperacion-ms N] [--registro <bitacora>] [--lote [archivo]]
+                [--grabar <archivo> | --reproducir <archivo> [--velocidad N]] | --replica <bitacora> */
+    int batch = 0;
+    const char *batch_path = NULL, *journal_arg = NULL;
+    for (int a = 1; a < argc; ++a) {
+        if (strcmp(argv[a], "--replica") == 0 && a + 1 < argc) return run_replica(argv[a + 1]);
+        else if (strcmp(argv[a], "--registro") == 0 && a + 1 < argc) journal_arg = argv[++a];
+        else if (strcmp(argv[a], "--registro-io") == 0 && a + 1 < argc) {
+            if (farm_journal_mode(argv[++a]) != FARM_OK) { fprintf(stderr, "%s\n", farm_error_text(FARM_ERR_JOURNAL_MODE)); return 1; }
+        }
+        else if (strcmp(argv[a], "--recuperacion-ms") == 0 && a + 1 < argc) {
+            recovery_bound_ms = atoll(argv[++a]);
+            if (recovery_bound_ms <= 0) recovery_bound_ms = 200;
+        }
+        else if (strcmp(argv[a], "--lote") == 0) {
+            batch = 1;
+            if (a + 1 < argc && argv[a + 1][0] != '-') batch_path = argv[++a];
+        }
+        else if (strcmp(argv[a], "--grabar") == 0 && a + 1 < argc) {
+            if (!rec_open(argv[++a])) { fprintf(stderr, "No se pudo crear %s\n", argv[a]); return 1; }
+        }
+        else if (strcmp(argv[a], "--reproducir") == 0 && a + 1 < argc) {
+            if (!replay_open(argv[++a])) { fprintf(stderr, "No se pudo abrir la grabacion %s\n", argv[a]); return 1; }
+        }
+        else if (strcmp(argv[a], "--velocidad") == 0 && a + 1 < argc) replay_speed = atof(argv[++a]);
+        else {
+            fprintf(stderr, "Uso: %s [--recuperacion-ms N] [--registro <bitacora> [--registro-io sin_sync|fdatasync|uring]]\n"
+                            "       [--lote [archivo]]"
+                            " [--grabar <archivo> | --reproducir <archivo> [--velocidad N]] | --replica <bitacora>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (journal_arg && farm_open(journal_arg) != FARM_OK) { fprintf(stderr, "No se pudo abrir la bitacora %s\n", journal_arg); return 1; }
+    if (batch) {
+        FILE *in = stdin;
+        if (batch_path && !(in = fopen(batch_path, "r"))) { fprintf(stderr, "No se pudo abrir %s\n", batch_path); return 1; }
+        int rc = run_batch(in);
+        if (in != stdin) fclose(in);
+        feed_flush(1);
+        feed_close();
+        farm_close();
+        return rc;
+    }
+
+    if (replay_fp) {
+        /* la reproduccion no dibuja pantallas: solo interesa el informe final */
+#ifdef _WIN32
+        if (!freopen("NUL", "w", stdout)) return 1;
+#else
+        if (!freopen("/dev/null", "w", stdout)) return 1;
+#endif
+    }
+    screen_init();
+    int running = 1;
+    while (running && !replay_done) {
+        idle_tasks();
         show_header();
         printf("Opciones:\n");
         printf(" 1) Agregar medicamento\n");
@@ -449,6 +6613,21 @@ int main(void) {
         printf("12) Cambiar contrasena (dueno)\n");
         printf("13) Mostrar CSV medicamentos (pantalla)\n");
         printf("14) Mostrar CSV ventas (pantalla)\n");
+        printf("15) Importar CSV medicamentos (archivo)\n");
+        printf("16) Stream de ventas a FIFO/archivo (dueno)\n");
+        printf("17) Metricas de operaciones / Prometheus\n");
+        printf("18) Trazas de venta (activar / exportar JSON)\n");
+        printf("19) Venta multiple (carrito)\n");
+        printf("20) Ventas por rango de dias y horas (dueno)\n");
+        printf("21) Ventas de un producto por dia/semana/mes/anio (dueno)\n");
+        printf("23) Consulta ad-hoc sobre ventas (dueno)\n");
+        printf("24) Historial de precios / recalcular ingresos (dueno)\n");
+        printf("25) Congelar catalogo (busqueda con hash perfecto) (dueno)\n");
+        printf("26) Listar ordenado / por rango (precio, stock...)\n");
+        printf("27) Cerrar sesion del dueno\n");
+        printf("28) Sucursales: ventas, stock e informes consolidados\n");
+        printf("29) Demanda estimada y reposicion sugerida (dueno)\n");
+        printf("30) Recepcion de mercaderia (remito CSV)\n");
         printf(" 0) Salir\n");
         printf("---------------------------------\n");
 
@@ -457,7 +6636,7 @@ int main(void) {
 
         switch (option) {
             case 1: add_medicine(); break;
-            case 2: list_medicines(); break;
+            case 2: browse_medicines(0); break;
             case 3: show_medicine_by_code(); break;
             case 4:
                 if (authenticate_owner()) edit_medicine();
@@ -474,7 +6653,7 @@ int main(void) {
                 else printf("No autorizado.\n");
                 break;
             case 9:
-                if (authenticate_owner()) show_rx_records();
+                if (authenticate_owner()) list_sales_paged(0, 0, 1, 1);
                 else printf("No autorizado.\n");
                 break;
             case 10:
@@ -495,22 +6674,71 @@ int main(void) {
                 else printf("No autorizado.\n");
                 break;
             case 13:
-                /* Imprime CSV de medicamentos en pantalla (sin usar archivos) */
-                print_medicines_csv();
+                /* Imprime CSV de medicamentos en pantalla (sin usar archivos), por paginas */
+                browse_medicines(1);
                 break;
             case 14:
-                /* Imprime CSV de ventas en pantalla (sin usar archivos) */
-                print_sales_csv();
+                /* Imprime CSV de ventas en pantalla (sin usar archivos), por paginas */
+                list_sales_paged(0, 0, 0, 1);
+                break;
+            case 15: import_medicines_csv(); break;
+            case 16:
+                if (authenticate_owner()) configure_sales_feed();
+                else printf("No autorizado.\n");
+                break;
+            case 17: show_metrics(); break;
+            case 18: configure_trace(); break;
+            case 19: sell_cart(); break;
+            case 20:
+                if (authenticate_owner()) report_time_range_prompt();
+                else printf("No autorizado.\n");
+                break;
+            case 21:
+                if (authenticate_owner()) report_product_rollup_prompt();
+                else printf("No autorizado.\n");
+                break;
+            case 23:
+                if (authenticate_owner()) run_query_prompt();
+                else printf("No autorizado.\n");
+                break;
+            case 24:
+                if (authenticate_owner()) price_history_menu();
+                else printf("No autorizado.\n");
+                break;
+            case 25:
+                if (authenticate_owner()) freeze_catalog();
+                else printf("No autorizado.\n");
+                break;
+            case 26: list_medicines_ordered_prompt(); break;
+            case 27: close_owner_session(); break;
+            case 28: branch_menu(0); break;
+            case 29:
+                if (authenticate_owner()) report_reorder_prompt();
+                else printf("No autorizado.\n");
                 break;
+            case 30: receive_prompt(); break;
             case 0: running = 0; break;
             default: printf("Opcion invalida.\n"); break;
         }
 
         printf("\nPresione ENTER para continuar...");
+        journal_poll(1);   /* lo que quedo en la arena sale mientras el usuario lee */
         char tmp[MAX_INPUT];
         read_line(tmp, sizeof(tmp));
     }
 
+    feed_flush(1);
+    feed_close();
+    if (replay_fp) replay_report();
+    if (rec_fp) { rec_password_result(0); fclose(rec_fp); }
+    if (journal_fp) {
+#ifndef _WIN32
+        if (ckpt_pid != -1) { waitpid(ckpt_pid, NULL, 0); ckpt_pid = -1; }
+#endif
+        farm_close();
+        printf("Saliendo. Los cambios quedaron en la bitacora.\n");
+        return 0;
+    }
     printf("Saliendo. Todos los datos en memoria seran perdidos.\n");
     return 0;
 }
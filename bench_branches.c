@@ -0,0 +1,67 @@
+/* bench_branches.c
+   Mide las sucursales (ver DATOS: particiones por sucursal en
+   Final_TpIA_Yuri_Arancibia.c): venta por sucursal y los informes
+   consolidados (mensual, dia y stock critico) recorriendo las particiones
+   una tras otra o en paralelo (un hilo por sucursal).
+   - Compilar y correr:
+     gcc -std=c11 -O2 bench_branches.c -o bench_branches && ./bench_branches
+     (en glibc anteriores a 2.34 agregar -pthread)
+   La mejora del modo paralelo depende de los nucleos libres: con un solo
+   nucleo las dos columnas dan parecido. Resultados a stderr. */
+
+#define _GNU_SOURCE
+#define MAX_MEDICINES 100000
+#define MAX_SALES 1000000
+#define FARMACIA_SIN_MENU
+#include "Final_TpIA_Yuri_Arancibia.c"
+
+#define BENCH_SALES_PER_BRANCH 1000000
+#define BENCH_REPORT_REPS 20
+
+static unsigned bench_rand_state = 12345u;
+static unsigned bench_rand(void) {
+    bench_rand_state = bench_rand_state * 1103515245u + 12345u;
+    return bench_rand_state >> 8;
+}
+
+/* ns por repeticion de un informe consolidado con el umbral de hilos dado */
+static double bench_report(int which, long long min_rows) {
+    static int branches[MAX_BRANCHES * MAX_MEDICINES], codes[MAX_BRANCHES * MAX_MEDICINES];
+    double total;
+    int count;
+    branch_parallel_min_rows = min_rows;
+    long long t0 = now_ns();
+    for (int r = 0; r < BENCH_REPORT_REPS; ++r) {
+        if (which == 0) farm_branch_month_summary(FARM_ALL_BRANCHES, &total, &count, NULL);
+        else if (which == 1) farm_branch_day_summary(FARM_ALL_BRANCHES, 1 + r % DAYS_IN_MONTH, &total, &count);
+        else farm_branch_stock_critical(FARM_ALL_BRANCHES, branches, codes, MAX_BRANCHES * MAX_MEDICINES);
+    }
+    return (double)(now_ns() - t0) / BENCH_REPORT_REPS;
+}
+
+int main(void) {
+    static const char *reports[] = { "mensual", "dia", "stock_critico" };
+    char name[MAX_NAME_LEN];
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+    for (int i = 0; i < MAX_MEDICINES; ++i) {
+        snprintf(name, sizeof(name), "Medicamento %d", i + 1);
+        farm_med_add(i + 1, name, 1.0 + i % 97, 1000000, i % 3 != 0, i % 50);
+        for (int b = 1; b < MAX_BRANCHES; ++b) farm_branch_set_stock(b, i + 1, (int)(bench_rand() % 100000));
+    }
+
+    fprintf(stderr, "Sucursal      Ventas   ns/venta\n");
+    for (int b = 0; b < MAX_BRANCHES; ++b) {
+        long long t0 = now_ns();
+        for (int k = 0; k < BENCH_SALES_PER_BRANCH; ++k)
+            farm_branch_sell(b, 1 + (int)(bench_rand() % MAX_MEDICINES), 1, 1 + k % DAYS_IN_MONTH, "30111222", NULL);
+        fprintf(stderr, "%8d %11d %10.1f\n", b, BENCH_SALES_PER_BRANCH, (double)(now_ns() - t0) / BENCH_SALES_PER_BRANCH);
+    }
+
+    fprintf(stderr, "\nInforme consolidado   secuencial (ms)   paralelo (ms)   (%d sucursales, %d ventas c/u)\n",
+            farm_branch_count(), BENCH_SALES_PER_BRANCH);
+    for (int w = 0; w < 3; ++w) {
+        double seq = bench_report(w, 1LL << 62), par = bench_report(w, 0);
+        fprintf(stderr, "%-20s %17.3f %15.3f\n", reports[w], seq / 1e6, par / 1e6);
+    }
+    return 0;
+}
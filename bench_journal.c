@@ -0,0 +1,84 @@
+/* bench_journal.c
+   Compara las formas de escribir la bitacora (--registro-io, ver
+   journal_io_mode en Final_TpIA_Yuri_Arancibia.c) con la misma carga:
+   BENCH_SALES ventas de a una, cada una con su commit.
+   - sin_sync  write() sin sincronizar (no sobrevive a un corte de luz)
+   - fdatasync write() + fdatasync() antes de devolver la venta
+   - uring     cadena write -> fsync encolada en io_uring; la venta vuelve
+               sin esperar al disco
+   - Compilar y correr:
+     gcc -std=c11 -O2 bench_journal.c -o bench_journal && ./bench_journal [directorio]
+   La bitacora se crea en el directorio indicado (por defecto el actual);
+   conviene que sea el disco real y no /tmp en memoria, si no fdatasync no
+   cuesta nada. Por cada modo: latencia de la venta (lo que espera la caja:
+   mediana, p99 y maximo), tiempo total de las ventas, lo que tarda despues
+   en quedar todo en disco (farm_close) y ventas durables por segundo. */
+
+#define _GNU_SOURCE
+#define MAX_MEDICINES 1000
+#define MAX_SALES 100000
+#define FARMACIA_SIN_MENU
+#include "Final_TpIA_Yuri_Arancibia.c"
+
+#define BENCH_SALES 20000
+#define BENCH_MEDS MAX_MEDICINES
+
+static long long bench_lat[BENCH_SALES];
+
+static int bench_cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_mode(const char *dir, const char *mode) {
+    char path[MAX_INPUT], name[MAX_NAME_LEN];
+    snprintf(path, sizeof(path), "%s/bench_journal_%s.log", dir, mode);
+    remove(path);
+    farm_reset();
+    recovery_bound_ms = 1000000000LL;   /* sin checkpoints durante la medicion */
+    if (farm_journal_mode(mode) != FARM_OK || farm_open(path) != FARM_OK) {
+        fprintf(stderr, "%-10s no se pudo abrir %s\n", mode, path);
+        return;
+    }
+    if (strcmp(jio_mode_names[journal_io_mode], mode) != 0) {
+        fprintf(stderr, "%-10s no disponible (se uso %s)\n", mode, jio_mode_names[journal_io_mode]);
+        farm_close();
+        remove(path);
+        return;
+    }
+    for (int i = 0; i < BENCH_MEDS; ++i) {
+        snprintf(name, sizeof(name), "Medicamento %d", i + 1);
+        farm_med_add(i + 1, name, 1.0 + i % 97, 1000000, i % 3 != 0, i % 50);
+    }
+    journal_drain();
+
+    long long t0 = now_ns();
+    for (int k = 0; k < BENCH_SALES; ++k) {
+        long long s0 = now_ns();
+        int err = farm_sell(1 + k % BENCH_MEDS, 1, 1 + k % DAYS_IN_MONTH, "30111222", NULL);
+        if (err != FARM_OK) {
+            fprintf(stderr, "%-10s venta %d: %s\n", mode, k, farm_error_text(err));
+            break;
+        }
+        bench_lat[k] = now_ns() - s0;
+    }
+    long long t1 = now_ns();
+    farm_close();
+    long long t2 = now_ns();
+
+    qsort(bench_lat, BENCH_SALES, sizeof(bench_lat[0]), bench_cmp_ll);
+    fprintf(stderr, "%-10s %8d %10.1f %10.1f %10.1f %10.1f %10.1f %12.0f\n", mode, BENCH_SALES,
+            bench_lat[BENCH_SALES / 2] / 1e3, bench_lat[BENCH_SALES * 99 / 100] / 1e3, bench_lat[BENCH_SALES - 1] / 1e3,
+            (t1 - t0) / 1e6, (t2 - t1) / 1e6, BENCH_SALES / ((t2 - t0) / 1e9));
+    remove(path);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : ".";
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+    fprintf(stderr, "Modo         Ventas   p50 (us)   p99 (us)   max (us) ventas (ms)  disco (ms) durables/s\n");
+    bench_mode(dir, "sin_sync");
+    bench_mode(dir, "fdatasync");
+    bench_mode(dir, "uring");
+    return 0;
+}
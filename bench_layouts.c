@@ -0,0 +1,178 @@
+/* bench_layouts.c
+   Compara las disposiciones en memoria del motor (FARM_LAYOUT, ver
+   Final_TpIA_Yuri_Arancibia.c): busqueda por codigo, venta, informes,
+   rango de precios por indice ordenado y exportaciones CSV con catalogos
+   y meses de distinto tamano.
+   - Compilar y correr una disposicion:
+     gcc -std=c11 -O2 -DFARM_LAYOUT=1 bench_layouts.c -o bench_aos && ./bench_aos
+     (0 = SoA, 1 = AoS, 2 = AoSoA, 3 = caliente/frio; -DLAYOUT_BLOCK=N cambia
+     el bloque AoSoA)
+   - La matriz completa: sh bench_layouts.sh
+   Las exportaciones y la consulta escriben a /dev/null; los resultados van
+   a stderr, una linea por (tamano, operacion). En Linux, si el kernel deja
+   leer los contadores de hardware (perf_event_paranoid <= 2), cada linea
+   trae tambien fallos de cache L1d y de ultimo nivel (LLC) por operacion.
+   El ultimo tamano (catalogo de 1M, mucho mas grande que L2) es el que
+   muestra la diferencia del catalogo partido caliente/frio. */
+
+#define _GNU_SOURCE
+#define MAX_MEDICINES 1000000
+#define MAX_SALES 1000000
+#define FARMACIA_SIN_MENU
+#include "Final_TpIA_Yuri_Arancibia.c"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#define BENCH_LOOKUPS 2000000
+#define BENCH_REPORT_REPS 20
+
+static const char *bench_layout_name(void) {
+#if FARM_LAYOUT == FARM_LAYOUT_SOA
+    return "SoA";
+#elif FARM_LAYOUT == FARM_LAYOUT_AOS
+    return "AoS";
+#elif FARM_LAYOUT == FARM_LAYOUT_AOSOA
+    return "AoSoA";
+#else
+    return "HotCold";
+#endif
+}
+
+/* Contadores de hardware: 0 = fallos de lectura L1d, 1 = fallos LLC.
+   fd -1 = no disponible (sin PMU en la maquina virtual, permisos, etc.). */
+static int bench_perf_fd[2] = { -1, -1 };
+static long long bench_perf_start[2];
+static long long bench_t0;
+
+static void bench_perf_open(void) {
+#ifdef __linux__
+    static const unsigned long long config[2] = {
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+    for (int k = 0; k < 2; ++k) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = k == 0 ? PERF_TYPE_HW_CACHE : PERF_TYPE_HARDWARE;
+        attr.config = config[k];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        bench_perf_fd[k] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+static long long bench_perf_read(int k) {
+    long long v = 0;
+    if (bench_perf_fd[k] < 0 || read(bench_perf_fd[k], &v, sizeof(v)) != sizeof(v)) return -1;
+    return v;
+}
+
+static void bench_begin(void) {
+    for (int k = 0; k < 2; ++k) bench_perf_start[k] = bench_perf_read(k);
+    bench_t0 = now_ns();
+}
+
+static unsigned bench_rand_state = 12345u;
+static unsigned bench_rand(void) {
+    bench_rand_state = bench_rand_state * 1103515245u + 12345u;
+    return bench_rand_state >> 8;
+}
+
+static void bench_end(int meds, int sales, const char *op, long long ops) {
+    long long ns = now_ns() - bench_t0;
+    char miss[2][24];
+    for (int k = 0; k < 2; ++k) {
+        long long v = bench_perf_read(k);
+        if (v < 0 || bench_perf_start[k] < 0) snprintf(miss[k], sizeof(miss[k]), "-");
+        else snprintf(miss[k], sizeof(miss[k]), "%.2f", (double)(v - bench_perf_start[k]) / (double)ops);
+    }
+    fprintf(stderr, "%-7s %7d %8d  %-18s %12.1f ns/op %10.3f ms %10s %10s\n",
+            bench_layout_name(), meds, sales, op, (double)ns / (double)ops, ns / 1e6, miss[0], miss[1]);
+}
+
+static void bench_size(int meds, int sales) {
+    char name[MAX_NAME_LEN];
+    farm_reset();
+    for (int i = 0; i < meds; ++i) {
+        snprintf(name, sizeof(name), "Medicamento %d", i + 1);
+        farm_med_add(i + 1, name, 1.0 + i % 97, 1000000, i % 3 != 0, i % 50);
+    }
+
+    bench_begin();
+    long long found = 0;
+    for (int k = 0; k < BENCH_LOOKUPS; ++k) {
+        int stock;
+        if (farm_med_get(1 + (int)(bench_rand() % (unsigned)meds), NULL, 0, NULL, &stock, NULL, NULL) == FARM_OK) found += stock;
+    }
+    bench_end(meds, sales, "buscar", BENCH_LOOKUPS);
+    if (found == 0) fprintf(stderr, "?\n");
+
+    /* la misma busqueda con el catalogo congelado (hash perfecto) */
+    if (farm_catalog_freeze(NULL) == FARM_OK) {
+        bench_begin();
+        for (int k = 0; k < BENCH_LOOKUPS; ++k) {
+            int stock;
+            if (farm_med_get(1 + (int)(bench_rand() % (unsigned)meds), NULL, 0, NULL, &stock, NULL, NULL) == FARM_OK) found += stock;
+        }
+        bench_end(meds, sales, "buscar_congelado", BENCH_LOOKUPS);
+    }
+
+    bench_begin();
+    for (int k = 0; k < sales; ++k)
+        farm_sell(1 + (int)(bench_rand() % (unsigned)meds), 1 + (int)(bench_rand() % 3), 1 + k % DAYS_IN_MONTH, "30111222", NULL);
+    bench_end(meds, sales, "vender", sales);
+
+    double total;
+    int count, per_day[DAYS_IN_MONTH + 1];
+    bench_begin();
+    for (int r = 0; r < BENCH_REPORT_REPS; ++r) farm_month_summary(&total, &count, per_day);
+    bench_end(meds, sales, "informe_mensual", BENCH_REPORT_REPS);
+
+    bench_begin();
+    for (int r = 0; r < BENCH_REPORT_REPS; ++r) farm_day_summary(1 + r % DAYS_IN_MONTH, &total, &count);
+    bench_end(meds, sales, "informe_dia", BENCH_REPORT_REPS);
+
+    bench_begin();
+    for (int r = 0; r < BENCH_REPORT_REPS; ++r) farm_stock_critical(NULL, 0);
+    bench_end(meds, sales, "stock_critico", BENCH_REPORT_REPS);
+
+    static int codes[BATCH_PAGE_MAX];
+    char cursor[FARM_CURSOR_LEN];
+    long long listed = 0;
+    int n;
+    bench_begin();
+    for (int r = 0; r < BENCH_REPORT_REPS; ++r) {
+        farm_med_cursor(cursor, ORD_PRICE, 0, 10.0, 11.0);
+        while ((n = farm_med_page(cursor, codes, NULL, NULL, NULL, NULL, NULL, BATCH_PAGE_MAX)) > 0) listed += n;
+    }
+    bench_end(meds, sales, "rango_precio", BENCH_REPORT_REPS);
+    if (listed == 0) fprintf(stderr, "?\n");
+
+    bench_begin();
+    run_query("donde tipo=rx por codigo suma importe orden suma_importe desc limite 10");
+    bench_end(meds, sales, "consulta", 1);
+
+    bench_begin();
+    print_medicines_csv();
+    fflush(stdout);
+    bench_end(meds, sales, "csv_medicamentos", 1);
+
+    bench_begin();
+    print_sales_csv();
+    fflush(stdout);
+    bench_end(meds, sales, "csv_ventas", 1);
+}
+
+int main(void) {
+    static const int sizes[][2] = { { 1000, 10000 }, { 10000, 100000 }, { 100000, 1000000 }, { 1000000, 1000000 } };
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+    bench_perf_open();
+    fprintf(stderr, "Disp.   Catalogo   Ventas  Operacion                 Tiempo/op          Total   L1d/op     LLC/op\n");
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) bench_size(sizes[k][0], sizes[k][1]);
+    return 0;
+}
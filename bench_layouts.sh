@@ -0,0 +1,10 @@
+#!/bin/sh
+# Matriz de bench_layouts.c: compila y corre el benchmark con cada
+# disposicion de filas (SoA, AoS, AoSoA, caliente/frio). Uso: sh bench_layouts.sh
+set -e
+CC=${CC:-gcc}
+for layout in 0 1 2 3; do
+    $CC -std=c11 -O2 -DFARM_LAYOUT=$layout bench_layouts.c -o bench_layout_$layout
+    ./bench_layout_$layout
+    rm -f bench_layout_$layout
+done
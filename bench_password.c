@@ -0,0 +1,79 @@
+/* bench_password.c
+   Comprueba el SHA-256 y el PBKDF2-HMAC-SHA256 escritos a mano (ver
+   CONTRASENA DEL DUENO en Final_TpIA_Yuri_Arancibia.c) contra valores
+   conocidos (FIPS 180-2 y RFC 7914, seccion 11) y mide lo que cuesta
+   verificar la contrasena del dueno, sin grabar y grabando (--grabar; la
+   grabacion no agrega otro PBKDF2).
+   - Compilar y correr:
+     gcc -std=c11 -O2 bench_password.c -o bench_password && ./bench_password
+   Sale con 1 si algun valor conocido no coincide. Resultados a stderr. */
+
+#define _GNU_SOURCE
+#define FARMACIA_SIN_MENU
+#include "Final_TpIA_Yuri_Arancibia.c"
+
+#define BENCH_REPS 5
+
+static int bench_failed = 0;
+
+static void bench_expect(const char *what, const unsigned char *got, const char *hex) {
+    char buf[2 * SHA256_LEN + 1];
+    for (int b = 0; b < SHA256_LEN; ++b) snprintf(buf + 2 * b, 3, "%02x", got[b]);
+    int ok = strcmp(buf, hex) == 0;
+    fprintf(stderr, "%-34s %s\n", what, ok ? "ok" : "FALLA");
+    if (!ok) { fprintf(stderr, "  esperado %s\n  obtenido %s\n", hex, buf); bench_failed = 1; }
+}
+
+static void bench_sha256(const char *what, const char *msg, const char *hex) {
+    unsigned char h[SHA256_LEN];
+    sha256_from(sha256_iv, 0, (const unsigned char *)msg, strlen(msg), h);
+    bench_expect(what, h, hex);
+}
+
+static void bench_pbkdf2(const char *what, const char *password, const char *salt, long iters, const char *hex) {
+    unsigned char h[SHA256_LEN];
+    pbkdf2_sha256(password, (const unsigned char *)salt, strlen(salt), iters, h);
+    bench_expect(what, h, hex);
+}
+
+int main(void) {
+    char long_key[101];
+    memset(long_key, 'x', 100);
+    long_key[100] = '\0';
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+
+    /* pbkdf2_sha256 da solo el primer bloque: se comparan los primeros 32
+       bytes de los valores de 64 del RFC */
+    bench_sha256("SHA-256 \"\"", "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    bench_sha256("SHA-256 \"abc\"", "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    bench_sha256("SHA-256 448 bits (dos bloques)", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                 "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    bench_pbkdf2("PBKDF2 passwd/salt c=1", "passwd", "salt", 1,
+                 "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc");
+    bench_pbkdf2("PBKDF2 Password/NaCl c=80000", "Password", "NaCl", 80000,
+                 "4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56");
+    bench_pbkdf2("PBKDF2 clave de 100 bytes c=2", long_key, "0123456789abcdef", 2,
+                 "97c71b2834f0a23b97ed0703a4512b7f2897b055e6e2a9b3c5676302f3eeec89");
+    if (bench_failed) return 1;
+
+    owner_password_store(OWNER_DEFAULT_PASSWORD);
+    long long t0 = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r) owner_password_matches(OWNER_DEFAULT_PASSWORD);
+    double plain = (double)(now_ns() - t0) / BENCH_REPS;
+    rec_fp = tmpfile();
+    if (!rec_fp) return 1;
+    t0 = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r) {
+        rec_write_password(OWNER_DEFAULT_PASSWORD);                          /* lo que graba --grabar */
+        rec_password_result(owner_password_matches(OWNER_DEFAULT_PASSWORD));   /* el login que sigue */
+    }
+    double recorded = (double)(now_ns() - t0) / BENCH_REPS;
+    rewind(rec_fp);
+    if (fgetc(rec_fp) != REC_PASS_OK) { fprintf(stderr, "grabacion: FALLA\n"); return 1; }
+    fclose(rec_fp);
+    rec_fp = NULL;
+    fprintf(stderr, "\nPBKDF2 de %d iteraciones\n", OWNER_HASH_ITERS);
+    fprintf(stderr, "%-34s %8.1f ms\n", "Verificar", plain / 1e6);
+    fprintf(stderr, "%-34s %8.1f ms\n", "Grabar y verificar", recorded / 1e6);
+    return 0;
+}
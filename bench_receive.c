@@ -0,0 +1,85 @@
+/* bench_receive.c
+   Mide la recepcion de mercaderia (farm_receive, ver RECEPCION DE
+   MERCADERIA en Final_TpIA_Yuri_Arancibia.c) contra buscar renglon por
+   renglon en el hash y sumar el stock, con catalogos de distinto tamano y
+   un remito de BENCH_ROWS renglones al azar (incluye codigos repetidos y
+   desconocidos).
+   - Compilar y correr:
+     gcc -std=c11 -O2 bench_receive.c -o bench_receive && ./bench_receive
+   "cruce (primero)" incluye armar el catalogo en orden de codigo, que se
+   hace una sola vez (despues las altas y bajas lo corrigen en su lugar);
+   "cruce" es con el orden ya armado. "baja y alta" mide corregirlo: la
+   baja de un producto de la mitad del orden y su alta de nuevo (incluye
+   lo que cuestan en el resto del catalogo).
+   Resultados a stderr. */
+
+#define _GNU_SOURCE
+#define MAX_MEDICINES 1000000
+#define MAX_SALES 1000
+#define FARMACIA_SIN_MENU
+#include "Final_TpIA_Yuri_Arancibia.c"
+
+#define BENCH_ROWS 200000
+#define BENCH_REPS 5
+
+#define BENCH_EDITS 200
+
+static int bench_codes[BENCH_ROWS], bench_qtys[BENCH_ROWS];
+
+static unsigned bench_rand_state = 12345u;
+static unsigned bench_rand(void) {
+    bench_rand_state = bench_rand_state * 1103515245u + 12345u;
+    return bench_rand_state >> 8;
+}
+
+static void bench_line(int meds, const char *how, long long ns, int reps) {
+    double per = (double)ns / reps;
+    fprintf(stderr, "%8d  %-16s %10.3f ms %12.0f filas/s\n", meds, how, per / 1e6, BENCH_ROWS / (per / 1e9));
+}
+
+static void bench_size(int meds) {
+    char name[MAX_NAME_LEN];
+    farm_reset();
+    /* altas en orden de codigo descendente: el catalogo no queda ordenado */
+    for (int i = 0; i < meds; ++i) {
+        snprintf(name, sizeof(name), "Medicamento %d", i + 1);
+        farm_med_add(meds - i, name, 1.0 + i % 97, 1000, i % 3 != 0, i % 50);
+    }
+    for (int k = 0; k < BENCH_ROWS; ++k) {
+        bench_codes[k] = 1 + (int)(bench_rand() % (unsigned)(meds + meds / 100 + 1));
+        bench_qtys[k] = 1 + (int)(bench_rand() % 24);
+    }
+
+    long long t0 = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r) {
+        for (int k = 0; k < BENCH_ROWS; ++k) {
+            int idx = find_med_index_by_code(bench_codes[k]);
+            if (idx != -1) branch_receive(0, idx, bench_qtys[k]);
+        }
+    }
+    bench_line(meds, "hash por renglon", now_ns() - t0, BENCH_REPS);
+
+    t0 = now_ns();
+    farm_receive(0, bench_codes, bench_qtys, BENCH_ROWS, NULL, 0, NULL);
+    bench_line(meds, "cruce (primero)", now_ns() - t0, 1);
+
+    t0 = now_ns();
+    for (int r = 0; r < BENCH_REPS; ++r) farm_receive(0, bench_codes, bench_qtys, BENCH_ROWS, NULL, 0, NULL);
+    bench_line(meds, "cruce", now_ns() - t0, BENCH_REPS);
+
+    t0 = now_ns();
+    for (int r = 0; r < BENCH_EDITS; ++r) {
+        farm_med_delete(meds / 2);
+        farm_med_add(meds / 2, "Medicamento repuesto", 1.0, 0, 1, 0);
+    }
+    long long edits = now_ns() - t0;
+    fprintf(stderr, "%8d  %-16s %10.3f ms\n", meds, "baja y alta", (double)edits / BENCH_EDITS / 1e6);
+}
+
+int main(void) {
+    static const int sizes[] = { 10000, 100000, 1000000 };
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+    fprintf(stderr, "Catalogo  Forma                  Tiempo       Renglones (%d por remito)\n", BENCH_ROWS);
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) bench_size(sizes[k]);
+    return 0;
+}